@@ -1,18 +1,112 @@
 // Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
 
 #include "DesktopCharacter.h"
+#include "VR_Lab.h"
+#include "VRCameraBoomComponent.h"
+#include "VRHitchCapture.h"
+#include "VRTelemetry.h"
+#include "VRSignificanceSubsystem.h"
+#include "VRStreamingPredictorComponent.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
 #include "InputActionValue.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
+#include "Containers/Ticker.h"
+#include "Engine/Engine.h"
 #include "Engine/LocalPlayer.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/Controller.h"
+#include "GameFramework/PlayerController.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/PackageName.h"
+#include "Net/UnrealNetwork.h"
 
 DEFINE_LOG_CATEGORY(LogDesktopCharacter);
 
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Perspective Requests Sent"), STAT_DesktopPerspectiveRequests, STATGROUP_VRLab);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Perspective Corrections"), STAT_DesktopPerspectiveCorrections, STATGROUP_VRLab);
+
+static FAutoConsoleCommand PerspectiveLatencyTestCommand(
+    TEXT("VRLab.Perspective.LatencyTest"),
+    TEXT("On a client, toggle the desktop character's perspective and log the round trip to the server and its corrections. Args: [toggles] [quit]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        const int32 Toggles = Args.IsValidIndex(0) && Args[0].IsNumeric() ? FCString::Atoi(*Args[0]) : 20;
+        ADesktopCharacter::StartPerspectiveLatencyTest(Toggles, Args.Contains(TEXT("quit")));
+    }));
+
+namespace DesktopPerspective
+{
+    constexpr uint8 FirstPersonBit = 0x01;
+    constexpr uint8 SequenceShift = 1;
+    constexpr uint8 SequenceMask = 0x7F;
+
+    bool IsFirstPerson(const uint8 State)
+    {
+        return (State & FirstPersonBit) != 0;
+    }
+
+    uint8 GetSequence(const uint8 State)
+    {
+        return static_cast<uint8>(State >> SequenceShift);
+    }
+
+    uint8 MakeState(const bool bFirstPerson, const uint8 Sequence)
+    {
+        return static_cast<uint8>(((Sequence & SequenceMask) << SequenceShift) | (bFirstPerson ? FirstPersonBit : 0));
+    }
+
+    /** Is sequence A later than B, allowing for the seven-bit counter wrapping around? */
+    bool IsNewer(const uint8 A, const uint8 B)
+    {
+        const uint8 Delta = static_cast<uint8>((A - B) & SequenceMask);
+        return Delta != 0 && Delta <= SequenceMask / 2;
+    }
+
+    /** A VRLab.Perspective.LatencyTest run in progress */
+    struct FLatencyTest
+    {
+        FTSTicker::FDelegateHandle TickerHandle;
+        TWeakObjectPtr<ADesktopCharacter> Character;
+        int32 Toggles = 0;
+        int32 TogglesRemaining = 0;
+        bool bQuitWhenDone = false;
+        bool bAwaitingAnswer = false;
+        double StartSeconds = 0.0;
+        double LastToggleSeconds = 0.0;
+        uint32 RequestsAtStart = 0;
+        uint32 CorrectionsAtStart = 0;
+        TArray<double> RoundTripsMs;
+    };
+    static FLatencyTest LatencyTest;
+
+    // How long to wait for the client to join and for each answer before giving up
+    constexpr double LatencyTestJoinTimeout = 60.0;
+    constexpr double LatencyTestAnswerTimeout = 5.0;
+
+    /** The locally controlled desktop character on a network client, if there is one yet */
+    ADesktopCharacter* FindClientCharacter()
+    {
+        for (const FWorldContext& Context : GEngine->GetWorldContexts())
+        {
+            const UWorld* World = Context.World();
+            if (World == nullptr || !World->IsGameWorld() || World->GetNetMode() != NM_Client)
+            {
+                continue;
+            }
+
+            const APlayerController* PlayerController = World->GetFirstPlayerController();
+            if (ADesktopCharacter* Character = PlayerController != nullptr ? PlayerController->GetPawn<ADesktopCharacter>() : nullptr)
+            {
+                return Character;
+            }
+        }
+        return nullptr;
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////
 // ADesktopCharacter
 
@@ -22,8 +116,11 @@ DEFINE_LOG_CATEGORY(LogDesktopCharacter);
  * This function is called when the character is spawned.
  * It sets up the input bindings for the character, the character's size and collision properties,
  * the character's movement properties, and the camera boom that follows the character.
+ * The cameras are optional so the fixed-perspective subclasses can leave out the ones they don't use.
+ *
+ * @param ObjectInitializer Lists the subobjects a subclass doesn't want created.
  */
-ADesktopCharacter::ADesktopCharacter()
+ADesktopCharacter::ADesktopCharacter(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
     // Set size for collision capsule
     GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);
@@ -33,6 +130,9 @@ ADesktopCharacter::ADesktopCharacter()
     bUseControllerRotationYaw = false;
     bUseControllerRotationRoll = false;
 
+    // Let the significance subsystem slow animation down through update rate optimization
+    GetMesh()->bEnableUpdateRateOptimizations = true;
+
     // Configure character movement
     GetCharacterMovement()->bOrientRotationToMovement = true;            // Character moves in the direction of input...
     GetCharacterMovement()->RotationRate = FRotator(0.0f, 500.0f, 0.0f); // ...at this rotation rate
@@ -47,21 +147,33 @@ ADesktopCharacter::ADesktopCharacter()
     GetCharacterMovement()->BrakingDecelerationFalling = 1500.0f;
 
     // Create a camera boom (pulls in towards the player if there is a collision)
-    CameraBoom = CreateDefaultSubobject<USpringArmComponent>("CameraBoom");
-    CameraBoom->SetupAttachment(RootComponent);
-    CameraBoom->TargetArmLength = CameraBoomMaxLength / 2.0f; // The camera follows at this distance behind the character
-    CameraBoom->bUsePawnControlRotation = true;               // Rotate the arm based on the controller
+    CameraBoom = CreateOptionalDefaultSubobject<UVRCameraBoomComponent>("CameraBoom");
+    if (CameraBoom != nullptr)
+    {
+        CameraBoom->SetupAttachment(RootComponent);
+        CameraBoom->TargetArmLength = CameraBoomMaxLength / 2.0f; // The camera follows at this distance behind the character
+        CameraBoom->bUsePawnControlRotation = true;               // Rotate the arm based on the controller
+    }
 
     // Create a follow camera
-    FollowCamera = CreateDefaultSubobject<UCameraComponent>("FollowCamera");
-    FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName);
+    FollowCamera = CreateOptionalDefaultSubobject<UCameraComponent>("FollowCamera");
+    if (FollowCamera != nullptr)
+    {
+        FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName);
 
-    // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
-    FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
+        // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
+        FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
+    }
+
+    FirstPersonCamera = CreateOptionalDefaultSubobject<UCameraComponent>("FirstPersonCamera");
+    if (FirstPersonCamera != nullptr)
+    {
+        FirstPersonCamera->SetupAttachment(GetMesh(), FName("head"));
+        FirstPersonCamera->bUsePawnControlRotation = true;
+    }
 
-    FirstPersonCamera = CreateDefaultSubobject<UCameraComponent>("FirstPersonCamera");
-    FirstPersonCamera->SetupAttachment(GetMesh(), FName("head"));
-    FirstPersonCamera->bUsePawnControlRotation = true;
+    // Prefetch the World Partition cells the character is heading towards
+    StreamingPredictor = CreateDefaultSubobject<UVRStreamingPredictorComponent>("StreamingPredictor");
 }
 
 /**
@@ -76,7 +188,20 @@ void ADesktopCharacter::BeginPlay()
     Super::BeginPlay();
 
     // Note that the camera is positioned in the blueprint and not in the code
-    FirstPersonCamera->Deactivate(); // Always start in 3rd person
+    if (CanTogglePerspective())
+    {
+        FirstPersonCamera->Deactivate(); // Always start in 3rd person...
+        if (DesktopPerspective::IsFirstPerson(PerspectiveState))
+        {
+            ApplyPerspective(true); // ...unless the server has already replicated first person
+        }
+    }
+
+    // Let the significance manager throttle this character when it's far away or off-screen
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->RegisterCharacter(this);
+    }
 
     // Add input mapping context
     // The input mapping context is used to determine which input mapping set to use
@@ -95,6 +220,84 @@ void ADesktopCharacter::BeginPlay()
     }
 }
 
+/**
+ * Takes a character parked in the pawn pool out of the significance manager, so a hidden character isn't budgeted.
+ *
+ * ResetForReuse registers it again.
+ */
+void ADesktopCharacter::ParkForReuse()
+{
+    GetWorldTimerManager().ClearTimer(PerspectiveResendTimer);
+
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->UnregisterCharacter(this);
+    }
+}
+
+/**
+ * Returns the character to the state it started play in, for a pawn taken from the pool.
+ *
+ * Drops any perspective request still waiting on the server, goes back to third person and restores the boom's zoom
+ * and probing. The pool restarts every component's tick, so this also turns the boom off again for a character that
+ * only has the first person camera.
+ */
+void ADesktopCharacter::ResetForReuse()
+{
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->RegisterCharacter(this);
+    }
+
+    GetWorldTimerManager().ClearTimer(PerspectiveResendTimer);
+    bPerspectivePending = false;
+    PendingPerspectiveState = 0;
+    LastPerspectiveToggleTime = -1.0;
+
+    ApplyPerspective(false);
+    PerspectiveState = DesktopPerspective::MakeState(IsInFirstPerson(), 0);
+
+    if (CameraBoom != nullptr)
+    {
+        CameraBoom->TargetArmLength = CastChecked<ADesktopCharacter>(GetArchetype())->CameraBoom->TargetArmLength;
+        CameraBoom->SetProbingEnabled(!IsInFirstPerson());
+    }
+
+    StopJumping();
+    UnCrouch();
+}
+
+/**
+ * Called every frame.
+ *
+ * Times the update so the significance subsystem budgets with what this character actually costs.
+ *
+ * @param DeltaTime Seconds since the last tick.
+ */
+void ADesktopCharacter::Tick(float DeltaTime)
+{
+    LLM_SCOPE_BYTAG(VRLab_CharacterTick);
+    const FVRCharacterTickTimer TickTimer(this);
+    Super::Tick(DeltaTime);
+}
+
+/**
+ * Called when the character is removed from play.
+ *
+ * Removes the character from the significance manager so it no longer counts against the character budget.
+ *
+ * @param EndPlayReason Why the character is leaving play.
+ */
+void ADesktopCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->UnregisterCharacter(this);
+    }
+
+    Super::EndPlay(EndPlayReason);
+}
+
 /**
  * Sets up the player input component.
  *
@@ -142,12 +345,18 @@ void ADesktopCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCo
         EnhancedInputComponent->BindAction(LookAction, ETriggerEvent::Triggered, this, &ThisClass::Look);
 
         // Zooming
-        // The zooming action is bound to the mouse wheel.
-        EnhancedInputComponent->BindAction(ZoomAction, ETriggerEvent::Triggered, this, &ThisClass::BoomZoom);
+        // The zooming action is bound to the mouse wheel, when there is a boom to zoom.
+        if (CameraBoom != nullptr)
+        {
+            EnhancedInputComponent->BindAction(ZoomAction, ETriggerEvent::Triggered, this, &ThisClass::BoomZoom);
+        }
 
         // Perspective
-        // The perspective action is bound to the 'p' key by default.
-        EnhancedInputComponent->BindAction(PerspectiveAction, ETriggerEvent::Triggered, this, &ThisClass::TogglePerspective);
+        // The perspective action is bound to the 'p' key by default, when there are two perspectives to toggle.
+        if (CanTogglePerspective())
+        {
+            EnhancedInputComponent->BindAction(PerspectiveAction, ETriggerEvent::Triggered, this, &ThisClass::TogglePerspective);
+        }
     }
     else
     {
@@ -169,6 +378,8 @@ void ADesktopCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputCo
  */
 void ADesktopCharacter::Move(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_Move);
+
     // input is a Vector2D
     const FVector2D MovementVector = Value.Get<FVector2D>();
 
@@ -208,6 +419,8 @@ void ADesktopCharacter::Move(const FInputActionValue& Value)
  */
 void ADesktopCharacter::Look(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_Look);
+
     // input is a Vector2D
     const FVector2D LookAxisVector = Value.Get<FVector2D>();
 
@@ -229,6 +442,8 @@ void ADesktopCharacter::Look(const FInputActionValue& Value)
 // ReSharper disable once CppMemberFunctionMayBeConst
 void ADesktopCharacter::BoomZoom(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_Zoom);
+
     // Increase the arm length based on the input value
     CameraBoom->TargetArmLength += Value.Get<float>() * CameraBoomZoomSpeed;
 
@@ -251,73 +466,360 @@ void ADesktopCharacter::BoomZoom(const FInputActionValue& Value)
 bool ADesktopCharacter::IsInFirstPerson() const
 {
     // Check if the first person camera is active
-    return FirstPersonCamera->IsActive();
+    return FirstPersonCamera != nullptr && FirstPersonCamera->IsActive();
 }
 
 /**
- * Toggles the character's perspective between first person and third person.
+ * Gets the perspective the character is in.
+ *
+ * @return DesktopFirstPerson or DesktopThirdPerson
+ */
+EVRCharacterMode ADesktopCharacter::GetCharacterMode() const
+{
+    return IsInFirstPerson() ? EVRCharacterMode::DesktopFirstPerson : EVRCharacterMode::DesktopThirdPerson;
+}
+
+/**
+ * Identifies Blueprint subclasses to the asset manager.
  *
- * If the character is in first person, this function will switch to third person.
- * If the character is in third person, this function will switch to first person.
+ * The asset manager asks each Blueprint's class default object. DefaultGame.ini scans for the DesktopPawn type and
+ * gives it a chunk of its own, so a VR-only build can leave the desktop character's assets out.
  *
- * This function is called on the client, and it will call the server function
- * Server_TogglePerspective_Implementation() to perform the actual toggling.
+ * @return A DesktopPawn id named after the Blueprint for a Blueprint's class default object, otherwise none
+ */
+FPrimaryAssetId ADesktopCharacter::GetPrimaryAssetId() const
+{
+    if (HasAnyFlags(RF_ClassDefaultObject) && !GetClass()->HasAnyClassFlags(CLASS_Native))
+    {
+        return FPrimaryAssetId(FPrimaryAssetType(TEXT("DesktopPawn")), FPackageName::GetShortFName(GetOutermost()->GetFName()));
+    }
+    return Super::GetPrimaryAssetId();
+}
+
+/**
+ * Toggles the character's perspective between first person and third person.
+ *
+ * The owning client switches cameras straight away rather than waiting on the server. The request then goes out as an
+ * unreliable RPC carrying the new state and a sequence number, and is sent again until the replicated
+ * PerspectiveState answers it. Toggles closer together than MinPerspectiveToggleInterval are ignored.
  */
 void ADesktopCharacter::TogglePerspective()
 {
-    if (!HasAuthority())
+    VRLAB_HITCH_SCOPE(Input_Perspective);
+
+    const double Now = GetWorld()->GetTimeSeconds();
+    if (LastPerspectiveToggleTime >= 0.0 && Now - LastPerspectiveToggleTime < MinPerspectiveToggleInterval)
     {
-        // If we are on the client, we need to call the server function
-        // to perform the actual toggling
-        UE_LOG(LogDesktopCharacter, Verbose, TEXT("Client_TogglePerspective"))
-        Server_TogglePerspective();
+        return;
+    }
+    LastPerspectiveToggleTime = Now;
+
+    const bool bFirstPerson = !IsInFirstPerson();
+    const uint8 PreviousState = bPerspectivePending ? PendingPerspectiveState : PerspectiveState;
+    const uint8 NextSequence = static_cast<uint8>(DesktopPerspective::GetSequence(PreviousState) + 1);
+    const uint8 NewState = DesktopPerspective::MakeState(bFirstPerson, NextSequence);
+    ApplyPerspective(bFirstPerson);
+
+    if (HasAuthority())
+    {
+        // Listen server or standalone: there is nobody to ask
+        PerspectiveState = NewState;
+        return;
+    }
+
+    UE_LOG(LogDesktopCharacter, Verbose, TEXT("Requesting perspective state %d"), NewState);
+    if (!bPerspectivePending)
+    {
+        PerspectiveRequestSeconds = FPlatformTime::Seconds();
+    }
+    PendingPerspectiveState = NewState;
+    bPerspectivePending = true;
+    Server_SetPerspective(NewState);
+    ++PerspectiveRequestsSent;
+    INC_DWORD_STAT(STAT_DesktopPerspectiveRequests);
+    GetWorldTimerManager().SetTimer(PerspectiveResendTimer,
+                                    this,
+                                    &ADesktopCharacter::ResendPerspectiveRequest,
+                                    PerspectiveResendInterval,
+                                    true);
+}
+
+/**
+ * Switches cameras, boom probing and rotation handling to match the given perspective.
+ *
+ * @param bFirstPerson true to switch to the first person camera, false for the follow camera
+ */
+void ADesktopCharacter::ApplyPerspective(const bool bFirstPerson)
+{
+    if (!CanTogglePerspective() || bFirstPerson == IsInFirstPerson())
+    {
+        return;
+    }
+
+    if (bFirstPerson)
+    {
+        UE_LOG(LogDesktopCharacter, Verbose, TEXT("Switching to first person"))
+        FollowCamera->Deactivate();
+        FirstPersonCamera->Activate();
+        CameraBoom->SetProbingEnabled(false); // Nothing to keep out of walls while the follow camera is off
+        if (Controller != nullptr)
+        {
+            Controller->SetControlRotation(GetActorRotation()); // re-orient the camera to the direction the character is facing
+        }
+        bUseControllerRotationYaw = true;
+        GetCharacterMovement()->bOrientRotationToMovement = false;
     }
     else
     {
-        // If we are on the server, we can perform the actual toggling here
-        // If we are in first person, switch to third person
-        if (IsInFirstPerson())
+        UE_LOG(LogDesktopCharacter, Verbose, TEXT("Switching to third person"))
+        CameraBoom->SetProbingEnabled(true);
+        FollowCamera->Activate();
+        FirstPersonCamera->Deactivate();
+        bUseControllerRotationYaw = false;
+        GetCharacterMovement()->bOrientRotationToMovement = true;
+    }
+    FVRTelemetry::Record(EVRTelemetryEvent::PerspectiveToggled, GetUniqueID(), bFirstPerson ? 1 : 0);
+}
+
+/**
+ * Sends the unanswered perspective request again, in case the unreliable RPC was dropped.
+ */
+void ADesktopCharacter::ResendPerspectiveRequest()
+{
+    if (!bPerspectivePending)
+    {
+        GetWorldTimerManager().ClearTimer(PerspectiveResendTimer);
+        return;
+    }
+
+    Server_SetPerspective(PendingPerspectiveState);
+    ++PerspectiveRequestsSent;
+    INC_DWORD_STAT(STAT_DesktopPerspectiveRequests);
+}
+
+/**
+ * Starts a perspective latency test on this process's network client.
+ *
+ * The test runs on the core ticker rather than in a world, so it can be started from -ExecCmds before the client has
+ * connected. It waits for the client's desktop character, then toggles once the previous toggle has been answered and
+ * the toggle interval has passed. Run it against a server with NetEmulation.PktLag and PktLoss set to see how the
+ * resends and corrections hold up.
+ *
+ * @param Toggles How many perspective changes to ask the server for
+ * @param bQuitWhenDone Exit once the report is logged, with a failure status if any toggle went unanswered
+ */
+void ADesktopCharacter::StartPerspectiveLatencyTest(const int32 Toggles, const bool bQuitWhenDone)
+{
+    using namespace DesktopPerspective;
+
+    if (LatencyTest.TickerHandle.IsValid())
+    {
+        UE_LOG(LogDesktopCharacter, Warning, TEXT("A perspective latency test is already running"));
+        return;
+    }
+
+    LatencyTest = FLatencyTest();
+    LatencyTest.Toggles = FMath::Max(Toggles, 1);
+    LatencyTest.TogglesRemaining = LatencyTest.Toggles;
+    LatencyTest.bQuitWhenDone = bQuitWhenDone;
+    LatencyTest.StartSeconds = FPlatformTime::Seconds();
+    LatencyTest.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&ADesktopCharacter::TickPerspectiveLatencyTest));
+    UE_LOG(LogDesktopCharacter, Display, TEXT("Perspective latency test: waiting for a client character to toggle %d times"), LatencyTest.Toggles);
+}
+
+/**
+ * Advances the perspective latency test by one tick, and logs the report when it finishes.
+ *
+ * @param DeltaTime Unused; the test works from wall clock time so it measures what the player would see
+ * @return false once the test is over, which removes it from the ticker
+ */
+bool ADesktopCharacter::TickPerspectiveLatencyTest(float DeltaTime)
+{
+    using namespace DesktopPerspective;
+
+    const double Now = FPlatformTime::Seconds();
+    ADesktopCharacter* Character = LatencyTest.Character.Get();
+    bool bFinished = false;
+    if (Character == nullptr && !LatencyTest.Character.IsExplicitlyNull())
+    {
+        UE_LOG(LogDesktopCharacter, Error, TEXT("Perspective latency test: the character went away"));
+        bFinished = true;
+    }
+    else if (Character == nullptr)
+    {
+        Character = FindClientCharacter();
+        if (Character != nullptr && Character->CanTogglePerspective())
         {
-            UE_LOG(LogDesktopCharacter, Verbose, TEXT("Switching to third person"))
-            FollowCamera->Activate();
-            FirstPersonCamera->Deactivate();
-            bUseControllerRotationYaw = false;
-            GetCharacterMovement()->bOrientRotationToMovement = true;
+            LatencyTest.Character = Character;
+            LatencyTest.RequestsAtStart = Character->PerspectiveRequestsSent;
+            LatencyTest.CorrectionsAtStart = Character->PerspectiveCorrections;
+            LatencyTest.LastToggleSeconds = Now;
         }
-        else // If we are in third person, switch to first person
+        else if (Now - LatencyTest.StartSeconds > LatencyTestJoinTimeout)
         {
-            UE_LOG(LogDesktopCharacter, Verbose, TEXT("Switching to first person"))
-            FollowCamera->Deactivate();
-            FirstPersonCamera->Activate();
-            GetController()->SetControlRotation(GetActorRotation()); // re-orient the camera to the direction the character is facing
-            bUseControllerRotationYaw = true;
-            GetCharacterMovement()->bOrientRotationToMovement = false;
+            UE_LOG(LogDesktopCharacter, Error, TEXT("Perspective latency test: no client character that can toggle perspective"));
+            bFinished = true;
         }
+        Character = nullptr; // Start toggling on the next tick
     }
+    else if (LatencyTest.bAwaitingAnswer)
+    {
+        if (!Character->bPerspectivePending)
+        {
+            LatencyTest.RoundTripsMs.Add(Character->LastPerspectiveRoundTripMs);
+            LatencyTest.bAwaitingAnswer = false;
+        }
+        else if (Now - LatencyTest.LastToggleSeconds > LatencyTestAnswerTimeout)
+        {
+            UE_LOG(LogDesktopCharacter, Error, TEXT("Perspective latency test: no answer after %.0f s"), LatencyTestAnswerTimeout);
+            bFinished = true;
+        }
+    }
+    else if (LatencyTest.TogglesRemaining == 0)
+    {
+        bFinished = true;
+    }
+    else if (Now - LatencyTest.LastToggleSeconds > Character->MinPerspectiveToggleInterval * 1.5f)
+    {
+        // The character can still refuse a toggle that comes too soon by game time; just try again next tick
+        Character->TogglePerspective();
+        if (Character->bPerspectivePending)
+        {
+            LatencyTest.LastToggleSeconds = Now;
+            LatencyTest.bAwaitingAnswer = true;
+            --LatencyTest.TogglesRemaining;
+        }
+    }
+
+    if (!bFinished)
+    {
+        return true;
+    }
+
+    const int32 Answered = LatencyTest.RoundTripsMs.Num();
+    if (Answered > 0)
+    {
+        LatencyTest.RoundTripsMs.Sort();
+        double TotalMs = 0.0;
+        for (const double RoundTripMs : LatencyTest.RoundTripsMs)
+        {
+            TotalMs += RoundTripMs;
+        }
+        UE_LOG(LogDesktopCharacter,
+               Display,
+               TEXT("Perspective round trip over %d toggles: min %.1f ms, median %.1f ms, average %.1f ms, max %.1f ms"),
+               Answered,
+               LatencyTest.RoundTripsMs[0],
+               LatencyTest.RoundTripsMs[Answered / 2],
+               TotalMs / Answered,
+               LatencyTest.RoundTripsMs.Last());
+    }
+    if (Character != nullptr)
+    {
+        UE_LOG(LogDesktopCharacter,
+               Display,
+               TEXT("Perspective requests: %d of %d toggles answered, %u sent including resends, %u corrected by the server"),
+               Answered,
+               LatencyTest.Toggles,
+               Character->PerspectiveRequestsSent - LatencyTest.RequestsAtStart,
+               Character->PerspectiveCorrections - LatencyTest.CorrectionsAtStart);
+    }
+
+    LatencyTest.TickerHandle.Reset();
+    if (LatencyTest.bQuitWhenDone)
+    {
+        FPlatformMisc::RequestExitWithStatus(false, Answered == LatencyTest.Toggles ? 0 : 1);
+    }
+    return false;
 }
 
 /**
- * Called on the server to toggle the character's perspective between first person and third person.
+ * Called on the server when the owning client asks for a perspective.
+ *
+ * Duplicates and requests that arrive out of order are dropped. Otherwise the server answers every request by
+ * replicating the request's sequence number alongside the perspective it settled on, which is the requested one
+ * unless the client is toggling faster than allowed.
  *
- * This function is called by the client when the player presses the toggle perspective button.
- * It will call the TogglePerspective() function, which will actually perform the toggling.
+ * @param RequestedState The perspective bit and sequence number the client wants
  */
-void ADesktopCharacter::Server_TogglePerspective_Implementation()
+void ADesktopCharacter::Server_SetPerspective_Implementation(const uint8 RequestedState)
 {
-    UE_LOG(LogDesktopCharacter, Verbose, TEXT("Server_TogglePerspective_Implementation"));
-    TogglePerspective();
+    const uint8 Sequence = DesktopPerspective::GetSequence(RequestedState);
+    if (!DesktopPerspective::IsNewer(Sequence, DesktopPerspective::GetSequence(PerspectiveState)))
+    {
+        return;
+    }
+
+    // Requests can arrive bunched up by network jitter, so only hold the server to half the client's interval
+    const double Now = GetWorld()->GetTimeSeconds();
+    if (LastPerspectiveToggleTime >= 0.0 && Now - LastPerspectiveToggleTime < MinPerspectiveToggleInterval * 0.5f)
+    {
+        UE_LOG(LogDesktopCharacter, Verbose, TEXT("Rejecting perspective state %d, toggled too quickly"), RequestedState);
+        PerspectiveState = DesktopPerspective::MakeState(IsInFirstPerson(), Sequence);
+        return;
+    }
+
+    LastPerspectiveToggleTime = Now;
+    ApplyPerspective(DesktopPerspective::IsFirstPerson(RequestedState));
+    PerspectiveState = RequestedState;
 }
 
 /**
- * Validation function for the Server_TogglePerspective_Implementation() function.
+ * Called on clients when the server's perspective state arrives.
  *
- * This function is called before the Server_TogglePerspective_Implementation() function is called.
- * It is used to validate the parameters of the function, and to check if the function should be called.
+ * The owning client ignores answers to requests older than the one it is waiting on. Once its latest request is
+ * answered it adopts the server's perspective, which undoes the local change if the server rejected it.
+ */
+void ADesktopCharacter::OnRep_PerspectiveState()
+{
+    if (bPerspectivePending)
+    {
+        if (DesktopPerspective::GetSequence(PerspectiveState) != DesktopPerspective::GetSequence(PendingPerspectiveState))
+        {
+            return;
+        }
+
+        bPerspectivePending = false;
+        GetWorldTimerManager().ClearTimer(PerspectiveResendTimer);
+        LastPerspectiveRoundTripMs = (FPlatformTime::Seconds() - PerspectiveRequestSeconds) * 1000.0;
+        if (PerspectiveState != PendingPerspectiveState)
+        {
+            UE_LOG(LogDesktopCharacter, Verbose, TEXT("Server corrected perspective state to %d"), PerspectiveState);
+            ++PerspectiveCorrections;
+            INC_DWORD_STAT(STAT_DesktopPerspectiveCorrections);
+        }
+    }
+
+    ApplyPerspective(DesktopPerspective::IsFirstPerson(PerspectiveState));
+}
+
+/**
+ * Registers the replicated perspective state.
+ */
+void ADesktopCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+    Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+    // Always notify so the owner hears the answer even when it matches what it already predicted
+    DOREPLIFETIME_CONDITION_NOTIFY(ADesktopCharacter, PerspectiveState, COND_None, REPNOTIFY_Always);
+}
+
+/**
+ * Describes the character for a hitch capture.
  *
- * @return true if the function should be called, false otherwise
+ * @param State The capture's player state, with the pawn's location already filled in
  */
-bool ADesktopCharacter::Server_TogglePerspective_Validate()
+void ADesktopCharacter::DescribeForHitch(FVRHitchPlayerState& State) const
 {
-    UE_LOG(LogDesktopCharacter, Verbose, TEXT("Server_TogglePerspective_Validate"));
-    return true;
+    const UCameraComponent* ActiveCamera = IsInFirstPerson() ? FirstPersonCamera : FollowCamera;
+    State.HeadLocation = ActiveCamera->GetComponentLocation();
+    State.HeadRotation = ActiveCamera->GetComponentRotation();
+
+    // EPose only applies to VR characters, so report the perspective in its place
+    State.Pose = IsInFirstPerson() ? TEXT("FirstPerson") : TEXT("ThirdPerson");
+    State.AddInput(this, MoveAction);
+    State.AddInput(this, LookAction);
+    State.AddInput(this, JumpAction);
+    State.AddInput(this, ZoomAction);
+    State.AddInput(this, PerspectiveAction);
 }
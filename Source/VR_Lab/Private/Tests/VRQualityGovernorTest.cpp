@@ -0,0 +1,108 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "CoreMinimal.h"
+#include "VRQualityGovernor.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVRQualityGovernorTierSequenceTest,
+                                 "VRLab.QualityGovernor.TierSequence",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+namespace VRQualityGovernorTest
+{
+    /** Append Frames frames with the given game, render and GPU times */
+    void AddFrames(TArray<FVRFrameTimeSample>& Trace, const int32 Frames, const float GameMs, const float RenderMs, const float GPUMs)
+    {
+        for (int32 Frame = 0; Frame < Frames; ++Frame)
+        {
+            Trace.Add({GameMs, RenderMs, GPUMs});
+        }
+    }
+
+    FString Describe(const TArray<int32>& Tiers)
+    {
+        return FString::JoinBy(Tiers, TEXT(","), [](const int32 Tier) { return FString::FromInt(Tier); });
+    }
+}
+
+bool FVRQualityGovernorTierSequenceTest::RunTest(const FString& Parameters)
+{
+    using namespace VRQualityGovernorTest;
+
+    // 72 Hz: a 13.9 ms budget, downshift above 13.2 ms and upshift below 10.4 ms
+    FVRQualityGovernor::FSettings Settings;
+    Settings.NumTiers = 4;
+    Settings.FrameBudgetMs = 1000.0f / 72.0f;
+    Settings.WindowFrames = 60;
+    Settings.DownshiftRatio = 0.95f;
+    Settings.UpshiftRatio = 0.75f;
+    Settings.UpshiftHoldFrames = 300;
+
+    struct FCase
+    {
+        const TCHAR* Name;
+        TArray<FVRFrameTimeSample> Trace;
+        TArray<int32> ExpectedTiers;
+    };
+    TArray<FCase> Cases;
+
+    // Comfortably inside the budget at the top tier already
+    FCase& Steady = Cases.Add_GetRef({TEXT("Steady"), {}, {0}});
+    AddFrames(Steady.Trace, 600, 6.0f, 7.0f, 9.0f);
+
+    // One 100 ms hitch is averaged away by the window
+    FCase& Hitch = Cases.Add_GetRef({TEXT("Hitch"), {}, {0}});
+    AddFrames(Hitch.Trace, 200, 6.0f, 7.0f, 9.0f);
+    AddFrames(Hitch.Trace, 1, 100.0f, 7.0f, 9.0f);
+    AddFrames(Hitch.Trace, 400, 6.0f, 7.0f, 9.0f);
+
+    // Between the thresholds neither shift happens
+    FCase& Hover = Cases.Add_GetRef({TEXT("Hover"), {}, {0}});
+    AddFrames(Hover.Trace, 900, 6.0f, 7.0f, 12.0f);
+
+    // A GPU that never keeps up walks down every tier one window at a time and stays at the bottom
+    FCase& Overload = Cases.Add_GetRef({TEXT("Overload"), {}, {0, 1, 2, 3}});
+    AddFrames(Overload.Trace, 600, 8.0f, 9.0f, 16.0f);
+
+    // Two windows over budget, then recovery climbs back only after the hold period at each tier
+    FCase& Recovery = Cases.Add_GetRef({TEXT("Recovery"), {}, {0, 1, 2, 1, 0}});
+    AddFrames(Recovery.Trace, 120, 8.0f, 9.0f, 16.0f);
+    AddFrames(Recovery.Trace, 1000, 5.0f, 6.0f, 8.0f);
+
+    // Recovery that doesn't last as long as the hold period doesn't count
+    FCase& ShortRecovery = Cases.Add_GetRef({TEXT("ShortRecovery"), {}, {0, 1}});
+    AddFrames(ShortRecovery.Trace, 60, 8.0f, 9.0f, 16.0f);
+    AddFrames(ShortRecovery.Trace, 300, 5.0f, 6.0f, 8.0f);
+    AddFrames(ShortRecovery.Trace, 60, 6.0f, 7.0f, 12.0f);
+    AddFrames(ShortRecovery.Trace, 300, 5.0f, 6.0f, 8.0f);
+
+    for (const FCase& Case : Cases)
+    {
+        const TArray<int32> Tiers = FVRQualityGovernor::Replay(Settings, Case.Trace);
+        TestTrue(FString::Printf(TEXT("%s: expected tiers %s, got %s"), Case.Name, *Describe(Case.ExpectedTiers), *Describe(Tiers)),
+                 Tiers == Case.ExpectedTiers);
+    }
+
+    // A tier change reports the averages of the window behind it, not the frame that completed the window
+    FVRQualityGovernor Governor(Settings);
+    TArray<FVRFrameTimeSample> RenderBound;
+    AddFrames(RenderBound, 59, 8.0f, 15.0f, 12.0f);
+    AddFrames(RenderBound, 1, 30.0f, 9.0f, 10.0f);
+    for (const FVRFrameTimeSample& Sample : RenderBound)
+    {
+        Governor.AddSample(Sample);
+    }
+    if (TestEqual(TEXT("Render bound window drops a tier"), Governor.GetTier(), 1))
+    {
+        const FVRFrameTimeSample& Average = Governor.GetChangeAverage();
+        TestEqual(TEXT("Bottleneck of the window"), FString(Average.GetBottleneckName()), FString(TEXT("Render")));
+        TestNearlyEqual(TEXT("Window average render time"), Average.RenderThreadMs, (59 * 15.0f + 9.0f) / 60.0f, 0.01f);
+        TestNearlyEqual(TEXT("Window average bottleneck"), Governor.GetChangeAverageMs(), (59 * 15.0f + 30.0f) / 60.0f, 0.01f);
+    }
+
+    return true;
+}
+
+#endif
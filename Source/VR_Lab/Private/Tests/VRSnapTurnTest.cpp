@@ -0,0 +1,77 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "CoreMinimal.h"
+#include "InputActionValue.h"
+#include "VRModeCharacters.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVRSnapTurnCountTest,
+                                 "VRLab.Character.SnapTurnCount",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+namespace VRSnapTurnTest
+{
+    /**
+     * Hold the stick right for just under Intervals repeat intervals at a fixed frame rate, then let go. That is the
+     * first turn plus Intervals - 1 repeats. Returns the yaw the character turned through.
+     */
+    float HoldStick(AVRCharacter* Character, const int32 Intervals, const float FrameRate, const float SnapTurnDelay)
+    {
+        const float DeltaTime = 1.0f / FrameRate;
+        const int32 Frames = FMath::CeilToInt((Intervals - 0.5f) * SnapTurnDelay / DeltaTime);
+        const float StartYaw = Character->GetActorRotation().Yaw;
+        FTimerManager& TimerManager = Character->GetWorldTimerManager();
+
+        // Enhanced input sends Triggered every frame the stick is held. The timer manager only ticks once per frame.
+        for (int32 Frame = 0; Frame < Frames; ++Frame)
+        {
+            Character->SnapTurn(FInputActionValue(FVector2D(1.0, 0.0)));
+            TimerManager.Tick(DeltaTime);
+            Character->Tick(DeltaTime);
+            ++GFrameCounter;
+        }
+        Character->ReleaseSnapTurn(FInputActionValue(FVector2D::ZeroVector));
+        TimerManager.Tick(DeltaTime);
+        Character->Tick(DeltaTime);
+        ++GFrameCounter;
+
+        return FRotator::NormalizeAxis(Character->GetActorRotation().Yaw - StartYaw);
+    }
+}
+
+bool FVRSnapTurnCountTest::RunTest(const FString& Parameters)
+{
+    // A bare game world. Play never begins, so the character's BeginPlay leaves the HMD and tracking origin alone.
+    UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+    FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+    WorldContext.SetCurrentWorld(World);
+
+    FActorSpawnParameters SpawnInfo;
+    SpawnInfo.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+    AVRCharacter* Character = World->SpawnActor<ASeatedVRCharacter>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnInfo);
+    if (TestNotNull(TEXT("Character spawned"), Character))
+    {
+        const AVRCharacter* Defaults = GetDefault<ASeatedVRCharacter>();
+        for (const float FrameRate : {24.0f, 72.0f, 90.0f, 120.0f})
+        {
+            for (const int32 Intervals : {1, 3, 6})
+            {
+                const float Yaw = HoldStick(Character, Intervals, FrameRate, Defaults->SnapTurnDelay);
+                TestNearlyEqual(FString::Printf(TEXT("Yaw after %d intervals at %.0f Hz"), Intervals, FrameRate),
+                                Yaw,
+                                Intervals * Defaults->SnapTurnAngle,
+                                KINDA_SMALL_NUMBER * 100.0f);
+            }
+        }
+    }
+
+    GEngine->DestroyWorldContext(World);
+    World->DestroyWorld(false);
+    return true;
+}
+
+#endif
@@ -0,0 +1,135 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRCameraBoomComponent.h"
+
+#include "VR_Lab.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Camera Boom Sync Probe"), STAT_VRCameraBoomSync, STATGROUP_VRLab);
+DECLARE_CYCLE_STAT(TEXT("Camera Boom Async Probe"), STAT_VRCameraBoomAsync, STATGROUP_VRLab);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Camera Boom Sync Fallbacks"), STAT_VRCameraBoomSyncFallbacks, STATGROUP_VRLab);
+
+static TAutoConsoleVariable<bool> CVarCameraBoomForceSyncProbe(
+    TEXT("VRLab.CameraBoom.ForceSyncProbe"),
+    false,
+    TEXT("Make every camera boom use the engine's synchronous collision sweep, for comparing against the async probe."));
+
+UVRCameraBoomComponent::UVRCameraBoomComponent()
+{
+    ProbeDelegate.BindUObject(this, &UVRCameraBoomComponent::OnProbeTraced);
+}
+
+void UVRCameraBoomComponent::SetProbingEnabled(const bool bEnabled)
+{
+    SetComponentTickEnabled(bEnabled);
+
+    // Anything probed before the boom was switched off no longer describes where the arm is
+    ++ProbeId;
+    bProbeInFlight = false;
+    bHasProbeResult = false;
+}
+
+void UVRCameraBoomComponent::UpdateDesiredArmLocation(const bool bDoTrace,
+                                                      const bool bDoLocationLag,
+                                                      const bool bDoRotationLag,
+                                                      const float DeltaTime)
+{
+    if (!bAsyncProbe || !bDoTrace || TargetArmLength == 0.0f || CVarCameraBoomForceSyncProbe.GetValueOnGameThread())
+    {
+        SCOPE_CYCLE_COUNTER(STAT_VRCameraBoomSync);
+        Super::UpdateDesiredArmLocation(bDoTrace, bDoLocationLag, bDoRotationLag, DeltaTime);
+        ArmFraction = 1.0f;
+        return;
+    }
+
+    SCOPE_CYCLE_COUNTER(STAT_VRCameraBoomAsync);
+
+    // Let the spring arm do the lag and offsets without its sweep; this leaves the unobstructed end in UnfixedCameraPosition
+    Super::UpdateDesiredArmLocation(false, bDoLocationLag, bDoRotationLag, DeltaTime);
+    UpdateAsyncProbe(DeltaTime);
+}
+
+void UVRCameraBoomComponent::UpdateAsyncProbe(const float DeltaTime)
+{
+    UWorld* World = GetWorld();
+    const FVector ArmOrigin = PreviousArmOrigin;
+    const FVector DesiredLoc = UnfixedCameraPosition;
+    const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(VRCameraBoom), false, GetOwner());
+
+    float TargetFraction = ArmFraction;
+    if (bHasProbeResult && FVector::DistSquared(ProbeEnd, DesiredLoc) <= FMath::Square(MaxProbeDrift))
+    {
+        TargetFraction = ProbeHitFraction;
+    }
+    else if (!bProbeInFlight || bHasProbeResult)
+    {
+        // No usable result: the first frame after enabling, or the arm swung too far since the probe went out
+        FHitResult Result;
+        World->SweepSingleByChannel(Result,
+                                    ArmOrigin,
+                                    DesiredLoc,
+                                    FQuat::Identity,
+                                    ProbeChannel,
+                                    FCollisionShape::MakeSphere(ProbeSize),
+                                    QueryParams);
+        TargetFraction = Result.bBlockingHit ? Result.Time : 1.0f;
+        INC_DWORD_STAT(STAT_VRCameraBoomSyncFallbacks);
+    }
+    bHasProbeResult = false;
+
+    // Pull in at once so the camera never sees through a wall, but ease back out to hide the frame of latency
+    if (TargetFraction < ArmFraction)
+    {
+        ArmFraction = TargetFraction;
+    }
+    else
+    {
+        ArmFraction = FMath::FInterpTo(ArmFraction, TargetFraction, DeltaTime, ReleaseSpeed);
+    }
+
+    if (!bProbeInFlight)
+    {
+        World->AsyncSweepByChannel(EAsyncTraceType::Single,
+                                   ArmOrigin,
+                                   DesiredLoc,
+                                   FQuat::Identity,
+                                   ProbeChannel,
+                                   FCollisionShape::MakeSphere(ProbeSize),
+                                   QueryParams,
+                                   FCollisionResponseParams::DefaultResponseParam,
+                                   &ProbeDelegate,
+                                   ProbeId);
+        bProbeInFlight = true;
+    }
+
+    // An unobstructed arm is exactly what the spring arm has already placed
+    bIsCameraFixed = ArmFraction < 1.0f;
+    if (!bIsCameraFixed)
+    {
+        return;
+    }
+
+    const FTransform WorldCamTM(PreviousDesiredRot, FMath::Lerp(ArmOrigin, DesiredLoc, ArmFraction));
+    const FTransform RelCamTM = WorldCamTM.GetRelativeTransform(GetComponentTransform());
+    RelativeSocketLocation = RelCamTM.GetLocation();
+    RelativeSocketRotation = RelCamTM.GetRotation();
+    UpdateChildTransforms();
+}
+
+void UVRCameraBoomComponent::OnProbeTraced(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
+{
+    if (TraceDatum.UserData != ProbeId)
+    {
+        return;
+    }
+
+    bProbeInFlight = false;
+    bHasProbeResult = true;
+    ProbeEnd = TraceDatum.End;
+
+    const FHitResult* Hit = TraceDatum.OutHits.FindByPredicate([](const FHitResult& Result)
+    {
+        return Result.bBlockingHit;
+    });
+    ProbeHitFraction = Hit != nullptr ? Hit->Time : 1.0f;
+}
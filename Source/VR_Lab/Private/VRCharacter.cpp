@@ -2,25 +2,53 @@
 
 #include "VRCharacter.h"
 
+#include "VR_Lab.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
+#include "InputAction.h"
+#include "InputMappingContext.h"
+#include "InputTriggers.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "MotionControllerComponent.h"
+#include "VRControllerModelCache.h"
+#include "VRHitchCapture.h"
+#include "VRPhysicsHandComponent.h"
+#include "VRPlayAreaBoundary.h"
+#include "VRSignificanceSubsystem.h"
+#include "VRStreamingPredictorComponent.h"
+#include "VRTelemetry.h"
+#include "VRTeleportComponent.h"
 #include "XRDeviceVisualizationComponent.h"
 #include "Camera/CameraComponent.h"
 #include "Components/ArrowComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/WidgetInteractionComponent.h"
+#include "Engine/GameInstance.h"
 #include "GameFramework/CharacterMovementComponent.h"
+#include "Misc/PackageName.h"
 
 DEFINE_LOG_CATEGORY(LogVRCharacter);
 
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Stale Head Poses Avoided"), STAT_VRStaleHeadPosesAvoided, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Stale Head Pose Error (cm)"), STAT_VRStaleHeadPoseError, STATGROUP_VRLab);
+DECLARE_CYCLE_STAT(TEXT("VR Character Tick (Seated)"), STAT_VRCharacterTickSeated, STATGROUP_VRLab);
+DECLARE_CYCLE_STAT(TEXT("VR Character Tick (Room-scale)"), STAT_VRCharacterTickRoomScale, STATGROUP_VRLab);
+
+static TAutoConsoleVariable<bool> CVarVerifyTracking(
+    TEXT("VRLab.Tracking.Verify"),
+    false,
+    TEXT("Check that everything in a VR character that reads tracking in a frame sees the same poses."));
+
 // Sets default values
-AVRCharacter::AVRCharacter()
+AVRCharacter::AVRCharacter(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
     // Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
     PrimaryActorTick.bCanEverTick = true;
 
+    // Movement runs after the character, once room-scale has placed the capsule. By default the character waits for
+    // its movement instead, and BeginPlay's prerequisite would then make a cycle.
+    GetCharacterMovement()->bTickBeforeOwner = false;
+
     // Create the objects we'll need
     VROrigin = CreateDefaultSubobject<USceneComponent>("VROrigin");
     Camera = CreateDefaultSubobject<UCameraComponent>("Camera");
@@ -40,6 +68,12 @@ AVRCharacter::AVRCharacter()
     UWidgetInteractionComponent* RightWidgetInteractionComponent = CreateDefaultSubobject<
         UWidgetInteractionComponent>("Right Widget Interaction");
 
+    TeleportComponent = CreateDefaultSubobject<UVRTeleportComponent>("Teleport");
+
+    // Only standing play has a play area to stay inside
+    PlayAreaBoundary = CreateOptionalDefaultSubobject<UVRPlayAreaBoundaryComponent>("PlayAreaBoundary");
+    StreamingPredictor = CreateDefaultSubobject<UVRStreamingPredictorComponent>("StreamingPredictor");
+
     // Attach all the objects to their locations for a VR Character
     VROrigin->SetupAttachment(GetRootComponent());
     Camera->SetupAttachment(VROrigin);
@@ -48,11 +82,29 @@ AVRCharacter::AVRCharacter()
     LeftWidgetInteractionComponent->SetupAttachment(LeftMotionController);
     RightWidgetInteractionComponent->SetupAttachment(RightMotionController);
 
+    // Physics hands follow the controllers through simulation, so they hang off the origin rather than the controllers.
+    // They are optional, and inactive until BeginPlay finds bPhysicsHands set.
+    LeftPhysicsHand = CreateOptionalDefaultSubobject<UVRPhysicsHandComponent>("LeftPhysicsHand");
+    if (LeftPhysicsHand != nullptr)
+    {
+        LeftPhysicsHand->SetupAttachment(VROrigin);
+    }
+    RightPhysicsHand = CreateOptionalDefaultSubobject<UVRPhysicsHandComponent>("RightPhysicsHand");
+    if (RightPhysicsHand != nullptr)
+    {
+        RightPhysicsHand->SetupAttachment(VROrigin);
+    }
+
     LeftHandMesh = CreateDefaultSubobject<USkeletalMeshComponent>("LeftHandMesh");
     LeftHandMesh->SetupAttachment(LeftMotionController);
     RightHandMesh = CreateDefaultSubobject<USkeletalMeshComponent>("RightHandMesh");
     RightHandMesh->SetupAttachment(RightMotionController);
 
+    // Let the significance subsystem slow animation down through update rate optimization
+    GetMesh()->bEnableUpdateRateOptimizations = true;
+    LeftHandMesh->bEnableUpdateRateOptimizations = true;
+    RightHandMesh->bEnableUpdateRateOptimizations = true;
+
     // TODO: Hand visualization should be handled by OpenXR
     // RightHandMeshSkeleton = ConstructorHelpers::FObjectFinder<USkeletalMesh>(TEXT("SkeletalMesh'/Game/VirtualReality/Mannequin/Character/Mesh/MannequinHand_Right.MannequinHand_Right'")).Object;
     // if (RightHandMeshSkeleton != nullptr)
@@ -73,42 +125,25 @@ AVRCharacter::AVRCharacter()
     // RightHandMesh->SetAnimInstanceClass(AnimBp);
     // }
 
-    // Set up arrows for debugging
-    LeftHandForwardArrow = CreateDefaultSubobject<UArrowComponent>("LeftHandForwardArrow");
-    LeftHandForwardArrow->SetupAttachment(LeftMotionController);
-    LeftHandForwardArrow->SetArrowColor(FColor::Red);
-    LeftHandForwardArrow->SetArrowSize(0.2f);
-    LeftHandForwardArrow->SetArrowLength(40.0f);
-
-    LeftHandForwardGoArrow = CreateDefaultSubobject<UArrowComponent>("LeftHandForwardGoArrow");
-    LeftHandForwardGoArrow->SetupAttachment(LeftMotionController);
-    LeftHandForwardGoArrow->SetArrowColor(FColor::Cyan);
-    LeftHandForwardGoArrow->SetArrowSize(0.2f);
-    LeftHandForwardGoArrow->SetArrowLength(80.0f);
-
-    LeftHandRightGoArrow = CreateDefaultSubobject<UArrowComponent>("LeftHandRightGoArrow");
-    LeftHandRightGoArrow->SetupAttachment(LeftMotionController);
-    LeftHandRightGoArrow->SetArrowColor(FColor::Yellow);
-    LeftHandRightGoArrow->SetArrowSize(0.2f);
-    LeftHandRightGoArrow->SetArrowLength(80.0f);
-
-    LeftHandRightArrow = CreateDefaultSubobject<UArrowComponent>("LeftHandRightArrow");
-    LeftHandRightArrow->SetupAttachment(LeftMotionController);
-    LeftHandRightArrow->SetArrowColor(FColor::Green);
-    LeftHandRightArrow->SetArrowSize(0.2f);
-    LeftHandRightArrow->SetArrowLength(40.0f);
-
-    RightHandForwardArrow = CreateDefaultSubobject<UArrowComponent>("RightHandForwardArrow");
-    RightHandForwardArrow->SetupAttachment(RightMotionController);
-    RightHandForwardArrow->SetArrowColor(FColor::Red);
-    RightHandForwardArrow->SetArrowSize(0.2f);
-    RightHandForwardArrow->SetArrowLength(40.0f);
-
-    RightHandRightArrow = CreateDefaultSubobject<UArrowComponent>("RightHandRightArrow");
-    RightHandRightArrow->SetupAttachment(RightMotionController);
-    RightHandRightArrow->SetArrowColor(FColor::Green);
-    RightHandRightArrow->SetArrowSize(0.2f);
-    RightHandRightArrow->SetArrowLength(40.0f);
+    // Set up arrows for debugging. Fixed-mode subclasses leave them out.
+    const auto CreateArrow = [this](const FName Name, USceneComponent* Parent, const FColor Color, const float Length)
+    {
+        UArrowComponent* Arrow = CreateOptionalDefaultSubobject<UArrowComponent>(Name);
+        if (Arrow != nullptr)
+        {
+            Arrow->SetupAttachment(Parent);
+            Arrow->SetArrowColor(Color);
+            Arrow->SetArrowSize(0.2f);
+            Arrow->SetArrowLength(Length);
+        }
+        return Arrow;
+    };
+    LeftHandForwardArrow = CreateArrow("LeftHandForwardArrow", LeftMotionController, FColor::Red, 40.0f);
+    LeftHandForwardGoArrow = CreateArrow("LeftHandForwardGoArrow", LeftMotionController, FColor::Cyan, 80.0f);
+    LeftHandRightGoArrow = CreateArrow("LeftHandRightGoArrow", LeftMotionController, FColor::Yellow, 80.0f);
+    LeftHandRightArrow = CreateArrow("LeftHandRightArrow", LeftMotionController, FColor::Green, 40.0f);
+    RightHandForwardArrow = CreateArrow("RightHandForwardArrow", RightMotionController, FColor::Red, 40.0f);
+    RightHandRightArrow = CreateArrow("RightHandRightArrow", RightMotionController, FColor::Green, 40.0f);
 }
 
 // Called when the game starts or when spawned
@@ -116,35 +151,44 @@ void AVRCharacter::BeginPlay()
 {
     Super::BeginPlay();
 
-    LeftHandRightArrow->SetHiddenInGame(false);
-    LeftHandForwardArrow->SetHiddenInGame(false);
-    RightHandRightArrow->SetHiddenInGame(false);
-    RightHandForwardArrow->SetHiddenInGame(false);
-    LeftHandForwardGoArrow->SetHiddenInGame(false);
-    LeftHandRightGoArrow->SetHiddenInGame(false);
-
-    UE_LOG(LogVRCharacter, Warning, TEXT("Left Controller Name: %s"), *LeftMotionController->GetName());
-    UE_LOG(LogVRCharacter,
-           Warning,
-           TEXT("Left Controller Motion Source: %s"),
-           *LeftMotionController->GetTrackingMotionSource().ToString());
-    UE_LOG(LogVRCharacter, Warning, TEXT("Left Controller Full Name: %s"), *LeftMotionController->GetFullName());
-    UE_LOG(LogVRCharacter, Warning, TEXT("Left Visualization Name: %s"), *LeftControllerVisualization->GetName());
-    UE_LOG(LogVRCharacter, Warning, TEXT("Left Visualization Full Name: %s"), *LeftControllerVisualization->GetFullName());
-
-    // Add Input Mapping Context
-    if (const APlayerController* PlayerController = Cast<APlayerController>(Controller))
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
     {
-        if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<
-            UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
+        SignificanceSubsystem->RegisterCharacter(this);
+    }
+
+    // Poll the controllers before anything here reads them, and move only once room-scale has placed the capsule
+    AddTickPrerequisiteComponent(LeftMotionController);
+    AddTickPrerequisiteComponent(RightMotionController);
+    GetCharacterMovement()->AddTickPrerequisiteActor(this);
+
+    if (bPhysicsHands)
+    {
+        if (LeftPhysicsHand != nullptr)
         {
-            Subsystem->AddMappingContext(DefaultMappingContext, 0);
+            LeftPhysicsHand->SetTrackingTarget(LeftMotionController);
+            LeftPhysicsHand->Activate();
+        }
+        if (RightPhysicsHand != nullptr)
+        {
+            RightPhysicsHand->SetTrackingTarget(RightMotionController);
+            RightPhysicsHand->Activate();
         }
-        else
-            UE_LOG(LogVRCharacter, Warning, TEXT("Unable to add mapping context"));
     }
-    else
-        UE_LOG(LogVRCharacter, Warning, TEXT("Unable to get the PlayerController"));
+
+    if (LeftHandForwardArrow != nullptr)
+    {
+        LeftHandRightArrow->SetHiddenInGame(false);
+        LeftHandForwardArrow->SetHiddenInGame(false);
+        RightHandRightArrow->SetHiddenInGame(false);
+        RightHandForwardArrow->SetHiddenInGame(false);
+        LeftHandForwardGoArrow->SetHiddenInGame(false);
+        LeftHandRightGoArrow->SetHiddenInGame(false);
+    }
+
+    FVRTelemetry::RecordName(EVRTelemetryEvent::MotionSource,
+                             GetUniqueID(),
+                             LeftMotionController->GetTrackingMotionSource(),
+                             static_cast<int32>(EControllerHand::Left));
 
     if (!UHeadMountedDisplayFunctionLibrary::EnableHMD(true))
     {
@@ -152,12 +196,11 @@ void AVRCharacter::BeginPlay()
         return;
     }
 
-    UE_LOG(LogVRCharacter, Warning, TEXT("HMD Activated: %s"), *UHeadMountedDisplayFunctionLibrary::GetHMDDeviceName().ToString());
-    FXRMotionControllerData MotionControllerData;
-    UHeadMountedDisplayFunctionLibrary::GetMotionControllerData(GetWorld(),
-                                                                LeftMotionController->GetTrackingSource(),
-                                                                MotionControllerData);
-    UE_LOG(LogVRCharacter, Warning, TEXT("Left Controller Device Name: %s"), *MotionControllerData.DeviceName.ToString());
+    FVRTelemetry::RecordName(EVRTelemetryEvent::HMDActivated, GetUniqueID(), UHeadMountedDisplayFunctionLibrary::GetHMDDeviceName());
+
+    // The device is often still unknown here, so keep checking for it, and for the player picking up other controllers
+    RefreshControllerModels();
+    GetWorldTimerManager().SetTimer(ControllerModelTimer, this, &AVRCharacter::RefreshControllerModels, ControllerModelPollInterval, true);
 
     // Set the tracking origin
     // CUSTOM_OPEN_XR: Custom OpenXR tracking space of some kind. You cannot set this space explicitly, it is automatically used by some platform plugin extensions.
@@ -165,7 +208,7 @@ void AVRCharacter::BeginPlay()
     // LOCAL_FLOOR: For standing stationary experiences. Typically centered around HMDs initial position either at app startup or device startup, with Z 0 set to match the floor as in the Stage Space. Falls back to local.
     // STAGE: For walking-around experiences. The origin will be at floor level and typically within a defined play areas who’s bounds will be available. Falls back to local.
     // EYE: Previously sometimes used Eye space to query for the view transform, this space is fixed to the HMD, meaning that as the hmd moves this space moves relative to other spaces. This isn’t used as a tracking origin.
-    if (SeatedVR)
+    if (GetCharacterMode() == EVRCharacterMode::Seated)
     {
         AllowCrouchToggle = true;
         VROrigin->SetRelativeLocation(FVector(0.f, 0.f, 88.f));
@@ -175,6 +218,10 @@ void AVRCharacter::BeginPlay()
     {
         VROrigin->SetRelativeLocation(FVector(0.f, 0.f, -88.f));
         UHeadMountedDisplayFunctionLibrary::SetTrackingOrigin(EHMDTrackingOrigin::Stage);
+        if (PlayAreaBoundary != nullptr)
+        {
+            PlayAreaBoundary->BuildFromTrackingSystem();
+        }
     }
 
     const FRotator HandRotation = FRotator(-80.0f, 0.0f, 90.0f);
@@ -184,19 +231,227 @@ void AVRCharacter::BeginPlay()
     RightHandMesh->SetRelativeTransform(FTransform(HandRotation, RightHandPosition, FVector::OneVector));
     LeftHandMesh->SetRelativeTransform(FTransform(HandRotation, LeftHandPosition, LeftHandScalar));
 
-    LeftControllerVisualization->SetIsVisualizationActive(ShowControllers);
-    RightControllerVisualization->SetIsVisualizationActive(ShowControllers);
-    LeftHandMesh->SetVisibility(!ShowControllers);
-    RightHandMesh->SetVisibility(!ShowControllers);
+    SetShowControllers(ShowControllers);
+
+    PreviousCapsuleHeight = GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+}
+
+// Called when the character leaves play
+void AVRCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->UnregisterCharacter(this);
+    }
+
+    GetWorldTimerManager().ClearTimer(ControllerModelTimer);
+
+    Super::EndPlay(EndPlayReason);
+}
+
+// Apply the cached render models for whichever device each hand now reports, if it has changed
+void AVRCharacter::RefreshControllerModels()
+{
+    const UGameInstance* GameInstance = GetGameInstance();
+    UVRControllerModelCache* ModelCache = GameInstance != nullptr ? GameInstance->GetSubsystem<UVRControllerModelCache>() : nullptr;
+
+    const auto Refresh = [this, ModelCache](UMotionControllerComponent* MotionController,
+                                            UXRDeviceVisualizationComponent* Visualization,
+                                            FName& AppliedDevice,
+                                            const EControllerHand Hand)
+    {
+        FXRMotionControllerData MotionControllerData;
+        UHeadMountedDisplayFunctionLibrary::GetMotionControllerData(GetWorld(), MotionController->GetTrackingSource(), MotionControllerData);
+        if (MotionControllerData.DeviceName.IsNone() || MotionControllerData.DeviceName == AppliedDevice)
+        {
+            return;
+        }
+
+        AppliedDevice = MotionControllerData.DeviceName;
+        FVRTelemetry::RecordName(EVRTelemetryEvent::ControllerDevice, GetUniqueID(), AppliedDevice, static_cast<int32>(Hand));
+
+        // The cache shares its models with every other character
+        if (ModelCache != nullptr)
+        {
+            ModelCache->ApplyModel(Visualization, AppliedDevice, Hand);
+        }
+    };
+
+    Refresh(LeftMotionController, LeftControllerVisualization, LeftControllerDevice, EControllerHand::Left);
+    Refresh(RightMotionController, RightControllerVisualization, RightControllerDevice, EControllerHand::Right);
+}
+
+void AVRCharacter::ParkForReuse()
+{
+    GetWorldTimerManager().ClearTimer(ControllerModelTimer);
+    GetWorldTimerManager().ClearTimer(SnapTurnRepeatTimer);
+
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->UnregisterCharacter(this);
+    }
+}
+
+void AVRCharacter::ResetForReuse()
+{
+    // Back in play: budgeted again, and watching for controller changes if BeginPlay found an HMD
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = GetWorld()->GetSubsystem<UVRSignificanceSubsystem>())
+    {
+        SignificanceSubsystem->RegisterCharacter(this);
+    }
+    if (UHeadMountedDisplayFunctionLibrary::IsHeadMountedDisplayEnabled())
+    {
+        RefreshControllerModels();
+        GetWorldTimerManager().SetTimer(ControllerModelTimer, this, &AVRCharacter::RefreshControllerModels, ControllerModelPollInterval, true);
+    }
 
+    // Input that was in flight for the previous player
+    SnapTurnDirection = 0;
+    PendingSnapTurns = 0;
+    GetWorldTimerManager().ClearTimer(SnapTurnRepeatTimer);
+    TeleportComponent->CancelAim();
+
+    // Stand up again, with the capsule and origin as BeginPlay left them
+    StopJumping();
+    UnCrouch();
+    SetPose(EPose::Standing);
+    GetCharacterMovement()->MaxWalkSpeed = RunSpeed;
+    GetCapsuleComponent()->SetCapsuleHalfHeight(GetDefaultHalfHeight());
     PreviousCapsuleHeight = GetCapsuleComponent()->GetUnscaledCapsuleHalfHeight();
+    VROrigin->SetRelativeLocation(FVector(0.f, 0.f, GetCharacterMode() == EVRCharacterMode::Seated ? 88.f : -88.f));
+
+    // Resample tracking this frame and bring the hands straight to the controllers. The pool restarted every component
+    // with its default tick state, which for the hands is off.
+    TrackingSample.FrameNumber = MAX_uint64;
+    for (UVRPhysicsHandComponent* Hand : {LeftPhysicsHand.Get(), RightPhysicsHand.Get()})
+    {
+        if (Hand != nullptr && Hand->IsActive())
+        {
+            Hand->SetComponentTickEnabled(true);
+            Hand->ResetTracking();
+        }
+    }
+}
+
+// Called when the character is possessed or unpossessed
+void AVRCharacter::NotifyControllerChanged()
+{
+    Super::NotifyControllerChanged();
+
+    // Input handlers run in the controller's tick and read the controller poses too
+    SetTrackingPrerequisites(PreviousController, false);
+    SetTrackingPrerequisites(Controller, true);
+
+    // Add Input Mapping Context here rather than in BeginPlay so pooled characters get it when they are reused
+    if (const APlayerController* PlayerController = Cast<APlayerController>(Controller))
+    {
+        if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<
+            UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
+        {
+            Subsystem->AddMappingContext(DefaultMappingContext, 0);
+
+            CreateDefaultTeleportInput();
+            if (TeleportMappingContext != nullptr)
+            {
+                Subsystem->AddMappingContext(TeleportMappingContext, 1);
+            }
+        }
+        else
+            UE_LOG(LogVRCharacter, Warning, TEXT("Unable to add mapping context"));
+    }
+}
+
+void AVRCharacter::CreateDefaultTeleportInput()
+{
+    if (TeleportAction != nullptr)
+    {
+        return;
+    }
+
+    // Either direction on the axis actuates, so BeginTeleportAim ignores the stick being pulled back
+    TeleportAction = NewObject<UInputAction>(this, TEXT("IA_DefaultTeleport"), RF_Transient);
+    TeleportAction->ValueType = EInputActionValueType::Axis1D;
+    TeleportAction->Triggers.Add(NewObject<UInputTriggerDown>(TeleportAction));
+
+    TeleportMappingContext = NewObject<UInputMappingContext>(this, TEXT("IMC_DefaultTeleport"), RF_Transient);
+    TeleportMappingContext->MapKey(TeleportAction, EKeys::OculusTouch_Left_Thumbstick_Y);
+    TeleportMappingContext->MapKey(TeleportAction, EKeys::ValveIndex_Left_Thumbstick_Y);
+    TeleportMappingContext->MapKey(TeleportAction, EKeys::MixedReality_Left_Thumbstick_Y);
 }
 
 // Called every frame
 void AVRCharacter::Tick(float DeltaTime)
 {
+    VRLAB_HITCH_SCOPE(CharacterTick);
+    LLM_SCOPE_BYTAG(VRLab_CharacterTick);
+    const FVRCharacterTickTimer TickTimer(this);
+
     Super::Tick(DeltaTime);
+    TickForMode(DeltaTime);
+}
 
+void AVRCharacter::TickForMode(const float DeltaTime)
+{
+    // SeatedVR may be changed up until BeginPlay, so this character decides every frame
+    if (GetCharacterMode() == EVRCharacterMode::Seated)
+    {
+        TickMode<FVRSeatedPolicy>(DeltaTime);
+    }
+    else
+    {
+        TickMode<FVRRoomScalePolicy>(DeltaTime);
+    }
+}
+
+void AVRCharacter::TickModeForBenchmark(const float DeltaTime)
+{
+    // Every call stands in for a new frame, so tracking is sampled again as it would be
+    TrackingSample.FrameNumber = MAX_uint64;
+    TickForMode(DeltaTime);
+}
+
+template <typename TPolicy>
+void AVRCharacter::TickMode(const float DeltaTime)
+{
+    FScopeCycleCounter CycleCounter(TPolicy::bRoomScale
+                                        ? GET_STATID(STAT_VRCharacterTickRoomScale)
+                                        : GET_STATID(STAT_VRCharacterTickSeated));
+
+    const FVRTrackingSample& Sample = GetTrackingSample(TEXT("CharacterTick"));
+
+    // Fixed-mode characters leave the arrows out
+    if (LeftHandForwardArrow != nullptr)
+    {
+        UpdateDebugArrows();
+    }
+
+    // Turn first so the room-scale correction below works from the new heading in the same update
+    ApplyPendingSnapTurns();
+
+    if constexpr (TPolicy::bRoomScale)
+    {
+        UpdateRoomScaleLocation();
+    }
+    if constexpr (TPolicy::bCapsuleFromHead)
+    {
+        UpdateCapsuleHeight<TPolicy>();
+    }
+    if constexpr (TPolicy::bPlayAreaBoundary)
+    {
+        if (PlayAreaBoundary != nullptr)
+        {
+            PlayAreaBoundary->UpdateTracking(Sample.HeadPosition,
+                                             Sample.LeftController.GetLocation(),
+                                             Sample.RightController.GetLocation());
+        }
+    }
+}
+
+template void AVRCharacter::TickMode<FVRSeatedPolicy>(float DeltaTime);
+template void AVRCharacter::TickMode<FVRRoomScalePolicy>(float DeltaTime);
+
+void AVRCharacter::UpdateDebugArrows() const
+{
     LeftHandForwardArrow->SetWorldRotation(LeftMotionController->GetForwardVector().Rotation());
     FRotator LeftHandForwardGoArrowRotator = (LeftMotionController->GetForwardVector().GetSafeNormal() -
                                               LeftMotionController->GetUpVector().GetSafeNormal())
@@ -214,28 +469,70 @@ void AVRCharacter::Tick(float DeltaTime)
     LeftHandRightArrow->SetWorldRotation(LeftMotionController->GetRightVector().Rotation());
     RightHandRightArrow->SetWorldRotation(RightMotionController->GetRightVector().Rotation());
     RightHandForwardArrow->SetWorldRotation(RightMotionController->GetForwardVector().Rotation());
+}
 
-    if (!SeatedVR)
+EVRCharacterMode AVRCharacter::GetCharacterMode() const
+{
+    return SeatedVR ? EVRCharacterMode::Seated : EVRCharacterMode::RoomScale;
+}
+
+FPrimaryAssetId AVRCharacter::GetPrimaryAssetId() const
+{
+    // The asset manager asks a Blueprint's class default object
+    if (HasAnyFlags(RF_ClassDefaultObject) && !GetClass()->HasAnyClassFlags(CLASS_Native))
     {
-        UpdateRoomScaleLocation();
-        UpdateCapsuleHeight();
+        return FPrimaryAssetId(FPrimaryAssetType(TEXT("VRPawn")), FPackageName::GetShortFName(GetOutermost()->GetFName()));
     }
+    return Super::GetPrimaryAssetId();
 }
 
 // Called to bind functionality to input
 void AVRCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
 {
     Super::SetupPlayerInputComponent(PlayerInputComponent);
+    CreateDefaultTeleportInput();
     UEnhancedInputComponent* EnhancedInputComponent = CastChecked<UEnhancedInputComponent>(InputComponent);
     EnhancedInputComponent->BindAction(JumpAction, ETriggerEvent::Triggered, this, &ThisClass::PerformJump);
-    EnhancedInputComponent->BindAction(CrouchAction, ETriggerEvent::Triggered, this, &ThisClass::ToggleCrouch);
+    BindInputForMode(EnhancedInputComponent);
     EnhancedInputComponent->BindAction(MoveAction, ETriggerEvent::Triggered, this, &ThisClass::Move);
     EnhancedInputComponent->BindAction(SmoothTurnAction, ETriggerEvent::Triggered, this, &ThisClass::SmoothTurn);
     EnhancedInputComponent->BindAction(SnapTurnAction, ETriggerEvent::Triggered, this, &ThisClass::SnapTurn);
+    EnhancedInputComponent->BindAction(SnapTurnAction, ETriggerEvent::Completed, this, &ThisClass::ReleaseSnapTurn);
+    EnhancedInputComponent->BindAction(TeleportAction, ETriggerEvent::Started, this, &ThisClass::BeginTeleportAim);
+    EnhancedInputComponent->BindAction(TeleportAction, ETriggerEvent::Completed, this, &ThisClass::FinishTeleport);
+    EnhancedInputComponent->BindAction(TeleportAction, ETriggerEvent::Canceled, this, &ThisClass::CancelTeleport);
 }
 
+void AVRCharacter::BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent)
+{
+    // SeatedVR may be changed up until the character is possessed, so this character decides here
+    if (GetCharacterMode() == EVRCharacterMode::Seated)
+    {
+        BindModeInput<FVRSeatedPolicy>(EnhancedInputComponent);
+    }
+    else
+    {
+        BindModeInput<FVRRoomScalePolicy>(EnhancedInputComponent);
+    }
+}
+
+template <typename TPolicy>
+void AVRCharacter::BindModeInput(UEnhancedInputComponent* EnhancedInputComponent)
+{
+    // Standing players crouch for real, which room-scale picks up from the head height, so only seated ones get the stick
+    if constexpr (TPolicy::bStickCrouch)
+    {
+        EnhancedInputComponent->BindAction(CrouchAction, ETriggerEvent::Triggered, this, &ThisClass::ToggleCrouch);
+    }
+}
+
+template void AVRCharacter::BindModeInput<FVRSeatedPolicy>(UEnhancedInputComponent* EnhancedInputComponent);
+template void AVRCharacter::BindModeInput<FVRRoomScalePolicy>(UEnhancedInputComponent* EnhancedInputComponent);
+
 void AVRCharacter::SmoothTurn(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_SmoothTurn);
+
     if (!EnableSmoothRotation)
     {
         return;
@@ -247,25 +544,75 @@ void AVRCharacter::SmoothTurn(const FInputActionValue& Value)
 
 void AVRCharacter::SnapTurn(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_SnapTurn);
+
     if (EnableSmoothRotation)
     {
         return;
     }
 
-    if (const float AxisValue = Value.Get<FVector2D>().X; AxisValue > 0)
+    // Quantize the stick into a direction; holding it steady produces no new events, the repeat timer does
+    const float AxisValue = Value.Get<FVector2D>().X;
+    const int8 Direction = FMath::Abs(AxisValue) < SnapTurnDeadZone ? 0 : (AxisValue > 0.0f ? 1 : -1);
+    if (Direction == SnapTurnDirection)
     {
-        AddControllerYawInput(SnapTurnAngle);
+        return;
     }
-    else
+
+    SnapTurnDirection = Direction;
+    if (Direction == 0)
+    {
+        GetWorldTimerManager().ClearTimer(SnapTurnRepeatTimer);
+        return;
+    }
+
+    QueueSnapTurn();
+    GetWorldTimerManager().SetTimer(SnapTurnRepeatTimer, this, &AVRCharacter::QueueSnapTurn, SnapTurnDelay, true);
+}
+
+void AVRCharacter::ReleaseSnapTurn(const FInputActionValue& Value)
+{
+    SnapTurnDirection = 0;
+    GetWorldTimerManager().ClearTimer(SnapTurnRepeatTimer);
+}
+
+void AVRCharacter::QueueSnapTurn()
+{
+    PendingSnapTurns += SnapTurnDirection;
+}
+
+void AVRCharacter::ApplyPendingSnapTurns()
+{
+    if (PendingSnapTurns == 0)
     {
-        AddControllerYawInput(SnapTurnAngle * -1.0f);
+        return;
+    }
+
+    const FRotator DeltaRotation(0.0f, PendingSnapTurns * SnapTurnAngle, 0.0f);
+    PendingSnapTurns = 0;
+
+    // Pivot around the HMD rather than the capsule so the player's head stays put while the world turns
+    const FVector Pivot = Camera->GetComponentLocation();
+    const FVector NewLocation = Pivot + DeltaRotation.RotateVector(GetActorLocation() - Pivot);
+    SetActorLocationAndRotation(NewLocation,
+                                GetActorRotation() + DeltaRotation,
+                                false,
+                                nullptr,
+                                ETeleportType::TeleportPhysics);
+
+    // Keep the controller in step, otherwise it rotates the pawn straight back
+    if (Controller != nullptr)
+    {
+        Controller->SetControlRotation(Controller->GetControlRotation() + DeltaRotation);
     }
 }
 
 void AVRCharacter::ToggleCrouch(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_Crouch);
+
     const float AxisValue = Value.Get<FVector2D>().Y;
-    if (!SeatedVR || AllowCrouchToggle)
+    if (GetCharacterMode() != EVRCharacterMode::Seated || !AllowCrouchToggle)
     {
         return;
     }
@@ -274,7 +621,7 @@ void AVRCharacter::ToggleCrouch(const FInputActionValue& Value)
     {
         if (AxisValue < 0.0f)
         {
-            CurrentPose = EPose::Crouching;
+            SetPose(EPose::Crouching);
             Crouch();
         }
     }
@@ -282,12 +629,12 @@ void AVRCharacter::ToggleCrouch(const FInputActionValue& Value)
     {
         if (AxisValue > 0.0f)
         {
-            CurrentPose = EPose::Standing;
+            SetPose(EPose::Standing);
             UnCrouch();
         }
         else
         {
-            CurrentPose = EPose::Crawling;
+            SetPose(EPose::Crawling);
             // Crawl
         }
     }
@@ -295,21 +642,182 @@ void AVRCharacter::ToggleCrouch(const FInputActionValue& Value)
     {
         if (AxisValue > 0.0f)
         {
-            CurrentPose = EPose::Crouching;
+            SetPose(EPose::Crouching);
             Crouch();
         }
     }
 }
 
+const FVRTrackingSample& AVRCharacter::GetTrackingSample(const TCHAR* Consumer)
+{
+    if (TrackingSample.FrameNumber != GFrameCounter)
+    {
+        SampleTracking();
+    }
+
+    if (CVarVerifyTracking.GetValueOnGameThread())
+    {
+        VerifyTrackingSample(Consumer);
+    }
+    return TrackingSample;
+}
+
+void AVRCharacter::SampleTracking()
+{
+    TrackingSample.FrameNumber = GFrameCounter;
+    TrackingSample.LeftController = LeftMotionController->GetRelativeTransform();
+    TrackingSample.RightController = RightMotionController->GetRelativeTransform();
+    TrackingSample.bHeadTracked = UHeadMountedDisplayFunctionLibrary::IsHeadMountedDisplayEnabled();
+    if (!TrackingSample.bHeadTracked)
+    {
+        return;
+    }
+
+    UHeadMountedDisplayFunctionLibrary::GetOrientationAndPosition(TrackingSample.HeadRotation, TrackingSample.HeadPosition);
+    if (!Camera->bLockToHmd)
+    {
+        return;
+    }
+
+    // The camera only picks up the HMD when the camera manager asks for its view, late in the frame. Until then it
+    // holds last frame's pose, which is what room-scale used to correct against.
+    const float StaleError = FVector::Dist(Camera->GetRelativeLocation(), TrackingSample.HeadPosition);
+    if (StaleError > UE_KINDA_SMALL_NUMBER)
+    {
+        INC_DWORD_STAT(STAT_VRStaleHeadPosesAvoided);
+    }
+    SET_FLOAT_STAT(STAT_VRStaleHeadPoseError, StaleError);
+    Camera->SetRelativeLocationAndRotation(TrackingSample.HeadPosition, TrackingSample.HeadRotation);
+}
+
+void AVRCharacter::VerifyTrackingSample(const TCHAR* Consumer) const
+{
+    ensureMsgf(LeftMotionController->GetRelativeTransform().Equals(TrackingSample.LeftController) &&
+               RightMotionController->GetRelativeTransform().Equals(TrackingSample.RightController),
+               TEXT("%s saw controller poses from after tracking was sampled on frame %llu"),
+               Consumer,
+               TrackingSample.FrameNumber);
+    ensureMsgf(!TrackingSample.bHeadTracked || !Camera->bLockToHmd ||
+               Camera->GetRelativeLocation().Equals(TrackingSample.HeadPosition),
+               TEXT("%s saw a head pose from after tracking was sampled on frame %llu"),
+               Consumer,
+               TrackingSample.FrameNumber);
+}
+
+void AVRCharacter::SetTrackingPrerequisites(AController* Target, const bool bEnable) const
+{
+    if (Target == nullptr)
+    {
+        return;
+    }
+
+    if (bEnable)
+    {
+        Target->AddTickPrerequisiteComponent(LeftMotionController);
+        Target->AddTickPrerequisiteComponent(RightMotionController);
+    }
+    else
+    {
+        Target->RemoveTickPrerequisiteComponent(LeftMotionController);
+        Target->RemoveTickPrerequisiteComponent(RightMotionController);
+    }
+}
+
+void AVRCharacter::SetPose(const EPose NewPose)
+{
+    if (NewPose == CurrentPose)
+    {
+        return;
+    }
+
+    FVRTelemetry::Record(EVRTelemetryEvent::PoseChanged,
+                         GetUniqueID(),
+                         static_cast<int32>(NewPose),
+                         static_cast<int32>(CurrentPose));
+    CurrentPose = NewPose;
+}
+
 void AVRCharacter::PerformJump(const FInputActionValue& Value)
 {
-    GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Cyan, TEXT("Jump!"));
+    VRLAB_HITCH_SCOPE(Input_Jump);
+
+    FVRTelemetry::Record(EVRTelemetryEvent::Jump, GetUniqueID(), static_cast<int32>(CurrentPose));
     if (CurrentPose == EPose::Standing || CurrentPose == EPose::Crouching)
     {
         Jump();
     }
 }
 
+void AVRCharacter::BeginTeleportAim(const FInputActionValue& Value)
+{
+    VRLAB_HITCH_SCOPE(Input_TeleportAim);
+
+    // The built-in mapping is an axis, and pulling the stick back isn't a teleport
+    if (LocomotionMode != ELocomotionMode::Teleport || Value.Get<float>() < 0.0f)
+    {
+        return;
+    }
+
+    // Aim with the same hand that supplies the forward vector for smooth locomotion
+    if (ForwardSource == EForwardSource::RightController)
+    {
+        TeleportComponent->BeginAim(RightMotionController);
+    }
+    else
+    {
+        TeleportComponent->BeginAim(LeftMotionController);
+    }
+}
+
+void AVRCharacter::FinishTeleport(const FInputActionValue& Value)
+{
+    VRLAB_HITCH_SCOPE(Input_Teleport);
+
+    FVector Destination;
+    if (!TeleportComponent->EndAim(Destination))
+    {
+        return;
+    }
+
+    // Land the player's head, not the capsule, over the target so room-scale offsets are preserved
+    FVector HeadOffset = Camera->GetComponentLocation() - GetActorLocation();
+    HeadOffset.Z = 0.0f;
+    const FVector NewLocation = Destination - HeadOffset +
+                                FVector(0.0f, 0.0f, GetCapsuleComponent()->GetScaledCapsuleHalfHeight());
+    if (!TeleportTo(NewLocation, GetActorRotation()))
+    {
+        UE_LOG(LogVRCharacter, Verbose, TEXT("Teleport to %s was blocked"), *NewLocation.ToString());
+    }
+}
+
+void AVRCharacter::CancelTeleport(const FInputActionValue& Value)
+{
+    TeleportComponent->CancelAim();
+}
+
+void AVRCharacter::DescribeForHitch(FVRHitchPlayerState& State) const
+{
+    State.HeadLocation = Camera->GetComponentLocation();
+    State.HeadRotation = Camera->GetComponentRotation();
+    State.Pose = StaticEnum<EPose>()->GetNameStringByValue(static_cast<int64>(CurrentPose));
+    State.AddInput(this, MoveAction);
+    State.AddInput(this, SmoothTurnAction);
+    State.AddInput(this, SnapTurnAction);
+    State.AddInput(this, TeleportAction);
+    State.AddInput(this, CrouchAction);
+    State.AddInput(this, JumpAction);
+}
+
+void AVRCharacter::SetShowControllers(const bool bShow)
+{
+    // The controller models stay loaded either way, so switching only changes what is drawn
+    ShowControllers = bShow;
+    LeftControllerVisualization->SetIsVisualizationActive(bShow);
+    RightControllerVisualization->SetIsVisualizationActive(bShow);
+    LeftHandMesh->SetVisibility(!bShow);
+    RightHandMesh->SetVisibility(!bShow);
+}
+
 void AVRCharacter::GrabAxisLeft(const float AxisValue) const
 {
     // TODO: Add hand animation
@@ -322,20 +830,30 @@ void AVRCharacter::GrabAxisRight(const float AxisValue) const
 
 void AVRCharacter::UpdateRoomScaleLocation()
 {
+    VRLAB_HITCH_SCOPE(RoomScale);
+
+    GetTrackingSample(TEXT("RoomScale"));
     FVector DeltaLocation = Camera->GetComponentLocation() - GetCapsuleComponent()->GetComponentLocation();
+    if (PlayAreaBoundary != nullptr && PlayAreaBoundary->bClampRoomScale && PlayAreaBoundary->HasBoundary())
+    {
+        // A head leaning out past the boundary takes the camera with it, but the capsule stops at the edge
+        const FVector Head = Camera->GetRelativeLocation();
+        DeltaLocation += VROrigin->GetComponentTransform().TransformVectorNoScale(PlayAreaBoundary->ClampHead(Head) - Head);
+    }
     DeltaLocation.Z = .0f;
 
     AddActorWorldOffset(DeltaLocation, false, nullptr, ETeleportType::TeleportPhysics);
     VROrigin->AddWorldOffset(-DeltaLocation, false, nullptr, ETeleportType::TeleportPhysics);
 }
 
+template <typename TPolicy>
 void AVRCharacter::UpdateCapsuleHeight()
 {
-    FRotator Rotation;
-    FVector Position;
-    UHeadMountedDisplayFunctionLibrary::GetOrientationAndPosition(Rotation, Position);
-    const float NewCapsuleHalfHeight = Position.Z / 2.0f + 10.0f;
-    if (!SeatedVR)
+    VRLAB_HITCH_SCOPE(RoomScaleCapsule);
+
+    const FVRTrackingSample& Sample = GetTrackingSample(TEXT("CapsuleHeight"));
+    const float NewCapsuleHalfHeight = Sample.HeadPosition.Z / 2.0f + 10.0f;
+    if constexpr (TPolicy::bRoomScale)
     {
         GetCapsuleComponent()->SetCapsuleSize(GetCapsuleComponent()->GetScaledCapsuleRadius(), NewCapsuleHalfHeight);
         VROrigin->AddRelativeLocation(FVector(0, 0, PreviousCapsuleHeight - NewCapsuleHalfHeight));
@@ -347,28 +865,39 @@ void AVRCharacter::UpdateCapsuleHeight()
         GetCharacterMovement()->MaxWalkSpeed = CrawlSpeed;
         // GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Red,
         //                                  FString::Printf(TEXT("Crawling %f"), NewCapsuleHalfHeight));
-        CurrentPose = EPose::Crawling;
+        SetPose(EPose::Crawling);
     }
     else if (NewCapsuleHalfHeight < CrouchHeight)
     {
         GetCharacterMovement()->MaxWalkSpeed = CrouchSpeed;
         // GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Yellow,
         //                                  FString::Printf(TEXT("Crouching %f"), NewCapsuleHalfHeight));
-        CurrentPose = EPose::Crouching;
+        SetPose(EPose::Crouching);
     }
     else
     {
         GetCharacterMovement()->MaxWalkSpeed = RunSpeed;
         // GEngine->AddOnScreenDebugMessage(-1, 5.f, FColor::Green,
         //                                  FString::Printf(TEXT("Standing %f"), NewCapsuleHalfHeight));
-        CurrentPose = EPose::Standing;
+        SetPose(EPose::Standing);
     }
 }
 
+template void AVRCharacter::UpdateCapsuleHeight<FVRSeatedPolicy>();
+template void AVRCharacter::UpdateCapsuleHeight<FVRRoomScalePolicy>();
+
 /** Move the character in the direction of the input */
 void AVRCharacter::Move(const FInputActionValue& Value)
 {
+    VRLAB_HITCH_SCOPE(Input_Move);
+
+    if (LocomotionMode == ELocomotionMode::Teleport)
+    {
+        return;
+    }
+
     const FVector2D InputAxisVector = Value.Get<FVector2D>();
+    GetTrackingSample(TEXT("Move"));
 
     FRotator ForwardRotator;
     FRotator RightRotator;
@@ -0,0 +1,249 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRControllerModelCache.h"
+
+#include "VR_Lab.h"
+#include "XRDeviceVisualizationComponent.h"
+#include "Engine/AssetManager.h"
+#include "Engine/GameInstance.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StreamableManager.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogVRControllerModels);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Controller Model Loads"), STAT_VRControllerModelLoads, STATGROUP_VRLab);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Controller Model Cache Hits"), STAT_VRControllerModelCacheHits, STATGROUP_VRLab);
+
+static FAutoConsoleCommand ListControllerModelsCommand(
+    TEXT("VRLab.ControllerModels.List"),
+    TEXT("List the configured controller models and whether they have loaded."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        const UGameInstance* GameInstance = World != nullptr ? World->GetGameInstance() : nullptr;
+        if (const UVRControllerModelCache* ModelCache = GameInstance != nullptr
+                                                            ? GameInstance->GetSubsystem<UVRControllerModelCache>()
+                                                            : nullptr)
+        {
+            ModelCache->LogModels();
+        }
+    }));
+
+namespace VRControllerModels
+{
+    void SetMesh(UXRDeviceVisualizationComponent* Visualization, UStaticMesh* Mesh, const float Scale)
+    {
+        Visualization->SetDisplayModelSource(UXRDeviceVisualizationComponent::CustomModelSourceId);
+        Visualization->SetCustomDisplayMesh(Mesh);
+        Visualization->SetRelativeScale3D(FVector(Scale));
+    }
+}
+
+void UVRControllerModelCache::ShowModel(UXRDeviceVisualizationComponent* Visualization,
+                                        const FVRControllerModel& Model,
+                                        const EControllerHand Hand) const
+{
+    // Fall back to the placeholder if the model is missing or failed to load
+    if (UStaticMesh* Mesh = Hand == EControllerHand::Left ? Model.Left.Get() : Model.Right.Get())
+    {
+        VRControllerModels::SetMesh(Visualization, Mesh, 1.0f);
+    }
+    else
+    {
+        ShowPlaceholder(Visualization);
+    }
+}
+
+void UVRControllerModelCache::ShowPlaceholder(UXRDeviceVisualizationComponent* Visualization) const
+{
+    VRControllerModels::SetMesh(Visualization, Placeholder, PlaceholderScale);
+}
+
+void UVRControllerModelCache::ShowDefault(UXRDeviceVisualizationComponent* Visualization) const
+{
+    // The component's archetype holds what the character was set up with, usually the XR system's own model
+    const UXRDeviceVisualizationComponent* Default = CastChecked<UXRDeviceVisualizationComponent>(Visualization->GetArchetype());
+    Visualization->SetDisplayModelSource(Default->DisplayModelSource);
+    Visualization->SetCustomDisplayMesh(Default->CustomDisplayMesh);
+    Visualization->SetRelativeScale3D(Default->GetRelativeScale3D());
+}
+
+void UVRControllerModelCache::RemoveWaiting(const UXRDeviceVisualizationComponent* Visualization)
+{
+    for (TPair<FName, FLoad>& Load : Loads)
+    {
+        Load.Value.Waiting.RemoveAll(
+            [Visualization](const TPair<TWeakObjectPtr<UXRDeviceVisualizationComponent>, EControllerHand>& Waiting)
+            {
+                return !Waiting.Key.IsValid() || Waiting.Key.Get() == Visualization;
+            });
+    }
+}
+
+void UVRControllerModelCache::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    // The placeholder has to be there the moment a controller appears, and is small enough to load while starting up
+    Placeholder = PlaceholderMesh.LoadSynchronous();
+    if (Placeholder == nullptr && !PlaceholderMesh.IsNull())
+    {
+        UE_LOG(LogVRControllerModels, Warning, TEXT("Unable to load placeholder mesh %s"), *PlaceholderMesh.ToString());
+    }
+}
+
+void UVRControllerModelCache::Deinitialize()
+{
+    for (TPair<FName, FLoad>& Load : Loads)
+    {
+        if (Load.Value.Handle.IsValid())
+        {
+            Load.Value.Handle->CancelHandle();
+        }
+    }
+    Loads.Empty();
+
+    Super::Deinitialize();
+}
+
+const FVRControllerModel* UVRControllerModelCache::FindModel(const FName DeviceName) const
+{
+    return Models.FindByPredicate([DeviceName](const FVRControllerModel& Model)
+    {
+        return Model.DeviceName == DeviceName;
+    });
+}
+
+void UVRControllerModelCache::Preload(const FName DeviceName)
+{
+    const FVRControllerModel* Model = FindModel(DeviceName);
+    if (Model == nullptr || Loads.Contains(DeviceName))
+    {
+        return;
+    }
+
+    TArray<FSoftObjectPath> Paths;
+    if (!Model->Left.IsNull())
+    {
+        Paths.Add(Model->Left.ToSoftObjectPath());
+    }
+    if (!Model->Right.IsNull())
+    {
+        Paths.Add(Model->Right.ToSoftObjectPath());
+    }
+    if (Paths.IsEmpty())
+    {
+        return;
+    }
+
+    FLoad& Load = Loads.Add(DeviceName);
+    Load.RequestTime = FPlatformTime::Seconds();
+    INC_DWORD_STAT(STAT_VRControllerModelLoads);
+    UE_LOG(LogVRControllerModels, Log, TEXT("Loading controller models for %s"), *DeviceName.ToString());
+
+    Load.Handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(
+        Paths,
+        FStreamableDelegate::CreateUObject(this, &UVRControllerModelCache::OnModelLoaded, DeviceName),
+        FStreamableManager::AsyncLoadHighPriority);
+}
+
+bool UVRControllerModelCache::ApplyModel(UXRDeviceVisualizationComponent* Visualization,
+                                         const FName DeviceName,
+                                         const EControllerHand Hand)
+{
+    if (Visualization == nullptr)
+    {
+        return false;
+    }
+
+    // Whatever was asked for this component before, a model still loading must not replace this one when it finishes
+    RemoveWaiting(Visualization);
+
+    const FVRControllerModel* Model = FindModel(DeviceName);
+    if (Model != nullptr)
+    {
+        Preload(DeviceName);
+    }
+    FLoad* Load = Model != nullptr ? Loads.Find(DeviceName) : nullptr;
+    if (Load == nullptr)
+    {
+        // Don't leave the last device's model on a controller it no longer matches
+        ShowDefault(Visualization);
+        return false;
+    }
+
+    if (Load->LoadMs >= 0.0)
+    {
+        INC_DWORD_STAT(STAT_VRControllerModelCacheHits);
+        ShowModel(Visualization, *Model, Hand);
+        return true;
+    }
+
+    ShowPlaceholder(Visualization);
+    Load->Waiting.Emplace(Visualization, Hand);
+    return true;
+}
+
+bool UVRControllerModelCache::IsLoaded(const FName DeviceName) const
+{
+    const FLoad* Load = Loads.Find(DeviceName);
+    return Load != nullptr && Load->LoadMs >= 0.0;
+}
+
+void UVRControllerModelCache::OnModelLoaded(const FName DeviceName)
+{
+    FLoad* Load = Loads.Find(DeviceName);
+    const FVRControllerModel* Model = FindModel(DeviceName);
+    if (Load == nullptr || Model == nullptr)
+    {
+        return;
+    }
+
+    Load->LoadMs = (FPlatformTime::Seconds() - Load->RequestTime) * 1000.0;
+    UE_LOG(LogVRControllerModels, Log, TEXT("Controller models for %s loaded in %.1f ms"), *DeviceName.ToString(), Load->LoadMs);
+
+    for (const TPair<TWeakObjectPtr<UXRDeviceVisualizationComponent>, EControllerHand>& Waiting : Load->Waiting)
+    {
+        if (UXRDeviceVisualizationComponent* Visualization = Waiting.Key.Get())
+        {
+            ShowModel(Visualization, *Model, Waiting.Value);
+        }
+    }
+    Load->Waiting.Empty();
+}
+
+void UVRControllerModelCache::LogModels() const
+{
+    UE_LOG(LogVRControllerModels,
+           Display,
+           TEXT("Placeholder %s (%s)"),
+           *PlaceholderMesh.ToString(),
+           Placeholder != nullptr ? TEXT("loaded") : TEXT("missing"));
+    for (const FVRControllerModel& Model : Models)
+    {
+        const FLoad* Load = Loads.Find(Model.DeviceName);
+        if (Load == nullptr)
+        {
+            UE_LOG(LogVRControllerModels, Display, TEXT("%-48s not requested"), *Model.DeviceName.ToString());
+        }
+        else if (Load->LoadMs < 0.0)
+        {
+            UE_LOG(LogVRControllerModels,
+                   Display,
+                   TEXT("%-48s loading, %d waiting"),
+                   *Model.DeviceName.ToString(),
+                   Load->Waiting.Num());
+        }
+        else
+        {
+            UE_LOG(LogVRControllerModels,
+                   Display,
+                   TEXT("%-48s loaded in %.1f ms: %s, %s"),
+                   *Model.DeviceName.ToString(),
+                   Load->LoadMs,
+                   *GetNameSafe(Model.Left.Get()),
+                   *GetNameSafe(Model.Right.Get()));
+        }
+    }
+}
@@ -1,3 +1,298 @@
 // Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
 
 #include "VRGameModeBase.h"
+
+#include "VR_Lab.h"
+#include "DesktopCharacter.h"
+#include "VRCharacter.h"
+#include "VRPlayerController.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/Controller.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectArray.h"
+
+DEFINE_LOG_CATEGORY(LogVRGameMode);
+
+DECLARE_CYCLE_STAT(TEXT("Default Pawn Spawn"), STAT_VRDefaultPawnSpawn, STATGROUP_VRLab);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pawn Pool Hits"), STAT_VRPawnPoolHits, STATGROUP_VRLab);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pawn Pool Misses"), STAT_VRPawnPoolMisses, STATGROUP_VRLab);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pawns Recycled"), STAT_VRPawnsRecycled, STATGROUP_VRLab);
+
+static FAutoConsoleCommand PawnPoolBenchmarkCommand(
+    TEXT("VRLab.PawnPool.Benchmark"),
+    TEXT("Respawn the first player with the pawn pool off and then on, and log spawn time and garbage collection cost. Args: [respawns] [quit]"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        AVRGameModeBase* GameMode = World != nullptr ? World->GetAuthGameMode<AVRGameModeBase>() : nullptr;
+        if (GameMode == nullptr)
+        {
+            UE_LOG(LogVRGameMode,
+                   Error,
+                   TEXT("The pawn pool benchmark needs an AVRGameModeBase on the server. ")
+                   TEXT("Open the map with ?game=/Game/Blueprints/BP_VRGameMode.BP_VRGameMode_C"));
+            return;
+        }
+
+        GameMode->BenchmarkRespawns(Args.IsValidIndex(0) ? FCString::Atoi(*Args[0]) : 20);
+        if (Args.Contains(TEXT("quit")))
+        {
+            FPlatformMisc::RequestExit(false);
+        }
+    }));
+
+AVRGameModeBase::AVRGameModeBase()
+{
+    // Its players hand their pawns back to the pool when they leave
+    PlayerControllerClass = AVRPlayerController::StaticClass();
+}
+
+void AVRGameModeBase::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+    Super::InitGame(MapName, Options, ErrorMessage);
+
+    if (!bUsePawnPool)
+    {
+        return;
+    }
+
+    if (PooledPawnClasses.IsEmpty() && DefaultPawnClass != nullptr)
+    {
+        PooledPawnClasses.Add(DefaultPawnClass);
+    }
+
+    // Pay for the spawns while the map is loading rather than when a player joins
+    const double StartTime = FPlatformTime::Seconds();
+    for (const TSubclassOf<APawn>& PawnClass : PooledPawnClasses)
+    {
+        for (int32 Index = 0; Index < PawnPoolSize; ++Index)
+        {
+            if (APawn* Pawn = SpawnPooledPawn(PawnClass))
+            {
+                ParkPawn(Pawn);
+                PooledPawns.Add(Pawn);
+            }
+        }
+    }
+
+    UE_LOG(LogVRGameMode,
+           Log,
+           TEXT("Pre-warmed %d pooled pawns in %.2f ms"),
+           PooledPawns.Num(),
+           (FPlatformTime::Seconds() - StartTime) * 1000.0);
+}
+
+void AVRGameModeBase::StartPlay()
+{
+    Super::StartPlay();
+
+    // BeginPlay re-enables ticking on everything that starts with it enabled, so park the pool again afterwards
+    for (APawn* Pawn : PooledPawns)
+    {
+        if (IsValid(Pawn))
+        {
+            ParkPawn(Pawn);
+        }
+    }
+}
+
+APawn* AVRGameModeBase::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+    SCOPE_CYCLE_COUNTER(STAT_VRDefaultPawnSpawn);
+    const double StartTime = FPlatformTime::Seconds();
+
+    const UClass* PawnClass = GetDefaultPawnClassForController(NewPlayer);
+    APawn* Pawn = bUsePawnPool ? AcquirePawn(PawnClass, SpawnTransform) : nullptr;
+    const bool bFromPool = Pawn != nullptr;
+    if (bFromPool)
+    {
+        ++PoolHits;
+        INC_DWORD_STAT(STAT_VRPawnPoolHits);
+    }
+    else
+    {
+        ++PoolMisses;
+        INC_DWORD_STAT(STAT_VRPawnPoolMisses);
+        Pawn = Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
+    }
+
+    UE_LOG(LogVRGameMode,
+           Log,
+           TEXT("%s %s for %s in %.3f ms (pool hits: %d, misses: %d)"),
+           bFromPool ? TEXT("Reused") : TEXT("Spawned"),
+           *GetNameSafe(Pawn),
+           *GetNameSafe(NewPlayer),
+           (FPlatformTime::Seconds() - StartTime) * 1000.0,
+           PoolHits,
+           PoolMisses);
+
+    return Pawn;
+}
+
+void AVRGameModeBase::RespawnPlayer(AController* Controller)
+{
+    if (Controller == nullptr)
+    {
+        return;
+    }
+
+    if (APawn* OldPawn = Controller->GetPawn(); OldPawn != nullptr && !ReleasePawn(OldPawn))
+    {
+        Controller->UnPossess();
+        OldPawn->Destroy();
+    }
+
+    RestartPlayer(Controller);
+}
+
+bool AVRGameModeBase::ReleasePawn(APawn* Pawn)
+{
+    if (!bUsePawnPool || !IsValid(Pawn) || !IsPooledClass(Pawn->GetClass()))
+    {
+        return false;
+    }
+
+    if (AController* Controller = Pawn->GetController())
+    {
+        Controller->UnPossess();
+    }
+
+    ParkPawn(Pawn);
+    PooledPawns.AddUnique(Pawn);
+    INC_DWORD_STAT(STAT_VRPawnsRecycled);
+    UE_LOG(LogVRGameMode, Verbose, TEXT("Released %s to the pawn pool"), *Pawn->GetName());
+    return true;
+}
+
+void AVRGameModeBase::BenchmarkRespawns(const int32 Respawns)
+{
+    AController* Player = GetWorld()->GetFirstPlayerController();
+    if (Player == nullptr || Respawns <= 0)
+    {
+        UE_LOG(LogVRGameMode, Error, TEXT("Nothing to respawn"));
+        return;
+    }
+
+    const bool bWasUsingPool = bUsePawnPool;
+    for (const bool bPool : {false, true})
+    {
+        bUsePawnPool = bPool;
+
+        // Start each run from a clean heap so the collection afterwards only sees what the respawns left behind
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+        const int32 ObjectsBefore = GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+        const double SpawnStart = FPlatformTime::Seconds();
+        for (int32 Index = 0; Index < Respawns; ++Index)
+        {
+            RespawnPlayer(Player);
+        }
+        const double SpawnMs = (FPlatformTime::Seconds() - SpawnStart) * 1000.0;
+        const int32 ObjectsAfterSpawns = GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+        const double CollectStart = FPlatformTime::Seconds();
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS, true);
+        const double CollectMs = (FPlatformTime::Seconds() - CollectStart) * 1000.0;
+        const int32 ObjectsCollected = ObjectsAfterSpawns - GUObjectArray.GetObjectArrayNumMinusAvailable();
+
+        UE_LOG(LogVRGameMode,
+               Display,
+               TEXT("Pool %s: %d respawns, %.3f ms each; %d objects created, %d collected in %.2f ms"),
+               bPool ? TEXT("on ") : TEXT("off"),
+               Respawns,
+               SpawnMs / Respawns,
+               ObjectsAfterSpawns - ObjectsBefore,
+               ObjectsCollected,
+               CollectMs);
+    }
+    bUsePawnPool = bWasUsingPool;
+}
+
+bool AVRGameModeBase::IsPooledClass(const UClass* PawnClass) const
+{
+    return PooledPawnClasses.Contains(PawnClass);
+}
+
+APawn* AVRGameModeBase::SpawnPooledPawn(UClass* PawnClass)
+{
+    FActorSpawnParameters SpawnInfo;
+    SpawnInfo.Instigator = GetInstigator();
+    SpawnInfo.ObjectFlags |= RF_Transient;
+    SpawnInfo.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+    return GetWorld()->SpawnActor<APawn>(PawnClass, FTransform::Identity, SpawnInfo);
+}
+
+APawn* AVRGameModeBase::AcquirePawn(const UClass* PawnClass, const FTransform& SpawnTransform)
+{
+    PooledPawns.RemoveAll([](const APawn* Pawn) { return !IsValid(Pawn); });
+
+    const int32 Index = PooledPawns.IndexOfByPredicate([PawnClass](const APawn* Pawn)
+    {
+        return Pawn->GetClass() == PawnClass;
+    });
+    if (Index == INDEX_NONE)
+    {
+        return nullptr;
+    }
+
+    APawn* Pawn = PooledPawns[Index];
+    PooledPawns.RemoveAtSwap(Index);
+
+    Pawn->SetActorLocationAndRotation(SpawnTransform.GetLocation(),
+                                      SpawnTransform.Rotator(),
+                                      false,
+                                      nullptr,
+                                      ETeleportType::ResetPhysics);
+    Pawn->SetActorHiddenInGame(false);
+    Pawn->SetActorEnableCollision(true);
+    Pawn->SetActorTickEnabled(true);
+    Pawn->ForEachComponent<UActorComponent>(false, [](UActorComponent* Component)
+    {
+        Component->SetComponentTickEnabled(Component->PrimaryComponentTick.bStartWithTickEnabled);
+    });
+
+    if (const ACharacter* Character = Cast<ACharacter>(Pawn))
+    {
+        Character->GetCharacterMovement()->SetDefaultMovementMode();
+    }
+
+    // Clear whatever the previous player left behind. This also settles the ticks that depend on that state.
+    if (AVRCharacter* VRCharacter = Cast<AVRCharacter>(Pawn))
+    {
+        VRCharacter->ResetForReuse();
+    }
+    else if (ADesktopCharacter* DesktopCharacter = Cast<ADesktopCharacter>(Pawn))
+    {
+        DesktopCharacter->ResetForReuse();
+    }
+
+    return Pawn;
+}
+
+void AVRGameModeBase::ParkPawn(APawn* Pawn)
+{
+    if (const ACharacter* Character = Cast<ACharacter>(Pawn))
+    {
+        Character->GetCharacterMovement()->StopMovementImmediately();
+        Character->GetCharacterMovement()->DisableMovement();
+    }
+
+    Pawn->SetActorHiddenInGame(true);
+    Pawn->SetActorEnableCollision(false);
+    Pawn->SetActorTickEnabled(false);
+    Pawn->ForEachComponent<UActorComponent>(false, [](UActorComponent* Component)
+    {
+        Component->SetComponentTickEnabled(false);
+    });
+
+    // Timers and the significance manager would otherwise keep working on a pawn nobody can see
+    if (AVRCharacter* VRCharacter = Cast<AVRCharacter>(Pawn))
+    {
+        VRCharacter->ParkForReuse();
+    }
+    else if (ADesktopCharacter* DesktopCharacter = Cast<ADesktopCharacter>(Pawn))
+    {
+        DesktopCharacter->ParkForReuse();
+    }
+}
@@ -0,0 +1,477 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRHitchCapture.h"
+
+#include "DesktopCharacter.h"
+#include "EnhancedInputSubsystems.h"
+#include "EnhancedPlayerInput.h"
+#include "InputAction.h"
+#include "VR_Lab.h"
+#include "VRCharacter.h"
+#include "Async/Async.h"
+#include "Engine/Engine.h"
+#include "Engine/LocalPlayer.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "ProfilingDebugging/MiscTrace.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY(LogVRHitch);
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Hitches Captured"), STAT_VRHitchesCaptured, STATGROUP_VRLab);
+
+static TAutoConsoleVariable<bool> CVarHitchEnable(
+    TEXT("VRLab.Hitch.Enable"),
+    true,
+    TEXT("Record VR_Lab timing scopes and write them to Saved/Profiling/Hitches when a frame hitches."));
+
+static TAutoConsoleVariable<float> CVarHitchThresholdMs(
+    TEXT("VRLab.Hitch.ThresholdMs"),
+    0.0f,
+    TEXT("Frames whose work, not counting time spent idle for the frame rate limit, takes longer than this many ")
+    TEXT("milliseconds are captured. 0 to use VRLab.Hitch.ThresholdFrames of the target frame time."));
+
+static TAutoConsoleVariable<float> CVarHitchThresholdFrames(
+    TEXT("VRLab.Hitch.ThresholdFrames"),
+    2.0f,
+    TEXT("When VRLab.Hitch.ThresholdMs is 0, frames whose work takes longer than this many target frame times are captured."));
+
+static TAutoConsoleVariable<float> CVarHitchTargetFrameRate(
+    TEXT("VRLab.Hitch.TargetFrameRate"),
+    72.0f,
+    TEXT("Frame rate to measure hitches against when the engine has no frame rate limit, as when the headset paces frames."));
+
+static TAutoConsoleVariable<float> CVarHitchWindowSeconds(
+    TEXT("VRLab.Hitch.WindowSeconds"),
+    3.0f,
+    TEXT("How many seconds of scopes leading up to a hitch are written out."));
+
+static TAutoConsoleVariable<float> CVarHitchCooldown(
+    TEXT("VRLab.Hitch.Cooldown"),
+    10.0f,
+    TEXT("Minimum seconds between automatic captures, so a run of bad frames produces one file."));
+
+static TAutoConsoleVariable<int32> CVarHitchMaxCaptures(
+    TEXT("VRLab.Hitch.MaxCaptures"),
+    20,
+    TEXT("Most automatic captures written in one session. 0 for no limit."));
+
+static FAutoConsoleCommand HitchCaptureCommand(
+    TEXT("VRLab.Hitch.Capture"),
+    TEXT("Write the current hitch capture window to disk."),
+    FConsoleCommandDelegate::CreateLambda([]()
+    {
+        FVRHitchCapture::Capture(TEXT("Requested from the console"));
+    }));
+
+namespace VRHitch
+{
+    struct FScopeRecord
+    {
+        const TCHAR* Name = nullptr;
+        uint64 StartCycles = 0;
+        uint64 EndCycles = 0;
+    };
+
+    struct FFrameRecord
+    {
+        uint64 FrameNumber = 0;
+        uint64 StartCycles = 0;
+        uint64 EndCycles = 0;
+        float IdleMs = 0.0f;
+    };
+
+    /** At 90 Hz this holds around 40 scopes a frame for the default three-second window */
+    constexpr uint32 ScopeCapacity = 16384;
+    constexpr uint32 ScopeMask = ScopeCapacity - 1;
+    static_assert((ScopeCapacity & ScopeMask) == 0, "ScopeCapacity must be a power of two");
+
+    constexpr uint32 FrameCapacity = 1024;
+    constexpr uint32 FrameMask = FrameCapacity - 1;
+    static_assert((FrameCapacity & FrameMask) == 0, "FrameCapacity must be a power of two");
+
+    /** Frames around a map load are expected to be long and aren't worth a capture */
+    constexpr int32 FramesToSkipAfterLoad = 2;
+
+    static FScopeRecord Scopes[ScopeCapacity];
+    static uint32 ScopeHead = 0;
+    static FFrameRecord Frames[FrameCapacity];
+    static uint32 FrameHead = 0;
+
+    static bool bRecording = false;
+    static uint64 FrameStartCycles = 0;
+    static uint64 FrameNumber = 0;
+    static uint64 GCStartCycles = 0;
+    static int32 FramesToSkip = 0;
+    static double LastCaptureSeconds = -1.0;
+    static int32 CaptureCount = 0;
+
+    static FDelegateHandle BeginFrameHandle;
+    static FDelegateHandle PreGCHandle;
+    static FDelegateHandle PostGCHandle;
+    static FDelegateHandle PreLoadMapHandle;
+    static FDelegateHandle PostLoadMapHandle;
+
+    /** Everything a capture needs, copied out of the rings so it can be formatted off the game thread */
+    struct FCapture
+    {
+        FString Reason;
+        uint64 FrameNumber = 0;
+        float FrameMs = 0.0f;
+        float ThresholdMs = 0.0f;
+        uint64 WindowStartCycles = 0;
+        bool bScopesTruncated = false;
+        FVRHitchPlayerState Player;
+        TArray<FFrameRecord> Frames;
+        TArray<FScopeRecord> Scopes;
+    };
+
+    double ToMs(const uint64 Cycles, const uint64 Origin)
+    {
+        return Cycles >= Origin
+                   ? FPlatformTime::ToMilliseconds64(Cycles - Origin)
+                   : -FPlatformTime::ToMilliseconds64(Origin - Cycles);
+    }
+
+    FString ToJson(const FVector& Vector)
+    {
+        return FString::Printf(TEXT("[%.2f, %.2f, %.2f]"), Vector.X, Vector.Y, Vector.Z);
+    }
+
+    FString ToJson(const FRotator& Rotator)
+    {
+        return FString::Printf(TEXT("[%.2f, %.2f, %.2f]"), Rotator.Pitch, Rotator.Yaw, Rotator.Roll);
+    }
+
+    FString Quote(const FString& Text)
+    {
+        return TEXT("\"") + Text.ReplaceCharWithEscapedChar() + TEXT("\"");
+    }
+
+    FString Format(const FCapture& Capture)
+    {
+        const FVRHitchPlayerState& Player = Capture.Player;
+        FString Json;
+        Json.Reserve(128 * (Capture.Scopes.Num() + Capture.Frames.Num()) + 1024);
+        Json += TEXT("{\n");
+        Json += FString::Printf(TEXT("  \"reason\": %s,\n"), *Quote(Capture.Reason));
+        Json += FString::Printf(TEXT("  \"platform\": %s,\n"), *Quote(FString(FPlatformProperties::IniPlatformName())));
+        Json += FString::Printf(TEXT("  \"frame\": %llu,\n"), Capture.FrameNumber);
+        Json += FString::Printf(TEXT("  \"frameMs\": %.3f,\n"), Capture.FrameMs);
+        Json += FString::Printf(TEXT("  \"thresholdMs\": %.3f,\n"), Capture.ThresholdMs);
+        Json += FString::Printf(TEXT("  \"scopesTruncated\": %s,\n"), Capture.bScopesTruncated ? TEXT("true") : TEXT("false"));
+
+        Json += TEXT("  \"player\": {\n");
+        Json += FString::Printf(TEXT("    \"pawn\": %s,\n"), *Quote(Player.PawnName));
+        Json += FString::Printf(TEXT("    \"location\": %s,\n"), *ToJson(Player.Location));
+        Json += FString::Printf(TEXT("    \"rotation\": %s,\n"), *ToJson(Player.Rotation));
+        Json += FString::Printf(TEXT("    \"velocity\": %s,\n"), *ToJson(Player.Velocity));
+        Json += FString::Printf(TEXT("    \"headLocation\": %s,\n"), *ToJson(Player.HeadLocation));
+        Json += FString::Printf(TEXT("    \"headRotation\": %s,\n"), *ToJson(Player.HeadRotation));
+        Json += FString::Printf(TEXT("    \"pose\": %s,\n"), *Quote(Player.Pose));
+        Json += TEXT("    \"inputs\": {");
+        for (int32 Index = 0; Index < Player.Inputs.Num(); ++Index)
+        {
+            Json += FString::Printf(TEXT("%s%s: %s"),
+                                    Index == 0 ? TEXT("") : TEXT(", "),
+                                    *Quote(Player.Inputs[Index].Key),
+                                    *Quote(Player.Inputs[Index].Value));
+        }
+        Json += TEXT("}\n  },\n");
+
+        // Times are milliseconds from the start of the window
+        Json += TEXT("  \"frames\": [\n");
+        for (int32 Index = 0; Index < Capture.Frames.Num(); ++Index)
+        {
+            const FFrameRecord& Frame = Capture.Frames[Index];
+            Json += FString::Printf(TEXT("    {\"frame\": %llu, \"startMs\": %.3f, \"ms\": %.3f, \"idleMs\": %.3f}%s\n"),
+                                    Frame.FrameNumber,
+                                    ToMs(Frame.StartCycles, Capture.WindowStartCycles),
+                                    ToMs(Frame.EndCycles, Frame.StartCycles),
+                                    Frame.IdleMs,
+                                    Index + 1 < Capture.Frames.Num() ? TEXT(",") : TEXT(""));
+        }
+        Json += TEXT("  ],\n");
+
+        Json += TEXT("  \"scopes\": [\n");
+        for (int32 Index = 0; Index < Capture.Scopes.Num(); ++Index)
+        {
+            const FScopeRecord& Scope = Capture.Scopes[Index];
+            Json += FString::Printf(TEXT("    {\"name\": \"%s\", \"startMs\": %.3f, \"ms\": %.3f}%s\n"),
+                                    Scope.Name,
+                                    ToMs(Scope.StartCycles, Capture.WindowStartCycles),
+                                    ToMs(Scope.EndCycles, Scope.StartCycles),
+                                    Index + 1 < Capture.Scopes.Num() ? TEXT(",") : TEXT(""));
+        }
+        Json += TEXT("  ]\n}\n");
+        return Json;
+    }
+
+    /** The first locally controlled pawn in a game or PIE world */
+    const APawn* FindLocalPawn()
+    {
+        if (GEngine == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (const FWorldContext& Context : GEngine->GetWorldContexts())
+        {
+            const UWorld* World = Context.World();
+            if (World == nullptr || !World->IsGameWorld())
+            {
+                continue;
+            }
+
+            if (const APlayerController* PlayerController = World->GetFirstPlayerController())
+            {
+                if (const APawn* Pawn = PlayerController->GetPawn())
+                {
+                    return Pawn;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void DescribePlayer(FVRHitchPlayerState& OutState)
+    {
+        const APawn* Pawn = FindLocalPawn();
+        if (Pawn == nullptr)
+        {
+            return;
+        }
+
+        OutState.PawnName = Pawn->GetName();
+        OutState.Location = Pawn->GetActorLocation();
+        OutState.Rotation = Pawn->GetActorRotation();
+        OutState.Velocity = Pawn->GetVelocity();
+        OutState.HeadLocation = Pawn->GetPawnViewLocation();
+        OutState.HeadRotation = Pawn->GetViewRotation();
+
+        if (const AVRCharacter* VRCharacter = Cast<AVRCharacter>(Pawn))
+        {
+            VRCharacter->DescribeForHitch(OutState);
+        }
+        else if (const ADesktopCharacter* DesktopCharacter = Cast<ADesktopCharacter>(Pawn))
+        {
+            DesktopCharacter->DescribeForHitch(OutState);
+        }
+    }
+
+    /**
+     * How long a frame's work may take before it is a hitch. The target frame time comes from the engine's limit, which
+     * covers t.MaxFPS, a fixed frame rate and a server's NetServerMaxTickRate, or failing that the headset's rate.
+     */
+    float GetThresholdMs()
+    {
+        const float ThresholdMs = CVarHitchThresholdMs.GetValueOnGameThread();
+        if (ThresholdMs > 0.0f)
+        {
+            return ThresholdMs;
+        }
+
+        float TargetFrameRate = GEngine != nullptr ? GEngine->GetMaxTickRate(0.0f, false) : 0.0f;
+        if (TargetFrameRate <= 0.0f)
+        {
+            TargetFrameRate = CVarHitchTargetFrameRate.GetValueOnGameThread();
+        }
+        return CVarHitchThresholdFrames.GetValueOnGameThread() * 1000.0f / FMath::Max(TargetFrameRate, 1.0f);
+    }
+
+    void CaptureWindow(const FString& Reason, const uint64 HitchFrameNumber, const float FrameMs, const float ThresholdMs)
+    {
+        const uint64 NowCycles = FPlatformTime::Cycles64();
+        const uint64 WindowCycles = static_cast<uint64>(FMath::Max(CVarHitchWindowSeconds.GetValueOnGameThread(), 0.1f) /
+                                                        FPlatformTime::GetSecondsPerCycle64());
+
+        FCapture Capture;
+        Capture.Reason = Reason;
+        Capture.FrameNumber = HitchFrameNumber;
+        Capture.FrameMs = FrameMs;
+        Capture.ThresholdMs = ThresholdMs;
+        Capture.WindowStartCycles = NowCycles > WindowCycles ? NowCycles - WindowCycles : 0;
+
+        const uint32 FrameCount = FMath::Min(FrameHead, FrameCapacity);
+        for (uint32 Index = FrameHead - FrameCount; Index != FrameHead; ++Index)
+        {
+            const FFrameRecord& Frame = Frames[Index & FrameMask];
+            if (Frame.EndCycles >= Capture.WindowStartCycles)
+            {
+                Capture.Frames.Add(Frame);
+            }
+        }
+
+        const uint32 ScopeCount = FMath::Min(ScopeHead, ScopeCapacity);
+        for (uint32 Index = ScopeHead - ScopeCount; Index != ScopeHead; ++Index)
+        {
+            const FScopeRecord& Scope = Scopes[Index & ScopeMask];
+            if (Scope.EndCycles >= Capture.WindowStartCycles)
+            {
+                Capture.Scopes.Add(Scope);
+            }
+        }
+
+        // If the oldest surviving scope is still inside the window, older ones were overwritten
+        Capture.bScopesTruncated = ScopeHead > ScopeCapacity && !Capture.Scopes.IsEmpty() &&
+                                   Capture.Scopes[0].EndCycles > Capture.WindowStartCycles;
+
+        DescribePlayer(Capture.Player);
+
+        TRACE_BOOKMARK(TEXT("VRLab hitch: %s"), *Reason);
+        INC_DWORD_STAT(STAT_VRHitchesCaptured);
+
+        const FString FileName = FPaths::ProfilingDir() / TEXT("Hitches") /
+                                 FString::Printf(TEXT("Hitch_%s_%llu.json"),
+                                                 *FDateTime::Now().ToString(TEXT("%Y%m%d-%H%M%S")),
+                                                 HitchFrameNumber);
+        UE_LOG(LogVRHitch, Warning, TEXT("%s, writing %d scopes to %s"), *Reason, Capture.Scopes.Num(), *FileName);
+
+        AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [Capture = MoveTemp(Capture), FileName]()
+        {
+            if (!FFileHelper::SaveStringToFile(Format(Capture), *FileName, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+            {
+                UE_LOG(LogVRHitch, Error, TEXT("Unable to write %s"), *FileName);
+            }
+        });
+    }
+
+    void OnBeginFrame()
+    {
+        const uint64 NowCycles = FPlatformTime::Cycles64();
+        const bool bWasRecording = bRecording;
+        bRecording = CVarHitchEnable.GetValueOnGameThread();
+
+        // Begin to begin covers everything the frame waited on, including the present. Time the engine spent asleep to
+        // hold its frame rate limit isn't work, so it doesn't count towards a hitch: a server held to 30 Hz sleeps most
+        // of every frame.
+        if (bWasRecording && FrameStartCycles != 0)
+        {
+            FFrameRecord& Frame = Frames[FrameHead++ & FrameMask];
+            Frame.FrameNumber = FrameNumber;
+            Frame.StartCycles = FrameStartCycles;
+            Frame.EndCycles = NowCycles;
+            Frame.IdleMs = static_cast<float>(FApp::GetIdleTime() * 1000.0);
+
+            const float ElapsedMs = static_cast<float>(FPlatformTime::ToMilliseconds64(NowCycles - FrameStartCycles));
+            const float FrameMs = FMath::Max(ElapsedMs - Frame.IdleMs, 0.0f);
+            const float ThresholdMs = GetThresholdMs();
+            const double NowSeconds = FPlatformTime::ToSeconds64(NowCycles);
+            const int32 MaxCaptures = CVarHitchMaxCaptures.GetValueOnGameThread();
+            if (FramesToSkip == 0 &&
+                FrameMs > ThresholdMs &&
+                (LastCaptureSeconds < 0.0 || NowSeconds - LastCaptureSeconds >= CVarHitchCooldown.GetValueOnGameThread()) &&
+                (MaxCaptures <= 0 || CaptureCount < MaxCaptures))
+            {
+                LastCaptureSeconds = NowSeconds;
+                ++CaptureCount;
+                CaptureWindow(FString::Printf(TEXT("Frame %llu took %.1f ms, over %.1f ms"), FrameNumber, FrameMs, ThresholdMs),
+                              FrameNumber,
+                              FrameMs,
+                              ThresholdMs);
+            }
+        }
+
+        FramesToSkip = FMath::Max(FramesToSkip - 1, 0);
+        FrameStartCycles = NowCycles;
+        FrameNumber = GFrameCounter;
+    }
+
+    void OnPreGarbageCollect()
+    {
+        GCStartCycles = FPlatformTime::Cycles64();
+    }
+
+    void OnPostGarbageCollect()
+    {
+        if (GCStartCycles != 0)
+        {
+            FVRHitchCapture::RecordScope(TEXT("GarbageCollect"), GCStartCycles, FPlatformTime::Cycles64());
+            GCStartCycles = 0;
+        }
+    }
+
+    void OnPreLoadMap(const FString& MapName)
+    {
+        FramesToSkip = MAX_int32;
+    }
+
+    void OnPostLoadMap(UWorld* World)
+    {
+        FramesToSkip = FramesToSkipAfterLoad;
+    }
+}
+
+void FVRHitchPlayerState::AddInput(const APawn* Pawn, const UInputAction* Action)
+{
+    if (Pawn == nullptr || Action == nullptr)
+    {
+        return;
+    }
+
+    const APlayerController* PlayerController = Cast<APlayerController>(Pawn->GetController());
+    if (PlayerController == nullptr)
+    {
+        return;
+    }
+
+    const UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(
+        PlayerController->GetLocalPlayer());
+    const UEnhancedPlayerInput* PlayerInput = Subsystem != nullptr ? Subsystem->GetPlayerInput() : nullptr;
+    if (PlayerInput != nullptr)
+    {
+        Inputs.Emplace(Action->GetName(), PlayerInput->GetActionValue(Action).ToString());
+    }
+}
+
+void FVRHitchCapture::Startup()
+{
+    using namespace VRHitch;
+    BeginFrameHandle = FCoreDelegates::OnBeginFrame.AddStatic(&OnBeginFrame);
+    PreGCHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddStatic(&OnPreGarbageCollect);
+    PostGCHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddStatic(&OnPostGarbageCollect);
+    PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddStatic(&OnPreLoadMap);
+    PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddStatic(&OnPostLoadMap);
+}
+
+void FVRHitchCapture::Shutdown()
+{
+    using namespace VRHitch;
+    bRecording = false;
+    FCoreDelegates::OnBeginFrame.Remove(BeginFrameHandle);
+    FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGCHandle);
+    FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGCHandle);
+    FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+    FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+}
+
+void FVRHitchCapture::RecordScope(const TCHAR* Name, const uint64 StartCycles, const uint64 EndCycles)
+{
+    using namespace VRHitch;
+    if (!bRecording || !IsInGameThread())
+    {
+        return;
+    }
+
+    FScopeRecord& Record = Scopes[ScopeHead++ & ScopeMask];
+    Record.Name = Name;
+    Record.StartCycles = StartCycles;
+    Record.EndCycles = EndCycles;
+}
+
+void FVRHitchCapture::RecordMarker(const TCHAR* Name)
+{
+    const uint64 NowCycles = FPlatformTime::Cycles64();
+    RecordScope(Name, NowCycles, NowCycles);
+}
+
+void FVRHitchCapture::Capture(const TCHAR* Reason)
+{
+    check(IsInGameThread());
+    VRHitch::CaptureWindow(Reason, GFrameCounter, 0.0f, VRHitch::GetThresholdMs());
+}
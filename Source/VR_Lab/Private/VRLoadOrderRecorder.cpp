@@ -0,0 +1,234 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRLoadOrderRecorder.h"
+
+#include "Containers/Ticker.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectArray.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY(LogVRLoadOrder);
+
+static FAutoConsoleCommand WriteLoadOrderCommand(
+    TEXT("VRLab.LoadOrder.Write"),
+    TEXT("Write the package load order recorded since startup (needs -VRRecordLoadOrder). Args: [quit]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        FVRLoadOrderRecorder::Write();
+        if (Args.Contains(TEXT("quit")))
+        {
+            FPlatformMisc::RequestExit(false);
+        }
+    }));
+
+namespace VRLoadOrder
+{
+    /**
+     * Notes each package the first time it is created. A package being loaded is created when its load starts, on
+     * whichever thread is loading it, so this is the order the packaging tools should lay packages out in.
+     */
+    class FPackageListener final : public FUObjectArray::FUObjectCreateListener
+    {
+    public:
+        virtual void NotifyUObjectCreated(const UObjectBase* Object, int32 Index) override
+        {
+            if (Object->GetClass() != UPackage::StaticClass())
+            {
+                return;
+            }
+
+            FScopeLock Lock(&Mutex);
+            bool bAlreadySeen = false;
+            Seen.Add(Object->GetFName(), &bAlreadySeen);
+            if (!bAlreadySeen)
+            {
+                Order.Add(Object->GetFName());
+            }
+        }
+
+        virtual void OnUObjectArrayShutdown() override
+        {
+            GUObjectArray.RemoveUObjectCreateListener(this);
+        }
+
+        TArray<FName> GetOrder() const
+        {
+            FScopeLock Lock(&Mutex);
+            return Order;
+        }
+
+    private:
+        mutable FCriticalSection Mutex;
+        TSet<FName> Seen;
+        TArray<FName> Order;
+    };
+
+    static FPackageListener Listener;
+    static bool bRecording = false;
+    static float WriteDelaySeconds = 0.0f;
+
+    /** Packages known to hold a map, which take the map extension in the order file */
+    static TSet<FName> MapPackages;
+
+    static double PreLoadMapSeconds = 0.0;
+    static FString LoadingMapName;
+    static bool bFirstMapLoaded = false;
+
+    static FDelegateHandle PreLoadMapHandle;
+    static FDelegateHandle PostLoadMapHandle;
+    static FDelegateHandle PreExitHandle;
+    static FTSTicker::FDelegateHandle WriteDelayHandle;
+
+    /** Only packages that were read from disk belong in the order file */
+    bool IsOrderable(const FName PackageName)
+    {
+        const FString Name = PackageName.ToString();
+        return FPackageName::IsValidLongPackageName(Name) &&
+               !FPackageName::IsScriptPackage(Name) &&
+               !FPackageName::IsMemoryPackage(Name) &&
+               !FPackageName::IsTempPackage(Name);
+    }
+
+    bool IsMap(const FName PackageName)
+    {
+        if (MapPackages.Contains(PackageName))
+        {
+            return true;
+        }
+        const UPackage* Package = FindObject<UPackage>(nullptr, *PackageName.ToString());
+        return Package != nullptr && Package->ContainsMap();
+    }
+
+    bool OnWriteDelayElapsed(float DeltaTime)
+    {
+        FVRLoadOrderRecorder::Write();
+        FPlatformMisc::RequestExit(false);
+        return false;
+    }
+
+    void OnPreLoadMap(const FString& MapName)
+    {
+        PreLoadMapSeconds = FPlatformTime::Seconds();
+        LoadingMapName = MapName;
+    }
+
+    void OnPostLoadMap(UWorld* World)
+    {
+        const double Now = FPlatformTime::Seconds();
+        if (World != nullptr)
+        {
+            MapPackages.Add(World->GetOutermost()->GetFName());
+        }
+
+        if (PreLoadMapSeconds > 0.0)
+        {
+            UE_LOG(LogVRLoadOrder, Display, TEXT("Map load %s: %.1f ms"), *LoadingMapName, (Now - PreLoadMapSeconds) * 1000.0);
+            PreLoadMapSeconds = 0.0;
+        }
+
+        if (bFirstMapLoaded)
+        {
+            return;
+        }
+        bFirstMapLoaded = true;
+        UE_LOG(LogVRLoadOrder, Display, TEXT("Cold start to %s: %.1f ms"), *GetNameSafe(World), (Now - GStartTime) * 1000.0);
+
+        // Give the pawn and whatever it streams in after the map time to load before writing
+        if (bRecording && WriteDelaySeconds > 0.0f)
+        {
+            WriteDelayHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&OnWriteDelayElapsed),
+                                                                    WriteDelaySeconds);
+        }
+    }
+
+    void OnEnginePreExit()
+    {
+        if (bRecording)
+        {
+            FVRLoadOrderRecorder::Write();
+        }
+    }
+}
+
+void FVRLoadOrderRecorder::Startup()
+{
+    using namespace VRLoadOrder;
+    PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddStatic(&OnPreLoadMap);
+    PostLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddStatic(&OnPostLoadMap);
+
+    FParse::Value(FCommandLine::Get(), TEXT("VRRecordLoadOrderSeconds="), WriteDelaySeconds);
+    bRecording = FParse::Param(FCommandLine::Get(), TEXT("VRRecordLoadOrder")) || WriteDelaySeconds > 0.0f;
+    if (!bRecording)
+    {
+        return;
+    }
+
+    // Packages the engine loaded before this module started are missed. They stay in the packaging tools' default order.
+    UE_LOG(LogVRLoadOrder, Display, TEXT("Recording package load order"));
+    GUObjectArray.AddUObjectCreateListener(&Listener);
+    PreExitHandle = FCoreDelegates::OnEnginePreExit.AddStatic(&OnEnginePreExit);
+}
+
+void FVRLoadOrderRecorder::Shutdown()
+{
+    using namespace VRLoadOrder;
+    FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+    FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(PostLoadMapHandle);
+    if (!bRecording)
+    {
+        return;
+    }
+
+    bRecording = false;
+    FTSTicker::GetCoreTicker().RemoveTicker(WriteDelayHandle);
+    FCoreDelegates::OnEnginePreExit.Remove(PreExitHandle);
+    GUObjectArray.RemoveUObjectCreateListener(&Listener);
+}
+
+bool FVRLoadOrderRecorder::Write()
+{
+    using namespace VRLoadOrder;
+    if (!bRecording)
+    {
+        UE_LOG(LogVRLoadOrder, Warning, TEXT("Load order is only recorded with -VRRecordLoadOrder"));
+        return false;
+    }
+
+    // One quoted filename and its position per line, the format of Build/<Platform>/FileOpenOrder/GameOpenOrder.log
+    FString Output;
+    int32 Position = 0;
+    for (const FName PackageName : Listener.GetOrder())
+    {
+        if (!IsOrderable(PackageName))
+        {
+            continue;
+        }
+
+        const FString& Extension = IsMap(PackageName)
+                                       ? FPackageName::GetMapPackageExtension()
+                                       : FPackageName::GetAssetPackageExtension();
+        FString FileName;
+        if (FPackageName::TryConvertLongPackageNameToFilename(PackageName.ToString(), FileName, Extension))
+        {
+            Output += FString::Printf(TEXT("\"%s\" %d\n"), *FileName, ++Position);
+        }
+    }
+
+    const FString Path = FPaths::ProjectSavedDir() / TEXT("FileOpenOrder") / TEXT("GameOpenOrder.log");
+    if (!FFileHelper::SaveStringToFile(Output, *Path))
+    {
+        UE_LOG(LogVRLoadOrder, Error, TEXT("Unable to write %s"), *Path);
+        return false;
+    }
+
+    UE_LOG(LogVRLoadOrder, Display, TEXT("Wrote the load order of %d packages to %s"), Position, *Path);
+    return true;
+}
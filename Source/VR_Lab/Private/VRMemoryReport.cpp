@@ -0,0 +1,349 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRMemoryReport.h"
+
+#include "EngineUtils.h"
+#include "VR_Lab.h"
+#include "MotionControllerComponent.h"
+#include "RHI.h"
+#include "XRDeviceVisualizationComponent.h"
+#include "Containers/Ticker.h"
+#include "Camera/CameraComponent.h"
+#include "Components/ArrowComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Components/WidgetInteractionComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/SkinnedAsset.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/Texture.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/MovementComponent.h"
+#include "GameFramework/SpringArmComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Materials/MaterialInterface.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/ArchiveCountMem.h"
+
+DEFINE_LOG_CATEGORY(LogVRMemory);
+
+namespace VRMemory
+{
+    /** Follows the character tick LLM tag over a number of frames before the report is written */
+    struct FTickSampler
+    {
+        TArray<FVRMemoryReportRow> Rows;
+        FString FileName;
+        int32 Frames = 0;
+        int32 FramesLeft = 0;
+        int64 LastBytes = 0;
+        int64 TotalChange = 0;
+        int64 PeakChange = 0;
+        FTSTicker::FDelegateHandle TickerHandle;
+    };
+    static FTickSampler TickSampler;
+
+    void LogRows(const TArray<FVRMemoryReportRow>& Rows)
+    {
+        for (const FVRMemoryReportRow& Row : Rows)
+        {
+            UE_LOG(LogVRMemory,
+                   Display,
+                   TEXT("%-32s %-20s x%-3d object %8.1f KB  resource %8.1f KB  assets %9.1f KB"),
+                   *Row.Character,
+                   *Row.Category,
+                   Row.Count,
+                   Row.ObjectBytes / 1024.0,
+                   Row.ResourceBytes / 1024.0,
+                   Row.AssetBytes / 1024.0);
+        }
+    }
+
+    bool TickSamplerFrame(float DeltaTime)
+    {
+        // LLM totals its tags once a frame, so each sample is one frame's net change
+        const int64 Bytes = UVRMemoryReportLibrary::GetCharacterTickBytes();
+        const int64 Change = FMath::Abs(Bytes - TickSampler.LastBytes);
+        TickSampler.LastBytes = Bytes;
+        TickSampler.TotalChange += Change;
+        TickSampler.PeakChange = FMath::Max(TickSampler.PeakChange, Change);
+        if (--TickSampler.FramesLeft > 0)
+        {
+            return true;
+        }
+
+        FVRMemoryReportRow& Row = TickSampler.Rows.AddDefaulted_GetRef();
+        Row.Character = TEXT("AllCharacters");
+        Row.Category = TEXT("CharacterTick");
+        Row.Count = TickSampler.Frames;
+        Row.TickHeapBytes = Bytes;
+        Row.TickBytesPerFrame = TickSampler.TotalChange / TickSampler.Frames;
+        Row.TickBytesPeakFrame = TickSampler.PeakChange;
+        UE_LOG(LogVRMemory,
+               Display,
+               TEXT("Character ticks over %d frames: heap %.1f KB, change per frame %.1f KB average, %.1f KB peak"),
+               Row.Count,
+               Row.TickHeapBytes / 1024.0,
+               Row.TickBytesPerFrame / 1024.0,
+               Row.TickBytesPeakFrame / 1024.0);
+
+        UVRMemoryReportLibrary::WriteCsv(TickSampler.Rows, TickSampler.FileName);
+        TickSampler = FTickSampler();
+        return false;
+    }
+    const TCHAR* GetCategory(const UActorComponent* Component)
+    {
+        // Device visualizations are static mesh components too, so the more specific types are checked first
+        if (Component->IsA<UXRDeviceVisualizationComponent>())
+        {
+            return TEXT("DeviceVisualization");
+        }
+        if (Component->IsA<UMotionControllerComponent>())
+        {
+            return TEXT("MotionController");
+        }
+        if (Component->IsA<UWidgetInteractionComponent>())
+        {
+            return TEXT("WidgetInteraction");
+        }
+        if (Component->IsA<USkeletalMeshComponent>())
+        {
+            return TEXT("SkeletalMesh");
+        }
+        if (Component->IsA<UArrowComponent>())
+        {
+            return TEXT("Arrow");
+        }
+        if (Component->IsA<USpringArmComponent>())
+        {
+            return TEXT("SpringArm");
+        }
+        if (Component->IsA<UCameraComponent>())
+        {
+            return TEXT("Camera");
+        }
+        if (Component->IsA<UMovementComponent>())
+        {
+            return TEXT("Movement");
+        }
+        if (Component->IsA<UCapsuleComponent>())
+        {
+            return TEXT("Capsule");
+        }
+        return nullptr;
+    }
+
+    int64 GetObjectBytes(UObject* Object)
+    {
+        FArchiveCountMem CountMem(Object);
+        return Object->GetClass()->GetStructureSize() + CountMem.GetMax();
+    }
+
+    int64 GetResourceBytes(UObject* Object)
+    {
+        FResourceSizeEx ResourceSize(EResourceSizeMode::Exclusive);
+        Object->GetResourceSizeEx(ResourceSize);
+        return ResourceSize.GetTotalMemoryBytes();
+    }
+
+    /** Add up the assets a component references that no earlier component on the character did */
+    int64 GetNewAssetBytes(const UActorComponent* Component, TSet<UObject*>& SeenAssets)
+    {
+        TArray<UObject*, TInlineAllocator<16>> Assets;
+        if (const UStaticMeshComponent* StaticMeshComponent = Cast<UStaticMeshComponent>(Component))
+        {
+            Assets.Add(StaticMeshComponent->GetStaticMesh());
+        }
+        if (const USkinnedMeshComponent* SkinnedMeshComponent = Cast<USkinnedMeshComponent>(Component))
+        {
+            Assets.Add(SkinnedMeshComponent->GetSkinnedAsset());
+        }
+        if (const UPrimitiveComponent* PrimitiveComponent = Cast<UPrimitiveComponent>(Component))
+        {
+            TArray<UMaterialInterface*> Materials;
+            PrimitiveComponent->GetUsedMaterials(Materials);
+            for (UMaterialInterface* Material : Materials)
+            {
+                if (Material == nullptr)
+                {
+                    continue;
+                }
+                Assets.Add(Material);
+
+                TArray<UTexture*> Textures;
+                Material->GetUsedTextures(Textures, EMaterialQualityLevel::Num, true, GMaxRHIFeatureLevel, false);
+                Assets.Append(Textures);
+            }
+        }
+
+        int64 Bytes = 0;
+        for (UObject* Asset : Assets)
+        {
+            if (Asset == nullptr)
+            {
+                continue;
+            }
+
+            bool bAlreadySeen = false;
+            SeenAssets.Add(Asset, &bAlreadySeen);
+            if (!bAlreadySeen)
+            {
+                Bytes += Asset->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+            }
+        }
+        return Bytes;
+    }
+}
+
+static FAutoConsoleCommand CharacterMemoryCommand(
+    TEXT("VRLab.Memory.Characters"),
+    TEXT("Report the memory used by every character in the world, by component type, and write it to CSV. With -llm, ")
+    TEXT("first follow the heap character ticks allocate for some frames. Args: [file.csv] [frames=60]"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        using namespace VRMemory;
+
+        if (TickSampler.TickerHandle.IsValid())
+        {
+            UE_LOG(LogVRMemory, Warning, TEXT("A character memory report is already sampling"));
+            return;
+        }
+
+        const TArray<FVRMemoryReportRow> Rows = UVRMemoryReportLibrary::MeasureAllCharacters(World);
+        LogRows(Rows);
+
+        const FString FileName = Args.IsValidIndex(0) ? Args[0] : FPaths::ProfilingDir() / TEXT("CharacterMemory.csv");
+        const int32 Frames = Args.IsValidIndex(1) ? FMath::Max(0, FCString::Atoi(*Args[1])) : 60;
+        const int64 TickBytes = UVRMemoryReportLibrary::GetCharacterTickBytes();
+        if (TickBytes < 0 || Frames == 0)
+        {
+            if (TickBytes < 0)
+            {
+                UE_LOG(LogVRMemory, Display, TEXT("Run with -llm to include the heap character ticks allocate"));
+            }
+            UVRMemoryReportLibrary::WriteCsv(Rows, FileName);
+            return;
+        }
+
+        TickSampler.Rows = Rows;
+        TickSampler.FileName = FileName;
+        TickSampler.Frames = Frames;
+        TickSampler.FramesLeft = Frames;
+        TickSampler.LastBytes = TickBytes;
+        TickSampler.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&TickSamplerFrame));
+        UE_LOG(LogVRMemory, Display, TEXT("Following character tick allocations for %d frames"), Frames);
+    }));
+
+TArray<FVRMemoryReportRow> UVRMemoryReportLibrary::MeasureCharacter(AActor* Character)
+{
+    TArray<FVRMemoryReportRow> Rows;
+    if (Character == nullptr)
+    {
+        return Rows;
+    }
+
+    const FString CharacterName = Character->GetName();
+    TMap<FString, int32> RowIndices;
+    auto FindOrAddRow = [&Rows, &RowIndices, &CharacterName](const FString& Category) -> FVRMemoryReportRow&
+    {
+        if (const int32* Index = RowIndices.Find(Category))
+        {
+            return Rows[*Index];
+        }
+        FVRMemoryReportRow& Row = Rows.AddDefaulted_GetRef();
+        Row.Character = CharacterName;
+        Row.Category = Category;
+        RowIndices.Add(Category, Rows.Num() - 1);
+        return Row;
+    };
+
+    FVRMemoryReportRow& ActorRow = FindOrAddRow(TEXT("Actor"));
+    ActorRow.Count = 1;
+    ActorRow.ObjectBytes = VRMemory::GetObjectBytes(Character);
+    ActorRow.ResourceBytes = VRMemory::GetResourceBytes(Character);
+
+    TSet<UObject*> SeenAssets;
+    Character->ForEachComponent<UActorComponent>(false, [&](UActorComponent* Component)
+    {
+        const TCHAR* Category = VRMemory::GetCategory(Component);
+        FVRMemoryReportRow& Row = FindOrAddRow(Category != nullptr ? FString(Category) : Component->GetClass()->GetName());
+        ++Row.Count;
+        Row.ObjectBytes += VRMemory::GetObjectBytes(Component);
+        Row.ResourceBytes += VRMemory::GetResourceBytes(Component);
+        Row.AssetBytes += VRMemory::GetNewAssetBytes(Component, SeenAssets);
+    });
+
+    FVRMemoryReportRow Total;
+    Total.Character = CharacterName;
+    Total.Category = TEXT("Total");
+    for (const FVRMemoryReportRow& Row : Rows)
+    {
+        Total.Count += Row.Count;
+        Total.ObjectBytes += Row.ObjectBytes;
+        Total.ResourceBytes += Row.ResourceBytes;
+        Total.AssetBytes += Row.AssetBytes;
+    }
+    Rows.Add(Total);
+    return Rows;
+}
+
+TArray<FVRMemoryReportRow> UVRMemoryReportLibrary::MeasureAllCharacters(const UObject* WorldContextObject)
+{
+    TArray<FVRMemoryReportRow> Rows;
+    const UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+    if (World == nullptr)
+    {
+        return Rows;
+    }
+
+    for (TActorIterator<ACharacter> Iterator(World); Iterator; ++Iterator)
+    {
+        Rows.Append(MeasureCharacter(*Iterator));
+    }
+    return Rows;
+}
+
+int64 UVRMemoryReportLibrary::GetCharacterTickBytes()
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+    if (FLowLevelMemTracker::IsEnabled())
+    {
+        return FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, LLM_TAGNAME(VRLab_CharacterTick), ELLMTagSet::None);
+    }
+#endif
+    return -1;
+}
+
+FString UVRMemoryReportLibrary::ToCsv(const TArray<FVRMemoryReportRow>& Rows)
+{
+    FString Csv = TEXT("Character,Category,Count,ObjectBytes,ResourceBytes,AssetBytes,TickHeapBytes,TickBytesPerFrame,TickBytesPeakFrame\n");
+    for (const FVRMemoryReportRow& Row : Rows)
+    {
+        Csv += FString::Printf(TEXT("%s,%s,%d,%lld,%lld,%lld,%lld,%lld,%lld\n"),
+                               *Row.Character,
+                               *Row.Category,
+                               Row.Count,
+                               Row.ObjectBytes,
+                               Row.ResourceBytes,
+                               Row.AssetBytes,
+                               Row.TickHeapBytes,
+                               Row.TickBytesPerFrame,
+                               Row.TickBytesPeakFrame);
+    }
+    return Csv;
+}
+
+bool UVRMemoryReportLibrary::WriteCsv(const TArray<FVRMemoryReportRow>& Rows, const FString& FileName)
+{
+    if (!FFileHelper::SaveStringToFile(ToCsv(Rows), *FileName))
+    {
+        UE_LOG(LogVRMemory, Error, TEXT("Unable to write %s"), *FileName);
+        return false;
+    }
+
+    UE_LOG(LogVRMemory, Display, TEXT("Wrote character memory report to %s"), *FileName);
+    return true;
+}
@@ -0,0 +1,200 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRModeCharacters.h"
+
+#include "VRCameraBoomComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogVRCharacterModes);
+
+namespace VRCharacterModes
+{
+    /** Per-frame cost and size of one character class */
+    struct FModeCost
+    {
+        FString Name;
+        int32 Components = 0;
+        int32 TickingComponents = 0;
+        double MicrosecondsPerUpdate = 0.0;
+        int64 ObjectBytes = 0;
+        int64 ResourceBytes = 0;
+    };
+
+    /**
+     * Time the part of a frame that depends on the mode, Iterations times: TickForMode for VR characters, and the
+     * camera boom for desktop characters. The actor tick, movement and animation are the same for every mode and are
+     * left out.
+     */
+    double TimeModeUpdate(AActor* Character, const int32 Iterations)
+    {
+        constexpr float DeltaTime = 1.0f / 90.0f;
+        AVRCharacter* VRCharacter = Cast<AVRCharacter>(Character);
+        const ADesktopCharacter* DesktopCharacter = Cast<ADesktopCharacter>(Character);
+        UVRCameraBoomComponent* CameraBoom = DesktopCharacter != nullptr ? DesktopCharacter->GetCameraBoom() : nullptr;
+        if (VRCharacter == nullptr && CameraBoom == nullptr)
+        {
+            return 0.0;
+        }
+
+        const uint64 StartCycles = FPlatformTime::Cycles64();
+        for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+        {
+            if (VRCharacter != nullptr)
+            {
+                VRCharacter->TickModeForBenchmark(DeltaTime);
+            }
+            else
+            {
+                CameraBoom->TickComponent(DeltaTime, LEVELTICK_All, &CameraBoom->PrimaryComponentTick);
+            }
+        }
+        return FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000.0 / Iterations;
+    }
+
+    FModeCost Measure(const FString& Name, AActor* Character, const int32 Iterations)
+    {
+        FModeCost Cost;
+        Cost.Name = Name;
+        Cost.ObjectBytes = Character->GetClass()->GetStructureSize();
+        Cost.ResourceBytes = Character->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+
+        TInlineComponentArray<UActorComponent*> Components(Character);
+        Cost.Components = Components.Num();
+        for (UActorComponent* Component : Components)
+        {
+            Cost.TickingComponents += Component->PrimaryComponentTick.bCanEverTick && Component->PrimaryComponentTick.bStartWithTickEnabled ? 1 : 0;
+            Cost.ObjectBytes += Component->GetClass()->GetStructureSize();
+            Cost.ResourceBytes += Component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+        }
+
+        Cost.MicrosecondsPerUpdate = TimeModeUpdate(Character, Iterations);
+        return Cost;
+    }
+
+    template <typename TCharacter>
+    TCharacter* Spawn(UWorld* World, const int32 Index, const TFunction<void(TCharacter*)>& Configure = nullptr)
+    {
+        // Well apart, so they don't collide with each other
+        const FTransform Transform(FVector(Index * 1000.0, 0.0, 0.0));
+        TCharacter* Character = World->SpawnActorDeferred<TCharacter>(TCharacter::StaticClass(),
+                                                                      Transform,
+                                                                      nullptr,
+                                                                      nullptr,
+                                                                      ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+        if (Character != nullptr)
+        {
+            if (Configure)
+            {
+                Configure(Character);
+            }
+            Character->FinishSpawning(Transform);
+        }
+        return Character;
+    }
+}
+
+static FAutoConsoleCommand CharacterModeBenchmarkCommand(
+    TEXT("VRLab.Characters.ModeBenchmark"),
+    TEXT("Compare the per-frame mode update cost and size of the all-in-one and fixed-mode characters. Args: [iterations=1000] [quit]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        using namespace VRCharacterModes;
+
+        const int32 Iterations = Args.IsValidIndex(0) ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+        const bool bQuit = Args.Contains(TEXT("quit"));
+
+        // The characters go in a world of their own that never begins play. Their BeginPlay would otherwise enable the
+        // HMD, change the tracking origin, build the play area boundary and register with the significance manager,
+        // all of which outlives the benchmark.
+        UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("VRCharacterModeBenchmark"));
+        FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+        WorldContext.SetCurrentWorld(World);
+
+        TArray<TPair<FString, AActor*>> Characters;
+        Characters.Emplace(TEXT("AVRCharacter (seated)"),
+                           Spawn<AVRCharacter>(World, 0, [](AVRCharacter* Character) { Character->SeatedVR = true; }));
+        Characters.Emplace(TEXT("ASeatedVRCharacter"), Spawn<ASeatedVRCharacter>(World, 1));
+        Characters.Emplace(TEXT("AVRCharacter (room-scale)"),
+                           Spawn<AVRCharacter>(World, 2, [](AVRCharacter* Character) { Character->SeatedVR = false; }));
+        Characters.Emplace(TEXT("ARoomScaleVRCharacter"), Spawn<ARoomScaleVRCharacter>(World, 3));
+        Characters.Emplace(TEXT("ADesktopCharacter"), Spawn<ADesktopCharacter>(World, 4));
+        Characters.Emplace(TEXT("ADesktopThirdPersonCharacter"), Spawn<ADesktopThirdPersonCharacter>(World, 5));
+        Characters.Emplace(TEXT("ADesktopFirstPersonCharacter"), Spawn<ADesktopFirstPersonCharacter>(World, 6));
+
+        UE_LOG(LogVRCharacterModes, Display, TEXT("Character mode benchmark, %d mode updates each"), Iterations);
+        for (const TPair<FString, AActor*>& Entry : Characters)
+        {
+            if (Entry.Value == nullptr)
+            {
+                UE_LOG(LogVRCharacterModes, Warning, TEXT("%s could not be spawned"), *Entry.Key);
+                continue;
+            }
+
+            const FModeCost Cost = Measure(Entry.Key, Entry.Value, Iterations);
+            UE_LOG(LogVRCharacterModes,
+                   Display,
+                   TEXT("%-30s %7.2f us/update  components %2d (%2d ticking)  object %8.1f KB  resource %8.1f KB"),
+                   *Cost.Name,
+                   Cost.MicrosecondsPerUpdate,
+                   Cost.Components,
+                   Cost.TickingComponents,
+                   Cost.ObjectBytes / 1024.0,
+                   Cost.ResourceBytes / 1024.0);
+        }
+
+        GEngine->DestroyWorldContext(World);
+        World->DestroyWorld(false);
+
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExit(false);
+        }
+    }));
+
+ASeatedVRCharacter::ASeatedVRCharacter(const FObjectInitializer& ObjectInitializer)
+    : Super(ForMode<FVRSeatedPolicy>(ObjectInitializer))
+{
+    SeatedVR = true;
+}
+
+void ASeatedVRCharacter::TickForMode(const float DeltaTime)
+{
+    TickMode<FVRSeatedPolicy>(DeltaTime);
+}
+
+void ASeatedVRCharacter::BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent)
+{
+    BindModeInput<FVRSeatedPolicy>(EnhancedInputComponent);
+}
+
+ARoomScaleVRCharacter::ARoomScaleVRCharacter(const FObjectInitializer& ObjectInitializer)
+    : Super(ForMode<FVRRoomScalePolicy>(ObjectInitializer))
+{
+    SeatedVR = false;
+}
+
+void ARoomScaleVRCharacter::TickForMode(const float DeltaTime)
+{
+    TickMode<FVRRoomScalePolicy>(DeltaTime);
+}
+
+void ARoomScaleVRCharacter::BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent)
+{
+    BindModeInput<FVRRoomScalePolicy>(EnhancedInputComponent);
+}
+
+ADesktopThirdPersonCharacter::ADesktopThirdPersonCharacter(const FObjectInitializer& ObjectInitializer)
+    : Super(ForMode<FDesktopThirdPersonPolicy>(ObjectInitializer))
+{
+}
+
+ADesktopFirstPersonCharacter::ADesktopFirstPersonCharacter(const FObjectInitializer& ObjectInitializer)
+    : Super(ForMode<FDesktopFirstPersonPolicy>(ObjectInitializer))
+{
+    // Always looking where the controller looks, as ApplyPerspective would set up on switching to first person
+    bUseControllerRotationYaw = true;
+    GetCharacterMovement()->bOrientRotationToMovement = false;
+}
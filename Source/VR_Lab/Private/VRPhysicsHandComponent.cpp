@@ -0,0 +1,238 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRPhysicsHandComponent.h"
+
+#include "VR_Lab.h"
+#include "Engine/CollisionProfile.h"
+#include "Misc/ScopeLock.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+#include "PhysicsProxy/SingleParticlePhysicsProxy.h"
+
+DEFINE_LOG_CATEGORY(LogVRPhysicsHand);
+
+DECLARE_CYCLE_STAT(TEXT("Physics Hand Game Thread"), STAT_VRPhysicsHandGameThread, STATGROUP_VRLab);
+DECLARE_CYCLE_STAT(TEXT("Physics Hand Async Tick"), STAT_VRPhysicsHandAsyncTick, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Physics Hand Tracking Error, all hands (cm)"), STAT_VRPhysicsHandError, STATGROUP_VRLab);
+
+UVRPhysicsHandComponent::UVRPhysicsHandComponent()
+{
+    PrimaryComponentTick.bCanEverTick = true;
+    PrimaryComponentTick.bStartWithTickEnabled = false;
+    bAutoActivate = false;
+
+    // Publish the target once tracking and movement have both placed it for this frame
+    PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+    InitSphereRadius(6.0f);
+
+    // Follows its target through physics alone, never through its attachment parent
+    SetUsingAbsoluteLocation(true);
+    SetUsingAbsoluteRotation(true);
+    SetUsingAbsoluteScale(true);
+
+    SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+    SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    SetCollisionResponseToChannel(ECC_Pawn, ECR_Ignore);
+    SetCollisionResponseToChannel(ECC_Camera, ECR_Ignore);
+    SetGenerateOverlapEvents(false);
+    SetEnableGravity(false);
+    CanCharacterStepUpOn = ECB_No;
+    BodyInstance.bUseCCD = true;
+    BodyInstance.SetMassOverride(2.0f);
+}
+
+void UVRPhysicsHandComponent::SetTrackingTarget(USceneComponent* Target)
+{
+    TrackingTarget = Target;
+    if (Target != nullptr)
+    {
+        // Never publish the target before it has been tracked this frame
+        AddTickPrerequisiteComponent(Target);
+        PublishTarget(Target->GetComponentTransform());
+    }
+}
+
+void UVRPhysicsHandComponent::SetTargetTransform(const FTransform& Target)
+{
+    TrackingTarget.Reset();
+    PublishTarget(Target);
+}
+
+void UVRPhysicsHandComponent::ResetTracking()
+{
+    {
+        FScopeLock Lock(&TargetLock);
+        bHasTarget = false;
+        TrackingError = FVRPhysicsHandError();
+        StepError = FVRPhysicsHandError();
+        LastStepErrorCm = 0.0f;
+    }
+
+    if (const USceneComponent* Target = TrackingTarget.Get())
+    {
+        PublishTarget(Target->GetComponentTransform());
+        SetWorldTransform(Target->GetComponentTransform(), false, nullptr, ETeleportType::ResetPhysics);
+        SetPhysicsLinearVelocity(FVector::ZeroVector);
+        SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+    }
+}
+
+FVRPhysicsHandError UVRPhysicsHandComponent::ConsumeTrackingError()
+{
+    FScopeLock Lock(&TargetLock);
+    const FVRPhysicsHandError Error = TrackingError;
+    TrackingError = FVRPhysicsHandError();
+    return Error;
+}
+
+uint64 UVRPhysicsHandComponent::ConsumeGameThreadCycles()
+{
+    const uint64 Cycles = GameThreadCycles;
+    GameThreadCycles = 0;
+    return Cycles;
+}
+
+void UVRPhysicsHandComponent::Activate(const bool bReset)
+{
+    // Async physics is a project-wide setting, so turning it on is left to whoever opts in to physics hands
+    if (!UPhysicsSettings::Get()->bTickPhysicsAsync)
+    {
+        UE_LOG(LogVRPhysicsHand,
+               Warning,
+               TEXT("%s stays inactive: physics hands need Tick Physics Async enabled in the physics settings"),
+               *GetPathName());
+        return;
+    }
+
+    const bool bWasActive = IsActive();
+    Super::Activate(bReset);
+
+    // Before play begins there is nothing to simulate in yet; BeginPlay starts following instead
+    if (IsActive() && !bWasActive && HasBegunPlay())
+    {
+        SetFollowing(true);
+    }
+}
+
+void UVRPhysicsHandComponent::Deactivate()
+{
+    Super::Deactivate();
+
+    if (!IsActive())
+    {
+        SetFollowing(false);
+    }
+}
+
+void UVRPhysicsHandComponent::BeginPlay()
+{
+    Super::BeginPlay();
+
+    if (IsActive())
+    {
+        SetFollowing(true);
+    }
+}
+
+void UVRPhysicsHandComponent::SetFollowing(const bool bFollow)
+{
+    if (bFollow)
+    {
+        if (const USceneComponent* Target = TrackingTarget.Get())
+        {
+            PublishTarget(Target->GetComponentTransform());
+        }
+        if (bHasTarget)
+        {
+            SetWorldTransform(TargetTransform, false, nullptr, ETeleportType::TeleportPhysics);
+        }
+        SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+        SetSimulatePhysics(true);
+    }
+    else
+    {
+        SetSimulatePhysics(false);
+        SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    }
+    SetAsyncPhysicsTickEnabled(bFollow);
+    SetComponentTickEnabled(bFollow);
+}
+
+void UVRPhysicsHandComponent::TickComponent(const float DeltaTime,
+                                            const ELevelTick TickType,
+                                            FActorComponentTickFunction* ThisTickFunction)
+{
+    const uint64 StartCycles = FPlatformTime::Cycles64();
+    {
+        SCOPE_CYCLE_COUNTER(STAT_VRPhysicsHandGameThread);
+        Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+        if (const USceneComponent* Target = TrackingTarget.Get())
+        {
+            PublishTarget(Target->GetComponentTransform());
+        }
+
+        // Physics may not have stepped this frame, in which case the last step's error still stands
+        FScopeLock Lock(&TargetLock);
+        if (StepError.Steps > 0)
+        {
+            LastStepErrorCm = StepError.GetAverageCm();
+            StepError = FVRPhysicsHandError();
+        }
+        INC_FLOAT_STAT_BY(STAT_VRPhysicsHandError, LastStepErrorCm);
+    }
+    GameThreadCycles += FPlatformTime::Cycles64() - StartCycles;
+}
+
+void UVRPhysicsHandComponent::PublishTarget(const FTransform& Target)
+{
+    FScopeLock Lock(&TargetLock);
+    TargetTransform = Target;
+    bHasTarget = true;
+}
+
+void UVRPhysicsHandComponent::AsyncPhysicsTickComponent(const float DeltaTime, const float SimTime)
+{
+    SCOPE_CYCLE_COUNTER(STAT_VRPhysicsHandAsyncTick);
+    Super::AsyncPhysicsTickComponent(DeltaTime, SimTime);
+
+    FPhysicsActorHandle ActorHandle = BodyInstance.GetPhysicsActorHandle();
+    Chaos::FRigidBodyHandle_Internal* Body = ActorHandle != nullptr ? ActorHandle->GetPhysicsThreadAPI() : nullptr;
+    if (Body == nullptr || DeltaTime <= 0.0f)
+    {
+        return;
+    }
+
+    FTransform Target;
+    {
+        FScopeLock Lock(&TargetLock);
+        if (!bHasTarget)
+        {
+            return;
+        }
+        Target = TargetTransform;
+
+        const float ErrorCm = FVector::Dist(FVector(Body->X()), Target.GetLocation());
+        TrackingError.Add(ErrorCm);
+        StepError.Add(ErrorCm);
+    }
+
+    const FVector Delta = Target.GetLocation() - FVector(Body->X());
+    if (Delta.SizeSquared() > FMath::Square(SnapDistance))
+    {
+        Body->SetX(Target.GetLocation());
+        Body->SetR(Target.GetRotation());
+        Body->SetV(FVector::ZeroVector);
+        Body->SetW(FVector::ZeroVector);
+        return;
+    }
+
+    Body->SetV((Delta * (LinearResponse / DeltaTime)).GetClampedToMaxSize(MaxLinearSpeed));
+
+    FQuat DeltaRotation = Target.GetRotation() * FQuat(Body->R()).Inverse();
+    DeltaRotation.EnforceShortestArcWith(FQuat::Identity);
+    FVector Axis;
+    float Angle;
+    DeltaRotation.ToAxisAndAngle(Axis, Angle);
+    Body->SetW((Axis * (Angle * AngularResponse / DeltaTime)).GetClampedToMaxSize(FMath::DegreesToRadians(MaxAngularSpeed)));
+}
@@ -0,0 +1,308 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRPhysicsStressSubsystem.h"
+
+#include <atomic>
+
+#include "PBDRigidsSolver.h"
+#include "Chaos/SimCallbackObject.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Physics/Experimental/PhysScene_Chaos.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+
+DEFINE_LOG_CATEGORY(LogVRPhysicsStress);
+
+static FAutoConsoleCommand PhysicsHandStressCommand(
+    TEXT("VRLab.Physics.HandStress"),
+    TEXT("Sweep a pair of physics hands through a pile of simulated props and report physics-thread time and hand tracking error. Args: [props] [seconds] [quit]"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        UVRPhysicsStressSubsystem* StressSubsystem = World != nullptr ? World->GetSubsystem<UVRPhysicsStressSubsystem>() : nullptr;
+        if (StressSubsystem == nullptr)
+        {
+            UE_LOG(LogVRPhysicsStress, Error, TEXT("No physics stress subsystem in this world"));
+            return;
+        }
+
+        const int32 PropCount = Args.IsValidIndex(0) ? FCString::Atoi(*Args[0]) : 500;
+        const float Duration = Args.IsValidIndex(1) ? FCString::Atof(*Args[1]) : 30.0f;
+        const bool bQuit = Args.IsValidIndex(2) && Args[2].Equals(TEXT("quit"), ESearchCase::IgnoreCase);
+        StressSubsystem->StartHandStress(PropCount, Duration, bQuit);
+    }));
+
+namespace VRPhysicsStress
+{
+    constexpr float PropSize = 15.0f;
+    constexpr float PropSpacing = 20.0f;
+    constexpr float FloorSize = 2000.0f;
+    constexpr float SweepRadius = 40.0f;
+    constexpr float SweepHeight = 15.0f;
+    constexpr float SweepBob = 10.0f;
+    constexpr float SweepRevolutionsPerSecond = 0.5f;
+
+    /** Times each physics step on the physics thread, from the start of the step to the end of the solve */
+    class FStepTimer : public Chaos::TSimCallbackObject<Chaos::FSimCallbackNoInput,
+                                                        Chaos::FSimCallbackNoOutput,
+                                                        Chaos::ESimCallbackOptions::Presimulate |
+                                                        Chaos::ESimCallbackOptions::PostSolve>
+    {
+    public:
+        std::atomic<uint32> Steps{0};
+        std::atomic<uint64> TotalCycles{0};
+        std::atomic<uint64> MaxCycles{0};
+
+    private:
+        virtual void OnPreSimulate_Internal() override
+        {
+            StartCycles = FPlatformTime::Cycles64();
+        }
+
+        virtual void OnPostSolve_Internal() override
+        {
+            // Only the physics thread writes, so the maximum doesn't need a compare-exchange
+            const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+            Steps.fetch_add(1, std::memory_order_relaxed);
+            TotalCycles.fetch_add(Cycles, std::memory_order_relaxed);
+            if (Cycles > MaxCycles.load(std::memory_order_relaxed))
+            {
+                MaxCycles.store(Cycles, std::memory_order_relaxed);
+            }
+        }
+
+        uint64 StartCycles = 0;
+    };
+
+    Chaos::FPhysicsSolver* GetSolver(const UWorld* World)
+    {
+        const FPhysScene* Scene = World != nullptr ? World->GetPhysicsScene() : nullptr;
+        return Scene != nullptr ? Scene->GetSolver() : nullptr;
+    }
+
+    AStaticMeshActor* SpawnBox(UWorld* World, UStaticMesh* Mesh, const FVector& Location, const FVector& Scale, const bool bSimulate)
+    {
+        AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator);
+        Actor->SetMobility(EComponentMobility::Movable);
+        UStaticMeshComponent* MeshComponent = Actor->GetStaticMeshComponent();
+        MeshComponent->SetStaticMesh(Mesh);
+        MeshComponent->SetWorldScale3D(Scale);
+        MeshComponent->SetSimulatePhysics(bSimulate);
+        return Actor;
+    }
+}
+
+void UVRPhysicsStressSubsystem::Deinitialize()
+{
+    Cleanup();
+    Super::Deinitialize();
+}
+
+bool UVRPhysicsStressSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+    return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId UVRPhysicsStressSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UVRPhysicsStressSubsystem, STATGROUP_Tickables);
+}
+
+void UVRPhysicsStressSubsystem::StartHandStress(const int32 InPropCount, const float Duration, const bool bInQuitWhenDone)
+{
+    if (IsRunning())
+    {
+        UE_LOG(LogVRPhysicsStress, Warning, TEXT("A hand stress test is already running"));
+        return;
+    }
+
+    if (!UPhysicsSettings::Get()->bTickPhysicsAsync)
+    {
+        UE_LOG(LogVRPhysicsStress, Error, TEXT("Physics hands need Tick Physics Async enabled in the physics settings"));
+        return;
+    }
+
+    Chaos::FPhysicsSolver* Solver = VRPhysicsStress::GetSolver(GetWorld());
+    if (Solver == nullptr)
+    {
+        UE_LOG(LogVRPhysicsStress, Error, TEXT("No physics scene in this world"));
+        return;
+    }
+
+    PropCount = FMath::Max(InPropCount, 0);
+    Elapsed = 0.0f;
+    TimeRemaining = Duration;
+    bQuitWhenDone = bInQuitWhenDone;
+    Frames = 0;
+    FrameMsSum = 0.0f;
+    FrameMsMax = 0.0f;
+    HandGameThreadCycles = 0;
+    HandError = FVRPhysicsHandError();
+
+    // Run beside the local pawn if there is one, so the test can be watched in a normal session too
+    const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+    const APawn* Pawn = PlayerController != nullptr ? PlayerController->GetPawn() : nullptr;
+    Center = Pawn != nullptr ? Pawn->GetActorLocation() + Pawn->GetActorForwardVector() * 150.0f : FVector::ZeroVector;
+
+    SpawnScene(PropCount);
+    StepTimer = Solver->CreateAndRegisterSimCallbackObject_External<VRPhysicsStress::FStepTimer>();
+    UE_LOG(LogVRPhysicsStress, Display, TEXT("Sweeping physics hands through %d props for %.0f s"), PropCount, Duration);
+}
+
+void UVRPhysicsStressSubsystem::SpawnScene(const int32 InPropCount)
+{
+    using namespace VRPhysicsStress;
+    UWorld* World = GetWorld();
+    UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+    if (Cube == nullptr)
+    {
+        UE_LOG(LogVRPhysicsStress, Error, TEXT("Unable to load /Engine/BasicShapes/Cube"));
+        return;
+    }
+
+    // The engine cube is a metre across; the floor's top sits at Center
+    SpawnedActors.Add(SpawnBox(World,
+                               Cube,
+                               Center - FVector(0.0f, 0.0f, 10.0f),
+                               FVector(FloorSize / 100.0f, FloorSize / 100.0f, 0.2f),
+                               false));
+
+    // Stack the props in a cube over the sweep so they fall into the hands' path
+    const int32 Side = FMath::Max(FMath::CeilToInt(FMath::Pow(static_cast<float>(InPropCount), 1.0f / 3.0f)), 1);
+    const FVector Corner = Center + FVector(-0.5f * Side * PropSpacing, -0.5f * Side * PropSpacing, 2.0f * PropSpacing);
+    for (int32 Index = 0; Index < InPropCount; ++Index)
+    {
+        const FVector Cell(static_cast<double>(Index % Side),
+                           static_cast<double>(Index / Side % Side),
+                           static_cast<double>(Index / (Side * Side)));
+        SpawnedActors.Add(SpawnBox(World, Cube, Corner + Cell * PropSpacing, FVector(PropSize / 100.0f), true));
+    }
+
+    AActor* Rig = World->SpawnActor<AActor>(Center, FRotator::ZeroRotator);
+    USceneComponent* Root = NewObject<USceneComponent>(Rig, TEXT("Root"));
+    Rig->SetRootComponent(Root);
+    Root->RegisterComponent();
+    SpawnedActors.Add(Rig);
+
+    for (const TCHAR* Name : {TEXT("LeftStressHand"), TEXT("RightStressHand")})
+    {
+        UVRPhysicsHandComponent* Hand = NewObject<UVRPhysicsHandComponent>(Rig, Name);
+        Hand->SetupAttachment(Root);
+        Hands.Add(Hand);
+    }
+
+    // Give the hands their first target before they start simulating, so they don't begin with a snap
+    UpdateHandTargets();
+    for (UVRPhysicsHandComponent* Hand : Hands)
+    {
+        Hand->RegisterComponent();
+        Hand->Activate();
+    }
+}
+
+void UVRPhysicsStressSubsystem::UpdateHandTargets() const
+{
+    using namespace VRPhysicsStress;
+    for (int32 Index = 0; Index < Hands.Num(); ++Index)
+    {
+        // The hands sweep opposite sides of the same circle, bobbing up and down through the pile
+        const float Angle = Elapsed * SweepRevolutionsPerSecond * UE_TWO_PI + Index * UE_PI;
+        const FVector Offset(FMath::Cos(Angle) * SweepRadius,
+                             FMath::Sin(Angle) * SweepRadius,
+                             SweepHeight + FMath::Sin(Angle * 3.0f) * SweepBob);
+        Hands[Index]->SetTargetTransform(FTransform(FRotator(0.0f, FMath::RadiansToDegrees(Angle), 0.0f), Center + Offset));
+    }
+}
+
+void UVRPhysicsStressSubsystem::Tick(const float DeltaTime)
+{
+    if (!IsRunning())
+    {
+        return;
+    }
+
+    ++Frames;
+    FrameMsSum += DeltaTime * 1000.0f;
+    FrameMsMax = FMath::Max(FrameMsMax, DeltaTime * 1000.0f);
+    for (UVRPhysicsHandComponent* Hand : Hands)
+    {
+        const FVRPhysicsHandError Error = Hand->ConsumeTrackingError();
+        HandError.Steps += Error.Steps;
+        HandError.SumCm += Error.SumCm;
+        HandError.MaxCm = FMath::Max(HandError.MaxCm, Error.MaxCm);
+        HandGameThreadCycles += Hand->ConsumeGameThreadCycles();
+    }
+
+    Elapsed += DeltaTime;
+    UpdateHandTargets();
+
+    TimeRemaining -= DeltaTime;
+    if (TimeRemaining <= 0.0f)
+    {
+        Finish();
+    }
+}
+
+void UVRPhysicsStressSubsystem::Finish()
+{
+    TimeRemaining = 0.0f;
+
+    const uint32 Steps = StepTimer != nullptr ? StepTimer->Steps.load() : 0;
+    const double StepMs = Steps > 0 ? FPlatformTime::ToMilliseconds64(StepTimer->TotalCycles.load()) / Steps : 0.0;
+    const double WorstStepMs = StepTimer != nullptr ? FPlatformTime::ToMilliseconds64(StepTimer->MaxCycles.load()) : 0.0;
+    const int32 FrameCount = FMath::Max(Frames, 1);
+
+    UE_LOG(LogVRPhysicsStress,
+           Display,
+           TEXT("%d props, %d frames averaging %.2f ms (worst %.2f ms)"),
+           PropCount,
+           Frames,
+           FrameMsSum / FrameCount,
+           FrameMsMax);
+    UE_LOG(LogVRPhysicsStress,
+           Display,
+           TEXT("  physics thread: %u steps averaging %.3f ms (worst %.3f ms), from step start to end of solve"),
+           Steps,
+           StepMs,
+           WorstStepMs);
+    UE_LOG(LogVRPhysicsStress,
+           Display,
+           TEXT("  hands: %.1f us game thread per frame, tracking error %.2f cm average, %.2f cm worst"),
+           FPlatformTime::ToMilliseconds64(HandGameThreadCycles) * 1000.0 / FrameCount,
+           HandError.GetAverageCm(),
+           HandError.MaxCm);
+
+    Cleanup();
+
+    if (bQuitWhenDone)
+    {
+        FPlatformMisc::RequestExit(false);
+    }
+}
+
+void UVRPhysicsStressSubsystem::Cleanup()
+{
+    if (StepTimer != nullptr)
+    {
+        if (Chaos::FPhysicsSolver* Solver = VRPhysicsStress::GetSolver(GetWorld()))
+        {
+            Solver->UnregisterAndFreeSimCallbackObject_External(StepTimer);
+        }
+        StepTimer = nullptr;
+    }
+
+    for (AActor* Actor : SpawnedActors)
+    {
+        if (IsValid(Actor))
+        {
+            Actor->Destroy();
+        }
+    }
+    SpawnedActors.Reset();
+    Hands.Reset();
+    TimeRemaining = 0.0f;
+}
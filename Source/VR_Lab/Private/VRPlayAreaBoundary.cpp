@@ -0,0 +1,347 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRPlayAreaBoundary.h"
+
+#include "VR_Lab.h"
+#include "VRTelemetry.h"
+#include "HeadMountedDisplayFunctionLibrary.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/CommandLine.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Parse.h"
+
+DEFINE_LOG_CATEGORY(LogVRBoundary);
+
+DECLARE_CYCLE_STAT(TEXT("Boundary Build"), STAT_VRBoundaryBuild, STATGROUP_VRLab);
+DECLARE_CYCLE_STAT(TEXT("Boundary Queries"), STAT_VRBoundaryQueries, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Boundary Head Distance (cm)"), STAT_VRBoundaryHeadDistance, STATGROUP_VRLab);
+
+static FAutoConsoleCommand BoundaryBenchmarkCommand(
+    TEXT("VRLab.Boundary.Benchmark"),
+    TEXT("Time play area distance lookups against brute-force polygon distance on the stand-in polygon. Args: [queries=100000] [cellsize=5] [quit]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        const int32 Queries = Args.IsValidIndex(0) ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+        const float CellSize = Args.IsValidIndex(1) ? FMath::Max(1.0f, FCString::Atof(*Args[1])) : 5.0f;
+        const bool bQuit = Args.Contains(TEXT("quit"));
+
+        const TArray<FVector2D> Polygon = UVRPlayAreaBoundaryComponent::MakeStandInPolygon();
+        FVRPlayAreaDistanceField Field;
+        const double BuildStart = FPlatformTime::Seconds();
+        Field.Build(Polygon, CellSize);
+        const double BuildMs = (FPlatformTime::Seconds() - BuildStart) * 1000.0;
+
+        // Spread the queries over the polygon's bounds and a metre around them, the way tracked heads and hands would
+        const FBox2D Bounds = FBox2D(Polygon).ExpandBy(100.0);
+        FRandomStream Random(1);
+        TArray<FVector2D> Points;
+        Points.Reserve(Queries);
+        for (int32 Index = 0; Index < Queries; ++Index)
+        {
+            Points.Emplace(Random.FRandRange(Bounds.Min.X, Bounds.Max.X), Random.FRandRange(Bounds.Min.Y, Bounds.Max.Y));
+        }
+
+        TArray<float> FieldDistances;
+        FieldDistances.SetNumUninitialized(Queries);
+        const double FieldStart = FPlatformTime::Seconds();
+        for (int32 Index = 0; Index < Queries; ++Index)
+        {
+            FieldDistances[Index] = Field.GetDistance(Points[Index]);
+        }
+        const double FieldNs = (FPlatformTime::Seconds() - FieldStart) * 1.0e9 / Queries;
+
+        TArray<float> ExactDistances;
+        ExactDistances.SetNumUninitialized(Queries);
+        const double ExactStart = FPlatformTime::Seconds();
+        for (int32 Index = 0; Index < Queries; ++Index)
+        {
+            ExactDistances[Index] = FVRPlayAreaDistanceField::GetDistanceBruteForce(Polygon, Points[Index]);
+        }
+        const double ExactNs = (FPlatformTime::Seconds() - ExactStart) * 1.0e9 / Queries;
+
+        // Accuracy matters most near the edge, where warnings and clamping happen
+        double ErrorSum = 0.0;
+        float MaxError = 0.0f;
+        float MaxNearError = 0.0f;
+        for (int32 Index = 0; Index < Queries; ++Index)
+        {
+            const float Error = FMath::Abs(FieldDistances[Index] - ExactDistances[Index]);
+            ErrorSum += Error;
+            MaxError = FMath::Max(MaxError, Error);
+            if (FMath::Abs(ExactDistances[Index]) < 50.0f)
+            {
+                MaxNearError = FMath::Max(MaxNearError, Error);
+            }
+        }
+
+        UE_LOG(LogVRBoundary,
+               Display,
+               TEXT("%d edges, %.1f cm cells: %d cells built in %.2f ms"),
+               Polygon.Num(),
+               CellSize,
+               Field.GetNumCells(),
+               BuildMs);
+        UE_LOG(LogVRBoundary,
+               Display,
+               TEXT("%d queries: field %.1f ns, brute force %.1f ns (%.1fx)"),
+               Queries,
+               FieldNs,
+               ExactNs,
+               FieldNs > 0.0 ? ExactNs / FieldNs : 0.0);
+        UE_LOG(LogVRBoundary,
+               Display,
+               TEXT("Error: average %.3f cm, max %.3f cm, max within 50 cm of the edge %.3f cm"),
+               ErrorSum / Queries,
+               MaxError,
+               MaxNearError);
+
+        if (bQuit)
+        {
+            FPlatformMisc::RequestExit(false);
+        }
+    }));
+
+//////////////////////////////////////////////////////////////////////////
+// FVRPlayAreaDistanceField
+
+void FVRPlayAreaDistanceField::Build(const TArrayView<const FVector2D> Polygon, const float InCellSize, const float Margin)
+{
+    SCOPE_CYCLE_COUNTER(STAT_VRBoundaryBuild);
+
+    Reset();
+    if (Polygon.Num() < 3)
+    {
+        return;
+    }
+
+    const FBox2D Bounds = FBox2D(Polygon.GetData(), Polygon.Num()).ExpandBy(Margin);
+    CellSize = FMath::Max(InCellSize, 1.0f);
+    Origin = Bounds.Min;
+    SizeX = FMath::Max(2, FMath::CeilToInt32(Bounds.GetSize().X / CellSize) + 1);
+    SizeY = FMath::Max(2, FMath::CeilToInt32(Bounds.GetSize().Y / CellSize) + 1);
+
+    Distances.SetNumUninitialized(SizeX * SizeY);
+    for (int32 Y = 0; Y < SizeY; ++Y)
+    {
+        for (int32 X = 0; X < SizeX; ++X)
+        {
+            const FVector2D Sample = Origin + FVector2D(static_cast<double>(X), static_cast<double>(Y)) * CellSize;
+            Distances[Y * SizeX + X] = GetDistanceBruteForce(Polygon, Sample);
+        }
+    }
+}
+
+void FVRPlayAreaDistanceField::Reset()
+{
+    Distances.Reset();
+    SizeX = 0;
+    SizeY = 0;
+}
+
+float FVRPlayAreaDistanceField::GetDistance(const FVector2D& Point) const
+{
+    if (!IsValid())
+    {
+        return MAX_flt;
+    }
+
+    const FVector2D Grid = (Point - Origin) / CellSize;
+    const FVector2D Clamped(FMath::Clamp(Grid.X, 0.0, SizeX - 1.0), FMath::Clamp(Grid.Y, 0.0, SizeY - 1.0));
+    const int32 X = FMath::Min(FMath::FloorToInt32(Clamped.X), SizeX - 2);
+    const int32 Y = FMath::Min(FMath::FloorToInt32(Clamped.Y), SizeY - 2);
+    const float Distance = FMath::BiLerp(GetSample(X, Y),
+                                         GetSample(X + 1, Y),
+                                         GetSample(X, Y + 1),
+                                         GetSample(X + 1, Y + 1),
+                                         static_cast<float>(Clamped.X - X),
+                                         static_cast<float>(Clamped.Y - Y));
+    return Distance - FVector2D::Distance(Grid, Clamped) * CellSize;
+}
+
+FVector2D FVRPlayAreaDistanceField::GetGradient(const FVector2D& Point) const
+{
+    const FVector2D Gradient(GetDistance(Point + FVector2D(CellSize, 0.0)) - GetDistance(Point - FVector2D(CellSize, 0.0)),
+                             GetDistance(Point + FVector2D(0.0, CellSize)) - GetDistance(Point - FVector2D(0.0, CellSize)));
+    return Gradient.GetSafeNormal();
+}
+
+FVector2D FVRPlayAreaDistanceField::ClampInside(const FVector2D& Point, const float MinDistance) const
+{
+    if (!IsValid())
+    {
+        return Point;
+    }
+
+    // A step along the gradient lands on the target distance along straight edges. Near corners it takes another.
+    FVector2D Result = Point;
+    for (int32 Step = 0; Step < 3; ++Step)
+    {
+        const float Distance = GetDistance(Result);
+        if (Distance >= MinDistance)
+        {
+            break;
+        }
+        Result += GetGradient(Result) * (MinDistance - Distance);
+    }
+    return Result;
+}
+
+float FVRPlayAreaDistanceField::GetDistanceBruteForce(const TArrayView<const FVector2D> Polygon, const FVector2D& Point)
+{
+    if (Polygon.Num() < 3)
+    {
+        return MAX_flt;
+    }
+
+    bool bInside = false;
+    double MinDistanceSquared = MAX_dbl;
+    for (int32 Index = 0, Previous = Polygon.Num() - 1; Index < Polygon.Num(); Previous = Index++)
+    {
+        const FVector2D& A = Polygon[Previous];
+        const FVector2D& B = Polygon[Index];
+
+        // Even-odd rule: count the edges a ray along +X from the point crosses
+        if ((A.Y > Point.Y) != (B.Y > Point.Y) && Point.X < A.X + (Point.Y - A.Y) * (B.X - A.X) / (B.Y - A.Y))
+        {
+            bInside = !bInside;
+        }
+
+        const FVector2D Edge = B - A;
+        const double T = FMath::Clamp(FVector2D::DotProduct(Point - A, Edge) / FMath::Max(Edge.SizeSquared(), UE_DOUBLE_SMALL_NUMBER),
+                                      0.0,
+                                      1.0);
+        MinDistanceSquared = FMath::Min(MinDistanceSquared, FVector2D::DistSquared(Point, A + Edge * T));
+    }
+
+    const float Distance = static_cast<float>(FMath::Sqrt(MinDistanceSquared));
+    return bInside ? Distance : -Distance;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UVRPlayAreaBoundaryComponent
+
+UVRPlayAreaBoundaryComponent::UVRPlayAreaBoundaryComponent()
+{
+    // The character feeds it tracking from its own tick
+    PrimaryComponentTick.bCanEverTick = false;
+
+    StandInPolygon = MakeStandInPolygon();
+}
+
+TArray<FVector2D> UVRPlayAreaBoundaryComponent::MakeStandInPolygon()
+{
+    return {
+        FVector2D(-150.0, -125.0),
+        FVector2D(150.0, -125.0),
+        FVector2D(150.0, 60.0),
+        FVector2D(85.0, 125.0),
+        FVector2D(-150.0, 125.0)
+    };
+}
+
+void UVRPlayAreaBoundaryComponent::BeginPlay()
+{
+    Super::BeginPlay();
+
+    RecenterHandle = FCoreDelegates::VRHeadsetRecenter.AddUObject(this, &UVRPlayAreaBoundaryComponent::OnRecenter);
+}
+
+void UVRPlayAreaBoundaryComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    FCoreDelegates::VRHeadsetRecenter.Remove(RecenterHandle);
+
+    Super::EndPlay(EndPlayReason);
+}
+
+void UVRPlayAreaBoundaryComponent::OnRecenter()
+{
+    // Recentering moves the tracking space, and the play area with it. The headset may also have bounds by now.
+    if (bFromTrackingSystem)
+    {
+        BuildFromTrackingSystem();
+    }
+}
+
+void UVRPlayAreaBoundaryComponent::BuildFromTrackingSystem()
+{
+    bFromTrackingSystem = true;
+
+    // The stage bounds are the largest rectangle inside the guardian, centred on the stage origin
+    const FVector2D Size = UHeadMountedDisplayFunctionLibrary::GetPlayAreaBounds(EHMDTrackingOrigin::Stage);
+    if (Size.X > 0.0 && Size.Y > 0.0)
+    {
+        const FVector2D Extent = Size / 2.0;
+        SetPolygon({
+            FVector2D(-Extent.X, -Extent.Y),
+            FVector2D(Extent.X, -Extent.Y),
+            FVector2D(Extent.X, Extent.Y),
+            FVector2D(-Extent.X, Extent.Y)
+        });
+        return;
+    }
+
+    if (bUseStandInPolygon || FParse::Param(FCommandLine::Get(), TEXT("VRStandInBoundary")))
+    {
+        UE_LOG(LogVRBoundary, Log, TEXT("No play area from the tracking system, using the stand-in polygon"));
+        SetPolygon(StandInPolygon);
+        return;
+    }
+
+    UE_LOG(LogVRBoundary, Verbose, TEXT("No play area from the tracking system, the boundary is off"));
+    ClearBoundary();
+}
+
+void UVRPlayAreaBoundaryComponent::SetPolygon(const TArray<FVector2D>& NewPolygon)
+{
+    ClearBoundary();
+    Polygon = NewPolygon;
+    Field.Build(Polygon, CellSize, WarningDistance + 100.0f);
+    UE_LOG(LogVRBoundary, Log, TEXT("Play area boundary of %d edges, %d cells"), Polygon.Num(), Field.GetNumCells());
+}
+
+void UVRPlayAreaBoundaryComponent::ClearBoundary()
+{
+    Polygon.Reset();
+    Field.Reset();
+    HeadDistance = MAX_flt;
+    LeftHandDistance = MAX_flt;
+    RightHandDistance = MAX_flt;
+    bNearBoundary = false;
+}
+
+void UVRPlayAreaBoundaryComponent::UpdateTracking(const FVector& Head, const FVector& LeftHand, const FVector& RightHand)
+{
+    if (!HasBoundary())
+    {
+        return;
+    }
+
+    SCOPE_CYCLE_COUNTER(STAT_VRBoundaryQueries);
+    HeadDistance = Field.GetDistance(FVector2D(Head));
+    LeftHandDistance = Field.GetDistance(FVector2D(LeftHand));
+    RightHandDistance = Field.GetDistance(FVector2D(RightHand));
+    SET_FLOAT_STAT(STAT_VRBoundaryHeadDistance, HeadDistance);
+
+    const float Closest = FMath::Min3(HeadDistance, LeftHandDistance, RightHandDistance);
+    const bool bNear = Closest < WarningDistance;
+    if (bNear != bNearBoundary)
+    {
+        bNearBoundary = bNear;
+        FVRTelemetry::Record(EVRTelemetryEvent::BoundaryWarning,
+                             GetOwner()->GetUniqueID(),
+                             bNear ? 1 : 0,
+                             FMath::RoundToInt32(Closest));
+    }
+}
+
+float UVRPlayAreaBoundaryComponent::GetHandDistance(const EControllerHand Hand) const
+{
+    return Hand == EControllerHand::Left ? LeftHandDistance : RightHandDistance;
+}
+
+FVector UVRPlayAreaBoundaryComponent::ClampHead(const FVector& Head) const
+{
+    const FVector2D Clamped = Field.ClampInside(FVector2D(Head), ClampDistance);
+    return FVector(Clamped.X, Clamped.Y, Head.Z);
+}
@@ -0,0 +1,18 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRPlayerController.h"
+
+#include "VRGameModeBase.h"
+#include "Engine/World.h"
+
+void AVRPlayerController::PawnLeavingGame()
+{
+    // ReleasePawn unpossesses it, which leaves the base class nothing to destroy
+    AVRGameModeBase* GameMode = GetWorld()->GetAuthGameMode<AVRGameModeBase>();
+    if (GameMode != nullptr && GameMode->ReleasePawn(GetPawn()))
+    {
+        return;
+    }
+
+    Super::PawnLeavingGame();
+}
@@ -0,0 +1,341 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRQualityGovernor.h"
+
+#include "RenderCore.h"
+#include "RHI.h"
+#include "VR_Lab.h"
+#include "VRSignificanceSubsystem.h"
+#include "VRTelemetry.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+
+DEFINE_LOG_CATEGORY(LogVRQualityGovernor);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Quality Tier"), STAT_VRQualityTier, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Quality Governor Average (ms)"), STAT_VRQualityAverage, STATGROUP_VRLab);
+
+static FAutoConsoleCommand ReplayQualityTraceCommand(
+    TEXT("VRLab.QualityGovernor.Replay"),
+    TEXT("Replay a CSV of game,render,gpu frame times (ms) through the quality governor and log its tier decisions. Args: <csv file> [expected tiers, e.g. 0,1,2,1] [quit]"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        if (Args.IsEmpty())
+        {
+            UE_LOG(LogVRQualityGovernor, Error, TEXT("Usage: VRLab.QualityGovernor.Replay <csv file> [expected tiers] [quit]"));
+            return;
+        }
+
+        TArray<int32> ExpectedTiers;
+        if (Args.IsValidIndex(1) && Args[1] != TEXT("quit"))
+        {
+            TArray<FString> Tiers;
+            Args[1].ParseIntoArray(Tiers, TEXT(","));
+            for (const FString& Tier : Tiers)
+            {
+                ExpectedTiers.Add(FCString::Atoi(*Tier));
+            }
+        }
+
+        const bool bPassed = UVRQualityGovernorSubsystem::ReplayTrace(Args[0], ExpectedTiers);
+        if (Args.Contains(TEXT("quit")))
+        {
+            FPlatformMisc::RequestExitWithStatus(false, bPassed ? 0 : 1);
+        }
+    }));
+
+namespace VRQualityGovernor
+{
+    void SetConsoleVariable(const TCHAR* Name, const float Value)
+    {
+        if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+        {
+            // The renderer settings come from DefaultEngine.ini, so anything weaker than code won't override them
+            Variable->Set(Value, ECVF_SetByCode);
+        }
+    }
+
+    void SetConsoleVariable(const TCHAR* Name, const int32 Value)
+    {
+        if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+        {
+            Variable->Set(Value, ECVF_SetByCode);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// FVRQualityGovernor
+
+FVRQualityGovernor::FVRQualityGovernor(const FSettings& InSettings)
+    : Settings(InSettings)
+{
+    Settings.NumTiers = FMath::Max(Settings.NumTiers, 1);
+    Settings.WindowFrames = FMath::Max(Settings.WindowFrames, 1);
+    Window.SetNum(Settings.WindowFrames);
+}
+
+int32 FVRQualityGovernor::AddSample(const FVRFrameTimeSample& Sample)
+{
+    if (NumSamples == Settings.WindowFrames)
+    {
+        const FVRFrameTimeSample& Oldest = Window[NextSample];
+        WindowSumMs -= Oldest.GetBottleneckMs();
+        WindowSum.GameThreadMs -= Oldest.GameThreadMs;
+        WindowSum.RenderThreadMs -= Oldest.RenderThreadMs;
+        WindowSum.GPUMs -= Oldest.GPUMs;
+    }
+    else
+    {
+        ++NumSamples;
+    }
+    Window[NextSample] = Sample;
+    WindowSumMs += Sample.GetBottleneckMs();
+    WindowSum.GameThreadMs += Sample.GameThreadMs;
+    WindowSum.RenderThreadMs += Sample.RenderThreadMs;
+    WindowSum.GPUMs += Sample.GPUMs;
+    NextSample = (NextSample + 1) % Settings.WindowFrames;
+
+    // Only decide on a full window of frames from the current tier
+    if (NumSamples < Settings.WindowFrames)
+    {
+        return Tier;
+    }
+
+    const float AverageMs = GetAverageMs();
+    if (AverageMs > Settings.FrameBudgetMs * Settings.DownshiftRatio)
+    {
+        FramesUnderUpshift = 0;
+        if (Tier < Settings.NumTiers - 1)
+        {
+            ChangeTier(Tier + 1);
+        }
+    }
+    else if (AverageMs < Settings.FrameBudgetMs * Settings.UpshiftRatio)
+    {
+        if (++FramesUnderUpshift >= Settings.UpshiftHoldFrames && Tier > 0)
+        {
+            ChangeTier(Tier - 1);
+        }
+    }
+    else
+    {
+        FramesUnderUpshift = 0;
+    }
+
+    return Tier;
+}
+
+TArray<int32> FVRQualityGovernor::Replay(const FSettings& Settings, const TConstArrayView<FVRFrameTimeSample> Samples)
+{
+    FVRQualityGovernor Governor(Settings);
+    TArray<int32> Tiers = {Governor.GetTier()};
+    for (const FVRFrameTimeSample& Sample : Samples)
+    {
+        if (Governor.AddSample(Sample) != Tiers.Last())
+        {
+            Tiers.Add(Governor.GetTier());
+        }
+    }
+    return Tiers;
+}
+
+void FVRQualityGovernor::ChangeTier(const int32 NewTier)
+{
+    // Keep what the decision was based on before the window is cleared
+    ChangeAverageMs = GetAverageMs();
+    ChangeAverage.GameThreadMs = WindowSum.GameThreadMs / NumSamples;
+    ChangeAverage.RenderThreadMs = WindowSum.RenderThreadMs / NumSamples;
+    ChangeAverage.GPUMs = WindowSum.GPUMs / NumSamples;
+
+    Tier = NewTier;
+    ResetWindow();
+}
+
+void FVRQualityGovernor::ResetWindow()
+{
+    NextSample = 0;
+    NumSamples = 0;
+    WindowSumMs = 0.0f;
+    WindowSum = FVRFrameTimeSample();
+    FramesUnderUpshift = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UVRQualityGovernorSubsystem
+
+bool UVRQualityGovernorSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+    // Nothing to govern without a renderer
+    return !IsRunningDedicatedServer() && Super::ShouldCreateSubsystem(Outer);
+}
+
+void UVRQualityGovernorSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    if (Tiers.IsEmpty())
+    {
+        Tiers.AddDefaulted();
+    }
+
+    Governor = MakeUnique<FVRQualityGovernor>(MakeGovernorSettings());
+    bInitialized = true;
+}
+
+void UVRQualityGovernorSubsystem::Deinitialize()
+{
+    bInitialized = false;
+    Governor.Reset();
+
+    Super::Deinitialize();
+}
+
+FVRQualityGovernor::FSettings UVRQualityGovernorSubsystem::MakeGovernorSettings() const
+{
+    FVRQualityGovernor::FSettings Settings;
+    Settings.NumTiers = FMath::Max(Tiers.Num(), 1);
+    Settings.FrameBudgetMs = 1000.0f / FMath::Max(TargetFrameRate, 1.0f);
+    Settings.WindowFrames = WindowFrames;
+    Settings.DownshiftRatio = DownshiftRatio;
+    Settings.UpshiftRatio = UpshiftRatio;
+    Settings.UpshiftHoldFrames = UpshiftHoldFrames;
+    return Settings;
+}
+
+bool UVRQualityGovernorSubsystem::IsTickable() const
+{
+    return bInitialized && bEnabled;
+}
+
+TStatId UVRQualityGovernorSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UVRQualityGovernorSubsystem, STATGROUP_Tickables);
+}
+
+void UVRQualityGovernorSubsystem::Tick(float DeltaTime)
+{
+    FVRFrameTimeSample Sample;
+    Sample.GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+    Sample.RenderThreadMs = FPlatformTime::ToMilliseconds(GRenderThreadTime);
+    Sample.GPUMs = FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles());
+
+    const int32 PreviousTier = Governor->GetTier();
+    const int32 NewTier = Governor->AddSample(Sample);
+    if (NewTier != PreviousTier)
+    {
+        const FVRFrameTimeSample& Average = Governor->GetChangeAverage();
+        UE_LOG(LogVRQualityGovernor,
+               Log,
+               TEXT("Quality tier %d (%s) -> %d (%s), %.2f ms window average against a %.2f ms budget (game %.2f, render %.2f, GPU %.2f; %s bound)"),
+               PreviousTier,
+               *Tiers[PreviousTier].Name.ToString(),
+               NewTier,
+               *Tiers[NewTier].Name.ToString(),
+               Governor->GetChangeAverageMs(),
+               1000.0f / TargetFrameRate,
+               Average.GameThreadMs,
+               Average.RenderThreadMs,
+               Average.GPUMs,
+               Average.GetBottleneckName());
+        FVRTelemetry::Record(EVRTelemetryEvent::QualityTierChanged, GetUniqueID(), NewTier, PreviousTier);
+        ApplyTier(NewTier);
+    }
+
+    // Worlds come and go with map loads, so keep the current world's character budget in step every frame
+    if (const UWorld* World = GetGameInstance()->GetWorld())
+    {
+        if (UVRSignificanceSubsystem* SignificanceSubsystem = World->GetSubsystem<UVRSignificanceSubsystem>())
+        {
+            SignificanceSubsystem->SetBudgetScale(Tiers[NewTier].CharacterBudgetScale);
+        }
+    }
+
+    SET_DWORD_STAT(STAT_VRQualityTier, NewTier);
+    SET_FLOAT_STAT(STAT_VRQualityAverage, Governor->GetAverageMs());
+}
+
+void UVRQualityGovernorSubsystem::ApplyTier(const int32 TierIndex)
+{
+    const FVRQualityTier& Tier = Tiers[TierIndex];
+    VRQualityGovernor::SetConsoleVariable(TEXT("r.ScreenPercentage"), Tier.ScreenPercentage);
+    VRQualityGovernor::SetConsoleVariable(TEXT("r.Shadow.Virtual.Enable"), Tier.bVirtualShadows ? 1 : 0);
+    VRQualityGovernor::SetConsoleVariable(TEXT("sg.ShadowQuality"), Tier.ShadowQuality);
+    VRQualityGovernor::SetConsoleVariable(TEXT("r.DynamicGlobalIlluminationMethod"), Tier.DynamicGlobalIlluminationMethod);
+    VRQualityGovernor::SetConsoleVariable(TEXT("r.ReflectionMethod"), Tier.ReflectionMethod);
+}
+
+bool UVRQualityGovernorSubsystem::ReplayTrace(const FString& FileName, const TArray<int32>& ExpectedTiers)
+{
+    TArray<FString> Lines;
+    if (!FFileHelper::LoadFileToStringArray(Lines, *FileName))
+    {
+        UE_LOG(LogVRQualityGovernor, Error, TEXT("Unable to read %s"), *FileName);
+        return false;
+    }
+
+    const UVRQualityGovernorSubsystem* Defaults = GetDefault<UVRQualityGovernorSubsystem>();
+    const FVRQualityGovernor::FSettings Settings = Defaults->MakeGovernorSettings();
+    FVRQualityGovernor ReplayGovernor(Settings);
+    TArray<int32> TierSequence = {ReplayGovernor.GetTier()};
+    TArray<int32> FramesPerTier;
+    FramesPerTier.SetNumZeroed(Settings.NumTiers);
+
+    int32 Frame = 0;
+    TArray<FString> Columns;
+    for (const FString& Line : Lines)
+    {
+        // Anything that isn't three numbers, such as a header row, is skipped
+        Line.ParseIntoArray(Columns, TEXT(","));
+        for (FString& Column : Columns)
+        {
+            Column.TrimStartAndEndInline();
+        }
+        if (Columns.Num() < 3 || !Columns[0].IsNumeric() || !Columns[1].IsNumeric() || !Columns[2].IsNumeric())
+        {
+            continue;
+        }
+
+        FVRFrameTimeSample Sample;
+        Sample.GameThreadMs = FCString::Atof(*Columns[0]);
+        Sample.RenderThreadMs = FCString::Atof(*Columns[1]);
+        Sample.GPUMs = FCString::Atof(*Columns[2]);
+
+        const int32 PreviousTier = ReplayGovernor.GetTier();
+        const int32 NewTier = ReplayGovernor.AddSample(Sample);
+        if (NewTier != PreviousTier)
+        {
+            const FVRFrameTimeSample& Average = ReplayGovernor.GetChangeAverage();
+            UE_LOG(LogVRQualityGovernor,
+                   Display,
+                   TEXT("Frame %d: tier %d -> %d, %.2f ms window average (%s bound)"),
+                   Frame,
+                   PreviousTier,
+                   NewTier,
+                   ReplayGovernor.GetChangeAverageMs(),
+                   Average.GetBottleneckName());
+            TierSequence.Add(NewTier);
+        }
+        ++FramesPerTier[NewTier];
+        ++Frame;
+    }
+
+    for (int32 TierIndex = 0; TierIndex < FramesPerTier.Num(); ++TierIndex)
+    {
+        UE_LOG(LogVRQualityGovernor, Display, TEXT("Tier %d: %d of %d frames"), TierIndex, FramesPerTier[TierIndex], Frame);
+    }
+
+    const auto JoinTiers = [](const TArray<int32>& Tiers)
+    {
+        return FString::JoinBy(Tiers, TEXT(","), [](const int32 Tier) { return FString::FromInt(Tier); });
+    };
+    if (!ExpectedTiers.IsEmpty() && ExpectedTiers != TierSequence)
+    {
+        UE_LOG(LogVRQualityGovernor, Error, TEXT("Expected tiers %s, got %s"), *JoinTiers(ExpectedTiers), *JoinTiers(TierSequence));
+        return false;
+    }
+    UE_LOG(LogVRQualityGovernor, Display, TEXT("Tiers %s"), *JoinTiers(TierSequence));
+    return true;
+}
@@ -0,0 +1,474 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRSignificanceSubsystem.h"
+
+#include "RenderCore.h"
+#include "SignificanceManager.h"
+#include "VR_Lab.h"
+#include "VRModeCharacters.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogVRSignificance);
+
+DECLARE_CYCLE_STAT(TEXT("Significance Update"), STAT_VRSignificanceUpdate, STATGROUP_VRLab);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Full Rate Characters"), STAT_VRSignificanceFullRate, STATGROUP_VRLab);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Throttled Characters"), STAT_VRSignificanceThrottled, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Character Budget Used (ms)"), STAT_VRSignificanceBudgetUsed, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Character Ticks Measured (ms)"), STAT_VRSignificanceMeasured, STATGROUP_VRLab);
+
+static FAutoConsoleCommand SignificanceBenchmarkCommand(
+    TEXT("VRLab.Significance.Benchmark"),
+    TEXT("Spawn characters around the player and compare game-thread time with and without significance throttling. Args: [characters] [frames] [quit]"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        UVRSignificanceSubsystem* SignificanceSubsystem = World != nullptr
+                                                              ? World->GetSubsystem<UVRSignificanceSubsystem>()
+                                                              : nullptr;
+        if (SignificanceSubsystem == nullptr)
+        {
+            UE_LOG(LogVRSignificance, Error, TEXT("No significance subsystem in this world"));
+            return;
+        }
+
+        const int32 CharacterCount = Args.IsValidIndex(0) ? FCString::Atoi(*Args[0]) : 300;
+        const int32 Frames = Args.IsValidIndex(1) ? FCString::Atoi(*Args[1]) : 300;
+        const bool bQuit = Args.IsValidIndex(2) && Args[2].Equals(TEXT("quit"), ESearchCase::IgnoreCase);
+        SignificanceSubsystem->StartBenchmark(CharacterCount, Frames, bQuit);
+    }));
+
+namespace VRSignificance
+{
+    const FName CharacterTag("VRCharacter");
+
+    /** Frames left to settle after the characters spawn or the throttling changes, before measuring */
+    constexpr int32 WarmupFrames = 30;
+}
+
+void UVRSignificanceSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    if (Tiers.IsEmpty())
+    {
+        // Without configured tiers every character simply stays at full rate
+        Tiers.AddDefaulted();
+    }
+}
+
+void UVRSignificanceSubsystem::Deinitialize()
+{
+    if (USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+    {
+        for (const TPair<TWeakObjectPtr<ACharacter>, FCharacterState>& Entry : Characters)
+        {
+            if (ACharacter* Character = Entry.Key.Get())
+            {
+                SignificanceManager->UnregisterObject(Character);
+            }
+        }
+    }
+    Characters.Reset();
+    BenchmarkCharacters.Reset();
+    BenchmarkPhase = EBenchmarkPhase::None;
+
+    Super::Deinitialize();
+}
+
+bool UVRSignificanceSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+    return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId UVRSignificanceSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UVRSignificanceSubsystem, STATGROUP_Tickables);
+}
+
+void UVRSignificanceSubsystem::RegisterCharacter(ACharacter* Character)
+{
+    USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld());
+    if (Character == nullptr || SignificanceManager == nullptr || Characters.Contains(Character))
+    {
+        return;
+    }
+
+    SignificanceManager->RegisterObject(Character,
+                                        VRSignificance::CharacterTag,
+                                        [this](USignificanceManager::FManagedObjectInfo* ObjectInfo,
+                                               const FTransform& Viewpoint)
+                                        {
+                                            return CalculateSignificance(
+                                                CastChecked<AActor>(ObjectInfo->GetObject()), Viewpoint);
+                                        });
+    Characters.Add(Character);
+}
+
+void UVRSignificanceSubsystem::UnregisterCharacter(ACharacter* Character)
+{
+    if (Characters.Remove(Character) == 0)
+    {
+        return;
+    }
+
+    if (USignificanceManager* SignificanceManager = USignificanceManager::Get(GetWorld()))
+    {
+        SignificanceManager->UnregisterObject(Character);
+    }
+}
+
+void UVRSignificanceSubsystem::ReportTickCost(ACharacter* Character, const float CostMs)
+{
+    FCharacterState* State = Characters.Find(Character);
+    if (State == nullptr)
+    {
+        return;
+    }
+
+    FrameTickCostMs += CostMs;
+    State->TickCostMs = State->TickCostMs < 0.0f ? CostMs : FMath::Lerp(State->TickCostMs, CostMs, 0.1f);
+}
+
+float UVRSignificanceSubsystem::CalculateSignificance(const AActor* Actor, const FTransform& Viewpoint) const
+{
+    const float Distance = FVector::Dist(Actor->GetActorLocation(), Viewpoint.GetLocation());
+    float Significance = 1.0f - FMath::Clamp(Distance / MaxSignificanceDistance, 0.0f, 1.0f);
+    if (!Actor->WasRecentlyRendered(0.2f))
+    {
+        Significance *= NotRenderedSignificanceScale;
+    }
+    return Significance;
+}
+
+float UVRSignificanceSubsystem::GetTierCostMs(const int32 TierIndex, const float DeltaTime, const FCharacterState& State) const
+{
+    // A character ticking every N seconds costs a full update on roughly DeltaTime / N of the frames
+    const float TickInterval = Tiers[TierIndex].TickInterval;
+    const float UpdateFraction = TickInterval > DeltaTime ? DeltaTime / TickInterval : 1.0f;
+    return FMath::Max(State.TickCostMs, FullRateCharacterCostMs) * UpdateFraction;
+}
+
+void UVRSignificanceSubsystem::Tick(float DeltaTime)
+{
+    SCOPE_CYCLE_COUNTER(STAT_VRSignificanceUpdate);
+
+    UWorld* World = GetWorld();
+    USignificanceManager* SignificanceManager = USignificanceManager::Get(World);
+    const float BudgetMs = CharacterBudgetMs * BudgetScale;
+    float RemainingBudgetMs = BudgetMs;
+    int32 FullRateCount = 0;
+    int32 ManagedCount = 0;
+
+    if (SignificanceManager != nullptr && !Characters.IsEmpty())
+    {
+        TArray<FTransform, TInlineAllocator<4>> Viewpoints;
+        for (FConstPlayerControllerIterator Iterator = World->GetPlayerControllerIterator(); Iterator; ++Iterator)
+        {
+            if (const APlayerController* PlayerController = Iterator->Get())
+            {
+                FVector ViewLocation;
+                FRotator ViewRotation;
+                PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+                Viewpoints.Emplace(ViewRotation, ViewLocation);
+            }
+        }
+        SignificanceManager->Update(Viewpoints);
+
+        TArray<const USignificanceManager::FManagedObjectInfo*> ManagedObjects;
+        SignificanceManager->GetManagedObjects(VRSignificance::CharacterTag, ManagedObjects);
+        ManagedObjects.Sort([](const USignificanceManager::FManagedObjectInfo& A,
+                               const USignificanceManager::FManagedObjectInfo& B)
+        {
+            return A.GetSignificance() > B.GetSignificance();
+        });
+        ManagedCount = ManagedObjects.Num();
+
+        // Hand out tiers from the most significant character down so the budget goes where the players are looking
+        for (const USignificanceManager::FManagedObjectInfo* ObjectInfo : ManagedObjects)
+        {
+            ACharacter* Character = Cast<ACharacter>(ObjectInfo->GetObject());
+            FCharacterState* State = Characters.Find(Character);
+            if (State == nullptr)
+            {
+                continue;
+            }
+
+            int32 TierIndex = 0;
+            if (bThrottling && !Character->IsLocallyControlled())
+            {
+                while (TierIndex < Tiers.Num() - 1 && Tiers[TierIndex].MinSignificance > ObjectInfo->GetSignificance())
+                {
+                    ++TierIndex;
+                }
+                while (TierIndex < Tiers.Num() - 1 && GetTierCostMs(TierIndex, DeltaTime, *State) > RemainingBudgetMs)
+                {
+                    ++TierIndex;
+                }
+            }
+            RemainingBudgetMs -= GetTierCostMs(TierIndex, DeltaTime, *State);
+
+            if (TierIndex == 0)
+            {
+                ++FullRateCount;
+            }
+
+            if (State->Tier != TierIndex)
+            {
+                State->Tier = TierIndex;
+                ApplyTier(Character, TierIndex);
+            }
+        }
+    }
+
+    SET_DWORD_STAT(STAT_VRSignificanceFullRate, FullRateCount);
+    SET_DWORD_STAT(STAT_VRSignificanceThrottled, ManagedCount - FullRateCount);
+    SET_FLOAT_STAT(STAT_VRSignificanceBudgetUsed, BudgetMs - RemainingBudgetMs);
+    SET_FLOAT_STAT(STAT_VRSignificanceMeasured, FrameTickCostMs);
+
+    if (IsBenchmarkRunning())
+    {
+        TickBenchmark(BudgetMs - RemainingBudgetMs, FullRateCount);
+    }
+    FrameTickCostMs = 0.0f;
+}
+
+void UVRSignificanceSubsystem::ApplyTier(ACharacter* Character, const int32 TierIndex) const
+{
+    const FVRSignificanceTier& Tier = Tiers[TierIndex];
+    UE_LOG(LogVRSignificance, Verbose, TEXT("%s moved to tier %d"), *GetNameSafe(Character), TierIndex);
+
+    Character->SetActorTickInterval(Tier.TickInterval);
+
+    const bool bLocallyControlled = Character->IsLocallyControlled();
+    Character->ForEachComponent<UActorComponent>(false, [&Tier, bLocallyControlled](UActorComponent* Component)
+    {
+        if (!Component->PrimaryComponentTick.bCanEverTick)
+        {
+            return;
+        }
+
+        // The local player's own movement must stay at full rate no matter what
+        if (bLocallyControlled && Component->IsA<UCharacterMovementComponent>())
+        {
+            return;
+        }
+
+        Component->SetComponentTickInterval(Tier.TickInterval);
+        if (USkeletalMeshComponent* SkeletalMesh = Cast<USkeletalMeshComponent>(Component))
+        {
+            SkeletalMesh->VisibilityBasedAnimTickOption = Tier.bTickPoseWhenNotRendered
+                                                              ? EVisibilityBasedAnimTickOption::AlwaysTickPose
+                                                              : EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+
+            // The characters turn update rate optimization on, and every LOD skips the tier's frames
+            if (FAnimUpdateRateParameters* UpdateRate = SkeletalMesh->AnimUpdateRateParams)
+            {
+                UpdateRate->bShouldUseLodMap = true;
+                UpdateRate->LODToFrameSkipMap.Reset();
+                for (int32 LODIndex = 0; LODIndex < FMath::Max(SkeletalMesh->GetNumLODs(), 1); ++LODIndex)
+                {
+                    UpdateRate->LODToFrameSkipMap.Add(LODIndex, Tier.AnimFrameSkip);
+                }
+            }
+        }
+    });
+}
+
+void UVRSignificanceSubsystem::SetThrottling(const bool bEnabled)
+{
+    bThrottling = bEnabled;
+    if (bThrottling)
+    {
+        return;
+    }
+
+    for (TPair<TWeakObjectPtr<ACharacter>, FCharacterState>& Entry : Characters)
+    {
+        ACharacter* Character = Entry.Key.Get();
+        if (Character != nullptr && Entry.Value.Tier != 0)
+        {
+            Entry.Value.Tier = 0;
+            ApplyTier(Character, 0);
+        }
+    }
+}
+
+void UVRSignificanceSubsystem::StartBenchmark(const int32 CharacterCount, const int32 FramesPerPhase, const bool bQuitWhenDone)
+{
+    if (IsBenchmarkRunning())
+    {
+        UE_LOG(LogVRSignificance, Warning, TEXT("A significance benchmark is already running"));
+        return;
+    }
+
+    BenchmarkCharacterCount = FMath::Max(CharacterCount, 1);
+    BenchmarkFramesPerPhase = FMath::Max(FramesPerPhase, 1);
+    bQuitAfterBenchmark = bQuitWhenDone;
+    for (FBenchmarkPhaseResult& Result : BenchmarkResults)
+    {
+        Result = FBenchmarkPhaseResult();
+    }
+
+    UE_LOG(LogVRSignificance,
+           Display,
+           TEXT("Significance benchmark: %d characters, %d frames per phase"),
+           BenchmarkCharacterCount,
+           BenchmarkFramesPerPhase);
+    BenchmarkPhase = EBenchmarkPhase::Baseline;
+    BenchmarkWarmupFrames = VRSignificance::WarmupFrames;
+}
+
+void UVRSignificanceSubsystem::TickBenchmark(const float BudgetUsedMs, const int32 FullRateCount)
+{
+    if (BenchmarkWarmupFrames > 0)
+    {
+        --BenchmarkWarmupFrames;
+        return;
+    }
+
+    // The game thread time is the previous frame's, which is a whole frame of the same phase after the warm-up
+    FBenchmarkPhaseResult& Result = BenchmarkResults[static_cast<int32>(BenchmarkPhase)];
+    const float GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+    ++Result.Frames;
+    Result.GameThreadMsSum += GameThreadMs;
+    Result.GameThreadMsMax = FMath::Max(Result.GameThreadMsMax, GameThreadMs);
+    Result.MeasuredTickMsSum += FrameTickCostMs;
+    Result.BudgetUsedMsSum += BudgetUsedMs;
+    Result.FullRateSum += FullRateCount;
+    if (Result.Frames < BenchmarkFramesPerPhase)
+    {
+        return;
+    }
+
+    BenchmarkWarmupFrames = VRSignificance::WarmupFrames;
+    switch (BenchmarkPhase)
+    {
+        case EBenchmarkPhase::Baseline:
+            SpawnBenchmarkCharacters();
+            BenchmarkPhase = EBenchmarkPhase::Throttled;
+            break;
+        case EBenchmarkPhase::Throttled:
+            SetThrottling(false);
+            BenchmarkPhase = EBenchmarkPhase::FullRate;
+            break;
+        default:
+            FinishBenchmark();
+            break;
+    }
+}
+
+void UVRSignificanceSubsystem::SpawnBenchmarkCharacters()
+{
+    UWorld* World = GetWorld();
+    UClass* CharacterClass = BenchmarkCharacterClass.LoadSynchronous();
+    if (CharacterClass == nullptr)
+    {
+        CharacterClass = ADesktopThirdPersonCharacter::StaticClass();
+    }
+
+    FVector Center = FVector::ZeroVector;
+    FRotator ViewRotation;
+    if (const APlayerController* PlayerController = World->GetFirstPlayerController())
+    {
+        PlayerController->GetPlayerViewPoint(Center, ViewRotation);
+    }
+
+    // Spread them evenly over a disc reaching past MaxSignificanceDistance, so every significance is represented
+    FActorSpawnParameters SpawnInfo;
+    SpawnInfo.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+    SpawnInfo.ObjectFlags |= RF_Transient;
+    const float Radius = MaxSignificanceDistance * 1.5f;
+    for (int32 Index = 0; Index < BenchmarkCharacterCount; ++Index)
+    {
+        const float Distance = Radius * FMath::Sqrt((Index + 0.5f) / BenchmarkCharacterCount);
+        const float Angle = Index * 2.39996f; // The golden angle
+        const FVector Location = Center + FVector(FMath::Cos(Angle) * Distance, FMath::Sin(Angle) * Distance, 0.0f);
+        if (ACharacter* Character = World->SpawnActor<ACharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnInfo))
+        {
+            BenchmarkCharacters.Add(Character);
+        }
+    }
+
+    UE_LOG(LogVRSignificance, Display, TEXT("Spawned %d %s"), BenchmarkCharacters.Num(), *CharacterClass->GetName());
+}
+
+void UVRSignificanceSubsystem::LogBenchmarkPhase(const TCHAR* Name, const FBenchmarkPhaseResult& Result) const
+{
+    UE_LOG(LogVRSignificance,
+           Display,
+           TEXT("  %-10s game thread %.2f ms avg, %.2f ms max; character ticks %.2f ms; budget used %.2f ms; full rate %.1f"),
+           Name,
+           Result.GetAverage(Result.GameThreadMsSum),
+           Result.GameThreadMsMax,
+           Result.GetAverage(Result.MeasuredTickMsSum),
+           Result.GetAverage(Result.BudgetUsedMsSum),
+           Result.GetAverage(Result.FullRateSum));
+}
+
+void UVRSignificanceSubsystem::FinishBenchmark()
+{
+    const FBenchmarkPhaseResult& Baseline = BenchmarkResults[static_cast<int32>(EBenchmarkPhase::Baseline)];
+    const FBenchmarkPhaseResult& Throttled = BenchmarkResults[static_cast<int32>(EBenchmarkPhase::Throttled)];
+    const FBenchmarkPhaseResult& FullRate = BenchmarkResults[static_cast<int32>(EBenchmarkPhase::FullRate)];
+    const int32 CharacterCount = FMath::Max(BenchmarkCharacters.Num(), 1);
+
+    UE_LOG(LogVRSignificance, Display, TEXT("Significance benchmark with %d characters:"), BenchmarkCharacters.Num());
+    LogBenchmarkPhase(TEXT("None"), Baseline);
+    LogBenchmarkPhase(TEXT("Throttled"), Throttled);
+    LogBenchmarkPhase(TEXT("Full rate"), FullRate);
+
+    // What the characters add to the game thread, movement and animation included
+    const float BaselineMs = Baseline.GetAverage(Baseline.GameThreadMsSum);
+    const float ThrottledCostMs = Throttled.GetAverage(Throttled.GameThreadMsSum) - BaselineMs;
+    const float FullRateCostMs = FullRate.GetAverage(FullRate.GameThreadMsSum) - BaselineMs;
+    const float BudgetMs = CharacterBudgetMs * BudgetScale;
+    UE_LOG(LogVRSignificance,
+           Display,
+           TEXT("Throttled characters cost %.2f ms of game thread against a %.2f ms budget: %s"),
+           ThrottledCostMs,
+           BudgetMs,
+           ThrottledCostMs <= BudgetMs ? TEXT("within budget") : TEXT("OVER BUDGET"));
+    UE_LOG(LogVRSignificance,
+           Display,
+           TEXT("One character at full rate costs %.4f ms, of which its own tick is %.4f ms (FullRateCharacterCostMs=%.4f)"),
+           FullRateCostMs / CharacterCount,
+           FullRate.GetAverage(FullRate.MeasuredTickMsSum) / CharacterCount,
+           FullRateCharacterCostMs);
+
+    for (ACharacter* Character : BenchmarkCharacters)
+    {
+        if (IsValid(Character))
+        {
+            Character->Destroy();
+        }
+    }
+    BenchmarkCharacters.Reset();
+    SetThrottling(true);
+    BenchmarkPhase = EBenchmarkPhase::None;
+
+    if (bQuitAfterBenchmark)
+    {
+        FPlatformMisc::RequestExit(false);
+    }
+}
+
+FVRCharacterTickTimer::FVRCharacterTickTimer(ACharacter* InCharacter)
+    : Character(InCharacter), StartCycles(FPlatformTime::Cycles64())
+{
+}
+
+FVRCharacterTickTimer::~FVRCharacterTickTimer()
+{
+    const UWorld* World = Character->GetWorld();
+    if (UVRSignificanceSubsystem* SignificanceSubsystem = World != nullptr
+                                                              ? World->GetSubsystem<UVRSignificanceSubsystem>()
+                                                              : nullptr)
+    {
+        const double CostMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+        SignificanceSubsystem->ReportTickCost(Character, static_cast<float>(CostMs));
+    }
+}
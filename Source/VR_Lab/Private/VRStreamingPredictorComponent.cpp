@@ -0,0 +1,180 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRStreamingPredictorComponent.h"
+
+#include "DrawDebugHelpers.h"
+#include "VR_Lab.h"
+#include "VRHitchCapture.h"
+#include "VRTeleportComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "WorldPartition/WorldPartitionSubsystem.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Streaming Prefetch Sources"), STAT_VRStreamingPrefetchSources, STATGROUP_VRLab);
+
+UVRStreamingPredictorComponent::UVRStreamingPredictorComponent()
+{
+    // Predict from the velocity movement has just produced this frame
+    PrimaryComponentTick.bCanEverTick = true;
+    PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+    // GetStreamingSources offers nothing while the component is inactive
+    bAutoActivate = true;
+}
+
+void UVRStreamingPredictorComponent::BeginPlay()
+{
+    Super::BeginPlay();
+
+    TeleportComponent = GetOwner()->FindComponentByClass<UVRTeleportComponent>();
+
+    // Names are handed out every time the streaming sources are gathered, so build them once
+    const FString OwnerName = GetOwner()->GetName();
+    for (int32 Sample = 0; Sample < PredictionSamples; ++Sample)
+    {
+        SourceNames.Add(FName(*FString::Printf(TEXT("%s_Prefetch%d"), *OwnerName, Sample)));
+    }
+    TeleportSourceName = FName(*FString::Printf(TEXT("%s_TeleportTarget"), *OwnerName));
+
+    // Only partitioned worlds have a subsystem to register with; anywhere else this component just does nothing
+    if (UWorldPartitionSubsystem* WorldPartitionSubsystem = GetWorld()->GetSubsystem<UWorldPartitionSubsystem>())
+    {
+        WorldPartitionSubsystem->RegisterStreamingSourceProvider(this);
+        bRegistered = true;
+    }
+    else
+    {
+        SetComponentTickEnabled(false);
+    }
+}
+
+void UVRStreamingPredictorComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (bRegistered)
+    {
+        if (UWorldPartitionSubsystem* WorldPartitionSubsystem = GetWorld()->GetSubsystem<UWorldPartitionSubsystem>())
+        {
+            WorldPartitionSubsystem->UnregisterStreamingSourceProvider(this);
+        }
+        bRegistered = false;
+    }
+
+    Super::EndPlay(EndPlayReason);
+}
+
+void UVRStreamingPredictorComponent::TickComponent(float DeltaTime,
+                                                   ELevelTick TickType,
+                                                   FActorComponentTickFunction* ThisTickFunction)
+{
+    VRLAB_HITCH_SCOPE(StreamingPrediction);
+
+    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+    const APawn* Pawn = GetOwner<APawn>();
+    if (Pawn == nullptr || !Pawn->IsLocallyControlled())
+    {
+        PredictedPath.Reset();
+        bHasPreviousVelocityYaw = false;
+        return;
+    }
+
+    PredictPath(Pawn, DeltaTime);
+
+    if (bDrawPrediction)
+    {
+        FVector Previous = Pawn->GetActorLocation();
+        for (const FVector& Point : PredictedPath)
+        {
+            DrawDebugLine(GetWorld(), Previous, Point, FColor::Orange, false, -1.0f, 0, 2.0f);
+            DrawDebugSphere(GetWorld(), Point, 25.0f, 8, FColor::Orange);
+            Previous = Point;
+        }
+    }
+}
+
+void UVRStreamingPredictorComponent::PredictPath(const APawn* Pawn, const float DeltaTime)
+{
+    PredictedPath.Reset();
+
+    const FVector Velocity = Pawn->GetVelocity();
+    const float Speed = Velocity.Size2D();
+    if (Speed < MinPredictionSpeed)
+    {
+        bHasPreviousVelocityYaw = false;
+        SmoothedYawRate = 0.0f;
+        return;
+    }
+
+    const float VelocityYaw = FMath::RadiansToDegrees(FMath::Atan2(Velocity.Y, Velocity.X));
+    if (bHasPreviousVelocityYaw && DeltaTime > UE_KINDA_SMALL_NUMBER)
+    {
+        // A snap turn swings the heading in one frame; following it would throw the prediction off to the side
+        float YawRate = FMath::FindDeltaAngleDegrees(PreviousVelocityYaw, VelocityYaw) / DeltaTime;
+        if (FMath::Abs(YawRate) > MaxPredictedYawRate)
+        {
+            YawRate = 0.0f;
+        }
+        SmoothedYawRate = FMath::FInterpTo(SmoothedYawRate, YawRate, DeltaTime, YawRateSmoothing);
+    }
+    PreviousVelocityYaw = VelocityYaw;
+    bHasPreviousVelocityYaw = true;
+
+    // Walk the arc at constant speed and turn rate, turning half a step either side of each move
+    const int32 NumSamples = FMath::Min(PredictionSamples, SourceNames.Num());
+    const float StepTime = LookaheadTime / FMath::Max(NumSamples, 1);
+    FVector Location = Pawn->GetActorLocation();
+    float Yaw = VelocityYaw;
+    for (int32 Sample = 0; Sample < NumSamples; ++Sample)
+    {
+        Yaw += SmoothedYawRate * StepTime * 0.5f;
+        Location += FRotator(0.0f, Yaw, 0.0f).Vector() * Speed * StepTime;
+        Yaw += SmoothedYawRate * StepTime * 0.5f;
+        PredictedPath.Add(Location);
+    }
+}
+
+bool UVRStreamingPredictorComponent::GetStreamingSources(TArray<FWorldPartitionStreamingSource>& OutStreamingSources) const
+{
+    const APawn* Pawn = GetOwner<APawn>();
+    if (!IsActive() || Pawn == nullptr || !Pawn->IsLocallyControlled())
+    {
+        return false;
+    }
+
+    const int32 NumSourcesBefore = OutStreamingSources.Num();
+    const FRotator Rotation = Pawn->GetActorRotation();
+    for (int32 Index = 0; Index < PredictedPath.Num(); ++Index)
+    {
+        AddSource(OutStreamingSources, SourceNames[Index], PredictedPath[Index], Rotation, EStreamingSourcePriority::Low);
+    }
+
+    // A teleport covers the whole distance in one frame, so the target needs to be ready before the trigger is released
+    const UVRTeleportComponent* Teleport = TeleportComponent.Get();
+    if (bPrefetchTeleportTarget && Teleport != nullptr && Teleport->IsAiming() && Teleport->HasValidTarget())
+    {
+        AddSource(OutStreamingSources, TeleportSourceName, Teleport->GetTargetLocation(), Rotation, EStreamingSourcePriority::High);
+    }
+
+    const int32 NumSourcesAdded = OutStreamingSources.Num() - NumSourcesBefore;
+    SET_DWORD_STAT(STAT_VRStreamingPrefetchSources, NumSourcesAdded);
+    return NumSourcesAdded > 0;
+}
+
+void UVRStreamingPredictorComponent::AddSource(TArray<FWorldPartitionStreamingSource>& OutStreamingSources,
+                                               const FName Name,
+                                               const FVector& Location,
+                                               const FRotator& Rotation,
+                                               const EStreamingSourcePriority Priority) const
+{
+    FWorldPartitionStreamingSource& Source = OutStreamingSources.AddDefaulted_GetRef();
+    Source.Name = Name;
+    Source.Location = Location;
+    Source.Rotation = Rotation;
+    Source.TargetState = EStreamingSourceTargetState::Loaded;
+    Source.bBlockOnSlowLoading = false;
+    Source.Priority = Priority;
+
+    FStreamingSourceShape& Shape = Source.Shapes.AddDefaulted_GetRef();
+    Shape.bUseGridLoadingRange = true;
+    Shape.LoadingRangeScale = PrefetchLoadingRangeScale;
+}
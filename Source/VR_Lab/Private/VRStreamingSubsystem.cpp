@@ -0,0 +1,366 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRStreamingSubsystem.h"
+
+#include "VR_Lab.h"
+#include "VRHitchCapture.h"
+#include "VRStreamingPredictorComponent.h"
+#include "Algo/BinarySearch.h"
+#include "Engine/Level.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogVRStreaming);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Streaming Cells Added"), STAT_VRStreamingCellsAdded, STATGROUP_VRLab);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Streaming Cells Removed"), STAT_VRStreamingCellsRemoved, STATGROUP_VRLab);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Streaming Frame Cost (ms)"), STAT_VRStreamingFrameCost, STATGROUP_VRLab);
+
+static FAutoConsoleCommand StreamingFlyThroughCommand(
+    TEXT("VRLab.Streaming.FlyThrough"),
+    TEXT("Fly the local pawn through the map and report the worst streaming frames. Args: [speed cm/s] [seconds] [turn deg/s] [quit]"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        UVRStreamingSubsystem* StreamingSubsystem = World != nullptr ? World->GetSubsystem<UVRStreamingSubsystem>() : nullptr;
+        if (StreamingSubsystem == nullptr)
+        {
+            UE_LOG(LogVRStreaming, Error, TEXT("No streaming subsystem in this world"));
+            return;
+        }
+
+        // Default to AVRCharacter's sprint speed, the fastest anyone moves through the map on foot
+        const float Speed = Args.IsValidIndex(0) ? FCString::Atof(*Args[0]) : 670.6f;
+        const float Duration = Args.IsValidIndex(1) ? FCString::Atof(*Args[1]) : 60.0f;
+        const float TurnRate = Args.IsValidIndex(2) ? FCString::Atof(*Args[2]) : 0.0f;
+        const bool bQuit = Args.IsValidIndex(3) && Args[3].Equals(TEXT("quit"), ESearchCase::IgnoreCase);
+        StreamingSubsystem->StartFlyThrough(Speed, Duration, TurnRate, bQuit);
+    }));
+
+static FAutoConsoleCommand StreamingReportCommand(
+    TEXT("VRLab.Streaming.Report"),
+    TEXT("Log the most expensive World Partition streaming frames so far."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        if (const UVRStreamingSubsystem* StreamingSubsystem = World != nullptr ? World->GetSubsystem<UVRStreamingSubsystem>() : nullptr)
+        {
+            StreamingSubsystem->LogReport();
+        }
+    }));
+
+static FAutoConsoleCommand StreamingResetReportCommand(
+    TEXT("VRLab.Streaming.ResetReport"),
+    TEXT("Forget the streaming frames recorded so far."),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        if (UVRStreamingSubsystem* StreamingSubsystem = World != nullptr ? World->GetSubsystem<UVRStreamingSubsystem>() : nullptr)
+        {
+            StreamingSubsystem->ResetReport();
+        }
+    }));
+
+namespace VRStreaming
+{
+    // Weight of each new quiet frame in the running average streaming frames are compared against
+    constexpr float QuietFrameBlend = 0.05f;
+
+    void SetConsoleVariable(const TCHAR* Name, const float Value)
+    {
+        if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+        {
+            Variable->Set(Value, ECVF_SetByCode);
+        }
+        else
+            UE_LOG(LogVRStreaming, Warning, TEXT("Console variable %s not found"), Name);
+    }
+
+    void SetConsoleVariable(const TCHAR* Name, const int32 Value)
+    {
+        if (IConsoleVariable* Variable = IConsoleManager::Get().FindConsoleVariable(Name))
+        {
+            Variable->Set(Value, ECVF_SetByCode);
+        }
+        else
+            UE_LOG(LogVRStreaming, Warning, TEXT("Console variable %s not found"), Name);
+    }
+}
+
+void UVRStreamingSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    ApplyBudget();
+
+    LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UVRStreamingSubsystem::OnLevelAdded);
+    LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UVRStreamingSubsystem::OnLevelRemoved);
+}
+
+void UVRStreamingSubsystem::Deinitialize()
+{
+    FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+    FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+
+    if (StreamingFrameCount > 0)
+    {
+        LogReport();
+    }
+
+    Super::Deinitialize();
+}
+
+bool UVRStreamingSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+    return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId UVRStreamingSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UVRStreamingSubsystem, STATGROUP_Tickables);
+}
+
+void UVRStreamingSubsystem::ApplyBudget() const
+{
+    if (!bApplyBudget)
+    {
+        return;
+    }
+
+    VRStreaming::SetConsoleVariable(TEXT("s.LevelStreamingActorsUpdateTimeLimit"), ActorsUpdateBudgetMs);
+    VRStreaming::SetConsoleVariable(TEXT("s.PriorityLevelStreamingActorsUpdateExtraTime"), PriorityActorsUpdateExtraMs);
+    VRStreaming::SetConsoleVariable(TEXT("s.UnregisterComponentsTimeLimit"), UnregisterComponentsBudgetMs);
+    VRStreaming::SetConsoleVariable(TEXT("s.AsyncLoadingTimeLimit"), AsyncLoadingBudgetMs);
+    VRStreaming::SetConsoleVariable(TEXT("s.LevelStreamingComponentsRegistrationGranularity"), ComponentsRegistrationGranularity);
+    VRStreaming::SetConsoleVariable(TEXT("wp.Runtime.BlockOnSlowStreaming"), bBlockOnSlowStreaming ? 1 : 0);
+}
+
+void UVRStreamingSubsystem::OnLevelAdded(ULevel* Level, UWorld* World)
+{
+    if (World == GetWorld())
+    {
+        ++CellsAddedThisFrame;
+        FVRHitchCapture::RecordMarker(TEXT("StreamingCellAdded"));
+    }
+}
+
+void UVRStreamingSubsystem::OnLevelRemoved(ULevel* Level, UWorld* World)
+{
+    // A null level means the whole world is being torn down
+    if (Level != nullptr && World == GetWorld())
+    {
+        ++CellsRemovedThisFrame;
+        FVRHitchCapture::RecordMarker(TEXT("StreamingCellRemoved"));
+    }
+}
+
+void UVRStreamingSubsystem::Tick(float DeltaTime)
+{
+    VRLAB_HITCH_SCOPE(Streaming);
+
+    // Wall-clock time between ticks covers whichever part of the frame the streaming work landed in
+    const double NowSeconds = FPlatformTime::Seconds();
+    const float FrameMs = LastTickSeconds > 0.0 ? static_cast<float>((NowSeconds - LastTickSeconds) * 1000.0) : 0.0f;
+    LastTickSeconds = NowSeconds;
+
+    if (FrameMs > 0.0f)
+    {
+        if (CellsAddedThisFrame == 0 && CellsRemovedThisFrame == 0)
+        {
+            QuietFrameMs = QuietFrameMs > 0.0f ? FMath::Lerp(QuietFrameMs, FrameMs, VRStreaming::QuietFrameBlend) : FrameMs;
+            SET_FLOAT_STAT(STAT_VRStreamingFrameCost, 0.0f);
+        }
+        else
+        {
+            FVRStreamingFrame Frame;
+            Frame.FrameNumber = GFrameCounter;
+            Frame.FrameMs = FrameMs;
+            Frame.CostMs = FMath::Max(FrameMs - QuietFrameMs, 0.0f);
+            Frame.CellsAdded = CellsAddedThisFrame;
+            Frame.CellsRemoved = CellsRemovedThisFrame;
+            if (const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController())
+            {
+                if (const APawn* Pawn = PlayerController->GetPawn())
+                {
+                    Frame.PawnLocation = Pawn->GetActorLocation();
+                    Frame.PawnSpeed = Pawn->GetVelocity().Size2D();
+                }
+            }
+            RecordStreamingFrame(Frame);
+            SET_FLOAT_STAT(STAT_VRStreamingFrameCost, Frame.CostMs);
+        }
+    }
+
+    SET_DWORD_STAT(STAT_VRStreamingCellsAdded, CellsAddedThisFrame);
+    SET_DWORD_STAT(STAT_VRStreamingCellsRemoved, CellsRemovedThisFrame);
+    CellsAddedThisFrame = 0;
+    CellsRemovedThisFrame = 0;
+
+    if (IsFlyingThrough())
+    {
+        UpdateFlyThrough(DeltaTime);
+    }
+}
+
+void UVRStreamingSubsystem::RecordStreamingFrame(const FVRStreamingFrame& Frame)
+{
+    ++StreamingFrameCount;
+    if (Frame.CostMs > HitchThresholdMs)
+    {
+        UE_LOG(LogVRStreaming,
+               Warning,
+               TEXT("Streaming hitch: %.2f ms over a %.2f ms frame, %d cells added, %d removed"),
+               Frame.CostMs,
+               Frame.FrameMs,
+               Frame.CellsAdded,
+               Frame.CellsRemoved);
+    }
+
+    // Keep the list sorted with the most expensive frame first
+    const int32 Index = Algo::LowerBound(WorstFrames,
+                                         Frame,
+                                         [](const FVRStreamingFrame& A, const FVRStreamingFrame& B)
+                                         {
+                                             return A.CostMs > B.CostMs;
+                                         });
+    if (Index < ReportFrameCount)
+    {
+        WorstFrames.Insert(Frame, Index);
+        if (WorstFrames.Num() > ReportFrameCount)
+        {
+            WorstFrames.Pop(EAllowShrinking::No);
+        }
+    }
+}
+
+void UVRStreamingSubsystem::LogReport() const
+{
+    UE_LOG(LogVRStreaming,
+           Display,
+           TEXT("%d streaming frames against a %.2f ms quiet frame, budget %.1f ms actors / %.1f ms async loading"),
+           StreamingFrameCount,
+           QuietFrameMs,
+           ActorsUpdateBudgetMs,
+           AsyncLoadingBudgetMs);
+
+    for (const FVRStreamingFrame& Frame : WorstFrames)
+    {
+        UE_LOG(LogVRStreaming,
+               Display,
+               TEXT("  frame %llu: +%.2f ms (%.2f ms total), %d added, %d removed, pawn at %s moving %.0f cm/s"),
+               Frame.FrameNumber,
+               Frame.CostMs,
+               Frame.FrameMs,
+               Frame.CellsAdded,
+               Frame.CellsRemoved,
+               *Frame.PawnLocation.ToCompactString(),
+               Frame.PawnSpeed);
+    }
+}
+
+void UVRStreamingSubsystem::ResetReport()
+{
+    WorstFrames.Reset();
+    StreamingFrameCount = 0;
+}
+
+void UVRStreamingSubsystem::StartFlyThrough(const float Speed, const float Duration, const float TurnRate, const bool bQuitWhenDone)
+{
+    const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+    const ACharacter* Character = PlayerController != nullptr ? PlayerController->GetPawn<ACharacter>() : nullptr;
+    if (Character == nullptr)
+    {
+        UE_LOG(LogVRStreaming, Error, TEXT("Fly-through needs a locally controlled character"));
+        return;
+    }
+
+    ResetReport();
+    FlyThroughSpeed = Speed;
+    FlyThroughTurnRate = TurnRate;
+    FlyThroughTimeRemaining = Duration;
+    bQuitAfterFlyThrough = bQuitWhenDone;
+    FlyThroughFrames = 0;
+    FlyThroughPrefetchFrames = 0;
+    FlyThroughMaxPrefetchSources = 0;
+
+    const UVRStreamingPredictorComponent* Predictor = Character->FindComponentByClass<UVRStreamingPredictorComponent>();
+    if (Predictor == nullptr || !Predictor->IsRegisteredWithWorldPartition() || !Predictor->IsActive())
+    {
+        UE_LOG(LogVRStreaming,
+               Warning,
+               TEXT("%s has no active streaming predictor registered with World Partition, nothing will be prefetched"),
+               *Character->GetName());
+    }
+
+    // Movement is driven directly from here; the movement component only reports the velocity
+    Character->GetCharacterMovement()->DisableMovement();
+    UE_LOG(LogVRStreaming, Display, TEXT("Flying through at %.0f cm/s for %.0f s"), Speed, Duration);
+}
+
+void UVRStreamingSubsystem::UpdateFlyThrough(const float DeltaTime)
+{
+    APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+    ACharacter* Character = PlayerController != nullptr ? PlayerController->GetPawn<ACharacter>() : nullptr;
+    if (Character == nullptr)
+    {
+        FinishFlyThrough();
+        return;
+    }
+
+    const FRotator Rotation = Character->GetActorRotation() + FRotator(0.0f, FlyThroughTurnRate * DeltaTime, 0.0f);
+    const FVector Velocity = Rotation.Vector().GetSafeNormal2D() * FlyThroughSpeed;
+    Character->SetActorLocationAndRotation(Character->GetActorLocation() + Velocity * DeltaTime,
+                                           Rotation,
+                                           false,
+                                           nullptr,
+                                           ETeleportType::TeleportPhysics);
+
+    // The streaming predictor reads the pawn's velocity, so report the speed we are flying at
+    Character->GetCharacterMovement()->Velocity = Velocity;
+
+    // Keep the controller in step, otherwise characters that follow the control rotation turn straight back
+    PlayerController->SetControlRotation(FRotator(PlayerController->GetControlRotation().Pitch, Rotation.Yaw, 0.0f));
+
+    // Ask the predictor the same way World Partition does, to show its sources actually reach the streaming update
+    ++FlyThroughFrames;
+    if (const UVRStreamingPredictorComponent* Predictor = Character->FindComponentByClass<UVRStreamingPredictorComponent>())
+    {
+        FlyThroughPrefetchSources.Reset();
+        if (Predictor->IsRegisteredWithWorldPartition() && Predictor->GetStreamingSources(FlyThroughPrefetchSources))
+        {
+            ++FlyThroughPrefetchFrames;
+            FlyThroughMaxPrefetchSources = FMath::Max(FlyThroughMaxPrefetchSources, FlyThroughPrefetchSources.Num());
+        }
+    }
+
+    FlyThroughTimeRemaining -= DeltaTime;
+    if (FlyThroughTimeRemaining <= 0.0f)
+    {
+        FinishFlyThrough();
+    }
+}
+
+void UVRStreamingSubsystem::FinishFlyThrough()
+{
+    FlyThroughTimeRemaining = 0.0f;
+
+    const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+    if (ACharacter* Character = PlayerController != nullptr ? PlayerController->GetPawn<ACharacter>() : nullptr)
+    {
+        Character->GetCharacterMovement()->Velocity = FVector::ZeroVector;
+        Character->GetCharacterMovement()->SetDefaultMovementMode();
+    }
+
+    LogReport();
+    UE_LOG(LogVRStreaming,
+           Display,
+           TEXT("Prefetch sources offered on %d of %d fly-through frames, up to %d at once"),
+           FlyThroughPrefetchFrames,
+           FlyThroughFrames,
+           FlyThroughMaxPrefetchSources);
+
+    if (bQuitAfterFlyThrough)
+    {
+        FPlatformMisc::RequestExit(false);
+    }
+}
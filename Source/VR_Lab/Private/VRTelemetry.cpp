@@ -0,0 +1,491 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRTelemetry.h"
+
+#include <atomic>
+
+#include "HAL/Event.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+DEFINE_LOG_CATEGORY(LogVRTelemetry);
+
+static TAutoConsoleVariable<bool> CVarTelemetryEnable(
+    TEXT("VRLab.Telemetry.Enable"),
+    false,
+    TEXT("Write binary telemetry to Saved/Telemetry. Read once at startup; -VRTelemetry on the command line also enables it."),
+    ECVF_ReadOnly);
+
+static TAutoConsoleVariable<int32> CVarTelemetryMaxFiles(
+    TEXT("VRLab.Telemetry.MaxFiles"),
+    10,
+    TEXT("The most telemetry files kept in Saved/Telemetry. The oldest are deleted at startup to make room for the new one."),
+    ECVF_ReadOnly);
+
+static TAutoConsoleVariable<float> CVarTelemetryFlushInterval(
+    TEXT("VRLab.Telemetry.FlushInterval"),
+    0.25f,
+    TEXT("Seconds between telemetry writer flushes."));
+
+namespace VRTelemetry
+{
+    enum class EChunk : uint8
+    {
+        Records = 1,
+        Name = 2,
+    };
+
+    constexpr uint32 RingCapacity = 2048;
+    constexpr uint32 RingMask = RingCapacity - 1;
+    static_assert((RingCapacity & RingMask) == 0, "RingCapacity must be a power of two");
+
+    /** Single-producer, single-consumer ring. The owning thread pushes, the writer thread drains. */
+    class FRing
+    {
+    public:
+        void Push(const FVRTelemetryRecord& Record)
+        {
+            const uint32 WriteIndex = Head.load(std::memory_order_relaxed);
+            if (WriteIndex - Tail.load(std::memory_order_acquire) >= RingCapacity)
+            {
+                Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            Records[WriteIndex & RingMask] = Record;
+            Head.store(WriteIndex + 1, std::memory_order_release);
+        }
+
+        void Drain(TArray<FVRTelemetryRecord>& OutRecords)
+        {
+            const uint32 ReadIndex = Tail.load(std::memory_order_relaxed);
+            const uint32 WriteIndex = Head.load(std::memory_order_acquire);
+            for (uint32 Index = ReadIndex; Index != WriteIndex; ++Index)
+            {
+                OutRecords.Add(Records[Index & RingMask]);
+            }
+            Tail.store(WriteIndex, std::memory_order_release);
+        }
+
+        uint32 TakeDropped()
+        {
+            return Dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+    private:
+        FVRTelemetryRecord Records[RingCapacity];
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> Head{0};
+        alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> Tail{0};
+        std::atomic<uint32> Dropped{0};
+    };
+
+    template <typename T>
+    void Append(TArray<uint8>& Buffer, const T& Value)
+    {
+        Buffer.Append(reinterpret_cast<const uint8*>(&Value), sizeof(T));
+    }
+
+    template <typename T>
+    bool Read(const TArray<uint8>& Buffer, int32& Offset, T& OutValue)
+    {
+        if (Offset + static_cast<int32>(sizeof(T)) > Buffer.Num())
+        {
+            return false;
+        }
+        FMemory::Memcpy(&OutValue, Buffer.GetData() + Offset, sizeof(T));
+        Offset += sizeof(T);
+        return true;
+    }
+
+    /** Drains every ring on a background thread and appends the records to the telemetry file */
+    class FWriter : public FRunnable
+    {
+    public:
+        explicit FWriter(FArchive* InFile)
+            : File(InFile), WakeEvent(FPlatformProcess::GetSynchEventFromPool())
+        {
+            Buffer.Reserve(64 * 1024);
+            Append(Buffer, FVRTelemetry::FileMagic);
+            Append(Buffer, FVRTelemetry::FileVersion);
+            Append(Buffer, FPlatformTime::GetSecondsPerCycle64());
+            Append(Buffer, FPlatformTime::Cycles64());
+            WriteBuffer();
+        }
+
+        virtual ~FWriter() override
+        {
+            FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+        }
+
+        FRing* CreateRing()
+        {
+            FScopeLock Lock(&RingsLock);
+            return Rings.Add_GetRef(MakeUnique<FRing>()).Get();
+        }
+
+        virtual uint32 Run() override
+        {
+            while (!bStopping.load())
+            {
+                WakeEvent->Wait(FTimespan::FromSeconds(FMath::Max(CVarTelemetryFlushInterval.GetValueOnAnyThread(), 0.01f)));
+                Flush();
+            }
+            Flush();
+            return 0;
+        }
+
+        virtual void Stop() override
+        {
+            bStopping = true;
+            WakeEvent->Trigger();
+        }
+
+    private:
+        void Flush()
+        {
+            Scratch.Reset();
+            uint32 Dropped = 0;
+            {
+                FScopeLock Lock(&RingsLock);
+                for (const TUniquePtr<FRing>& Ring : Rings)
+                {
+                    Ring->Drain(Scratch);
+                    Dropped += Ring->TakeDropped();
+                }
+            }
+
+            if (Dropped > 0)
+            {
+                UE_LOG(LogVRTelemetry, Warning, TEXT("Dropped %u telemetry events, a ring buffer was full"), Dropped);
+            }
+
+            if (Scratch.IsEmpty())
+            {
+                return;
+            }
+
+            // Names are written once, the first time a record refers to them
+            for (const FVRTelemetryRecord& Record : Scratch)
+            {
+                bool bAlreadyWritten = false;
+                WrittenNames.Add(Record.NameId, &bAlreadyWritten);
+                if (Record.NameId == 0 || bAlreadyWritten)
+                {
+                    continue;
+                }
+
+                const FString Name = FName::CreateFromDisplayId(FNameEntryId::FromUnstableInt(Record.NameId), NAME_NO_NUMBER_INTERNAL).ToString();
+                const FTCHARToUTF8 Utf8Name(*Name);
+                Append(Buffer, EChunk::Name);
+                Append(Buffer, Record.NameId);
+                Append(Buffer, static_cast<uint32>(Utf8Name.Length()));
+                Buffer.Append(reinterpret_cast<const uint8*>(Utf8Name.Get()), Utf8Name.Length());
+            }
+
+            Append(Buffer, EChunk::Records);
+            Append(Buffer, static_cast<uint32>(Scratch.Num()));
+            Buffer.Append(reinterpret_cast<const uint8*>(Scratch.GetData()), Scratch.Num() * sizeof(FVRTelemetryRecord));
+            WriteBuffer();
+        }
+
+        void WriteBuffer()
+        {
+            File->Serialize(Buffer.GetData(), Buffer.Num());
+            File->Flush();
+            Buffer.Reset();
+        }
+
+        TUniquePtr<FArchive> File;
+        FEvent* WakeEvent;
+        std::atomic<bool> bStopping{false};
+
+        FCriticalSection RingsLock;
+        TArray<TUniquePtr<FRing>> Rings;
+
+        TArray<FVRTelemetryRecord> Scratch;
+        TArray<uint8> Buffer;
+        TSet<uint32> WrittenNames;
+    };
+
+    FWriter* Writer = nullptr;
+    FRunnableThread* WriterThread = nullptr;
+
+    /** Bumped on every startup so threads notice that their ring belongs to a previous writer */
+    std::atomic<uint32> Generation{0};
+    std::atomic<bool> bEnabled{false};
+
+    /** Threads between checking bEnabled and finishing their push. Shutdown waits for this to drain. */
+    std::atomic<int32> ActiveProducers{0};
+
+    /**
+     * Marks the calling thread as pushing to the writer for its lifetime.
+     *
+     * The counter goes up before bEnabled is checked and Shutdown clears bEnabled before waiting on the counter, so
+     * either Shutdown sees the producer or the producer sees telemetry disabled. The writer can't be deleted mid-push.
+     */
+    class FProducerScope
+    {
+    public:
+        FProducerScope()
+        {
+            ActiveProducers.fetch_add(1);
+            bActive = bEnabled.load();
+        }
+
+        ~FProducerScope()
+        {
+            ActiveProducers.fetch_sub(1);
+        }
+
+        bool IsActive() const { return bActive; }
+
+    private:
+        bool bActive;
+    };
+
+    /** Delete the oldest telemetry files so that, with the one about to be written, at most MaxFiles remain */
+    void DeleteOldFiles(const FString& Directory, const int32 MaxFiles)
+    {
+        TArray<FString> FileNames;
+        IFileManager::Get().FindFiles(FileNames, *(Directory / TEXT("*.vrtl")), true, false);
+        if (MaxFiles <= 0 || FileNames.Num() < MaxFiles)
+        {
+            return;
+        }
+
+        // The names carry the start time in a sortable form
+        FileNames.Sort();
+        for (int32 Index = 0; Index <= FileNames.Num() - MaxFiles; ++Index)
+        {
+            IFileManager::Get().Delete(*(Directory / FileNames[Index]));
+        }
+    }
+
+    thread_local FRing* ThreadRing = nullptr;
+    thread_local uint32 ThreadRingGeneration = 0;
+
+}
+
+const TCHAR* LexToString(const EVRTelemetryEvent Event)
+{
+    switch (Event)
+    {
+        case EVRTelemetryEvent::PoseChanged:
+            return TEXT("PoseChanged");
+        case EVRTelemetryEvent::Jump:
+            return TEXT("Jump");
+        case EVRTelemetryEvent::PerspectiveToggled:
+            return TEXT("PerspectiveToggled");
+        case EVRTelemetryEvent::HMDActivated:
+            return TEXT("HMDActivated");
+        case EVRTelemetryEvent::MotionSource:
+            return TEXT("MotionSource");
+        case EVRTelemetryEvent::ControllerDevice:
+            return TEXT("ControllerDevice");
+        case EVRTelemetryEvent::QualityTierChanged:
+            return TEXT("QualityTierChanged");
+        case EVRTelemetryEvent::BoundaryWarning:
+            return TEXT("BoundaryWarning");
+        default:
+            return TEXT("None");
+    }
+}
+
+void FVRTelemetry::Startup()
+{
+    const bool bRequested = CVarTelemetryEnable.GetValueOnGameThread() || FParse::Param(FCommandLine::Get(), TEXT("VRTelemetry"));
+    if (VRTelemetry::Writer != nullptr || !bRequested || IsRunningCommandlet())
+    {
+        return;
+    }
+
+    const FString Directory = FPaths::ProjectSavedDir() / TEXT("Telemetry");
+    VRTelemetry::DeleteOldFiles(Directory, CVarTelemetryMaxFiles.GetValueOnGameThread());
+
+    const FString FileName = Directory / FString::Printf(TEXT("VRLab-%s.vrtl"), *FDateTime::Now().ToString());
+    FArchive* File = IFileManager::Get().CreateFileWriter(*FileName, FILEWRITE_AllowRead);
+    if (File == nullptr)
+    {
+        UE_LOG(LogVRTelemetry, Warning, TEXT("Unable to open %s, telemetry is disabled"), *FileName);
+        return;
+    }
+
+    VRTelemetry::Writer = new VRTelemetry::FWriter(File);
+    VRTelemetry::WriterThread = FRunnableThread::Create(VRTelemetry::Writer, TEXT("VRTelemetryWriter"), 0, TPri_BelowNormal);
+    ++VRTelemetry::Generation;
+    VRTelemetry::bEnabled = true;
+    UE_LOG(LogVRTelemetry, Log, TEXT("Writing telemetry to %s"), *FileName);
+}
+
+void FVRTelemetry::Shutdown()
+{
+    if (VRTelemetry::Writer == nullptr)
+    {
+        return;
+    }
+
+    // Turn new events away, then let the ones already past the check finish with the writer
+    VRTelemetry::bEnabled = false;
+    while (VRTelemetry::ActiveProducers.load() > 0)
+    {
+        FPlatformProcess::Yield();
+    }
+
+    if (VRTelemetry::WriterThread != nullptr)
+    {
+        VRTelemetry::WriterThread->Kill(true);
+        delete VRTelemetry::WriterThread;
+        VRTelemetry::WriterThread = nullptr;
+    }
+    delete VRTelemetry::Writer;
+    VRTelemetry::Writer = nullptr;
+}
+
+bool FVRTelemetry::IsEnabled()
+{
+    return VRTelemetry::bEnabled.load(std::memory_order_relaxed);
+}
+
+void FVRTelemetry::Record(const EVRTelemetryEvent Event, const uint32 ObjectId, const int32 Data0, const int32 Data1)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    const VRTelemetry::FProducerScope Producer;
+    if (!Producer.IsActive())
+    {
+        return;
+    }
+
+    FVRTelemetryRecord Entry;
+    Entry.Cycles = FPlatformTime::Cycles64();
+    Entry.ObjectId = ObjectId;
+    Entry.Event = Event;
+    Entry.Data[0] = Data0;
+    Entry.Data[1] = Data1;
+    Push(Entry);
+}
+
+void FVRTelemetry::RecordName(const EVRTelemetryEvent Event, const uint32 ObjectId, const FName Name, const int32 Data0)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    const VRTelemetry::FProducerScope Producer;
+    if (!Producer.IsActive())
+    {
+        return;
+    }
+
+    FVRTelemetryRecord Entry;
+    Entry.Cycles = FPlatformTime::Cycles64();
+    Entry.ObjectId = ObjectId;
+    Entry.Event = Event;
+    Entry.NameId = Name.GetDisplayIndex().ToUnstableInt();
+    Entry.NameNumber = Name.GetNumber();
+    Entry.Data[0] = Data0;
+    Push(Entry);
+}
+
+void FVRTelemetry::Push(const FVRTelemetryRecord& Record)
+{
+    const uint32 CurrentGeneration = VRTelemetry::Generation.load(std::memory_order_relaxed);
+    if (VRTelemetry::ThreadRing == nullptr || VRTelemetry::ThreadRingGeneration != CurrentGeneration)
+    {
+        // First event on this thread since the writer started; registering takes a lock once
+        VRTelemetry::ThreadRing = VRTelemetry::Writer->CreateRing();
+        VRTelemetry::ThreadRingGeneration = CurrentGeneration;
+    }
+    VRTelemetry::ThreadRing->Push(Record);
+}
+
+bool FVRTelemetry::DecodeToCsv(const TArray<uint8>& FileData, FString& OutCsv)
+{
+    int32 Offset = 0;
+    uint32 Magic = 0;
+    uint32 Version = 0;
+    double SecondsPerCycle = 0.0;
+    uint64 StartCycles = 0;
+    if (!VRTelemetry::Read(FileData, Offset, Magic) || Magic != FileMagic ||
+        !VRTelemetry::Read(FileData, Offset, Version) || Version != FileVersion ||
+        !VRTelemetry::Read(FileData, Offset, SecondsPerCycle) ||
+        !VRTelemetry::Read(FileData, Offset, StartCycles))
+    {
+        return false;
+    }
+
+    TMap<uint32, FString> Names;
+    TArray<FVRTelemetryRecord> Records;
+    VRTelemetry::EChunk Chunk;
+    while (VRTelemetry::Read(FileData, Offset, Chunk))
+    {
+        uint32 Count = 0;
+        if (Chunk == VRTelemetry::EChunk::Name)
+        {
+            uint32 NameId = 0;
+            if (!VRTelemetry::Read(FileData, Offset, NameId) || !VRTelemetry::Read(FileData, Offset, Count) ||
+                Offset + static_cast<int32>(Count) > FileData.Num())
+            {
+                break;
+            }
+            const FUTF8ToTCHAR Name(reinterpret_cast<const ANSICHAR*>(FileData.GetData() + Offset), Count);
+            Names.Add(NameId, FString(Name.Length(), Name.Get()));
+            Offset += Count;
+        }
+        else if (Chunk == VRTelemetry::EChunk::Records)
+        {
+            // A truncated final chunk just means the process died mid-write; keep what's complete
+            if (!VRTelemetry::Read(FileData, Offset, Count))
+            {
+                break;
+            }
+            const int32 Available = (FileData.Num() - Offset) / sizeof(FVRTelemetryRecord);
+            const int32 NumRecords = FMath::Min(static_cast<int32>(Count), Available);
+            const int32 First = Records.AddUninitialized(NumRecords);
+            FMemory::Memcpy(&Records[First], FileData.GetData() + Offset, NumRecords * sizeof(FVRTelemetryRecord));
+            Offset += NumRecords * sizeof(FVRTelemetryRecord);
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    // Each thread has its own ring, so records only come out of the file in order per thread
+    Records.StableSort([](const FVRTelemetryRecord& A, const FVRTelemetryRecord& B)
+    {
+        return A.Cycles < B.Cycles;
+    });
+
+    OutCsv = TEXT("Seconds,Event,ObjectId,Name,Data0,Data1\n");
+    for (const FVRTelemetryRecord& Record : Records)
+    {
+        FString Name;
+        if (const FString* Found = Names.Find(Record.NameId))
+        {
+            Name = Record.NameNumber != NAME_NO_NUMBER_INTERNAL
+                       ? FString::Printf(TEXT("%s_%d"), **Found, NAME_INTERNAL_TO_EXTERNAL(Record.NameNumber))
+                       : *Found;
+        }
+
+        OutCsv += FString::Printf(TEXT("%.6f,%s,%u,%s,%d,%d\n"),
+                                  (static_cast<int64>(Record.Cycles) - static_cast<int64>(StartCycles)) * SecondsPerCycle,
+                                  LexToString(Record.Event),
+                                  Record.ObjectId,
+                                  *Name,
+                                  Record.Data[0],
+                                  Record.Data[1]);
+    }
+    return true;
+}
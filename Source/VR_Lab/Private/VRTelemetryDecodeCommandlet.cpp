@@ -0,0 +1,46 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRTelemetryDecodeCommandlet.h"
+
+#include "VRTelemetry.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+int32 UVRTelemetryDecodeCommandlet::Main(const FString& Params)
+{
+    FString InputFile;
+    if (!FParse::Value(*Params, TEXT("In="), InputFile))
+    {
+        UE_LOG(LogVRTelemetry, Error, TEXT("Missing -In=<telemetry file>"));
+        return 1;
+    }
+
+    FString OutputFile;
+    if (!FParse::Value(*Params, TEXT("Out="), OutputFile))
+    {
+        OutputFile = FPaths::ChangeExtension(InputFile, TEXT("csv"));
+    }
+
+    TArray<uint8> FileData;
+    if (!FFileHelper::LoadFileToArray(FileData, *InputFile))
+    {
+        UE_LOG(LogVRTelemetry, Error, TEXT("Unable to read %s"), *InputFile);
+        return 1;
+    }
+
+    FString Csv;
+    if (!FVRTelemetry::DecodeToCsv(FileData, Csv))
+    {
+        UE_LOG(LogVRTelemetry, Error, TEXT("%s is not a VR_Lab telemetry file"), *InputFile);
+        return 1;
+    }
+
+    if (!FFileHelper::SaveStringToFile(Csv, *OutputFile))
+    {
+        UE_LOG(LogVRTelemetry, Error, TEXT("Unable to write %s"), *OutputFile);
+        return 1;
+    }
+
+    UE_LOG(LogVRTelemetry, Display, TEXT("Decoded %s to %s"), *InputFile, *OutputFile);
+    return 0;
+}
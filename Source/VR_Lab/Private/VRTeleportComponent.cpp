@@ -0,0 +1,244 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#include "VRTeleportComponent.h"
+
+#include "DrawDebugHelpers.h"
+#include "NavigationSystem.h"
+#include "VR_Lab.h"
+#include "Engine/World.h"
+
+DEFINE_LOG_CATEGORY(LogVRTeleport);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Teleport Arc Sweeps"), STAT_VRTeleportArcSweeps, STATGROUP_VRLab);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Teleport Nav Projections"), STAT_VRTeleportNavProjections, STATGROUP_VRLab);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Teleport Aim To Target (ms)"), STAT_VRTeleportAimToTarget, STATGROUP_VRLab);
+
+namespace VRTeleport
+{
+    // UserData packs the batch id above the segment index so late results from an old batch can be discarded
+    constexpr uint32 SegmentBits = 8;
+    constexpr uint32 SegmentMask = (1u << SegmentBits) - 1;
+}
+
+UVRTeleportComponent::UVRTeleportComponent()
+{
+    // Only tick while aiming
+    PrimaryComponentTick.bCanEverTick = true;
+    PrimaryComponentTick.bStartWithTickEnabled = false;
+
+    ArcTraceDelegate.BindUObject(this, &UVRTeleportComponent::OnArcSegmentTraced);
+}
+
+void UVRTeleportComponent::BeginAim(USceneComponent* InAimSource)
+{
+    if (InAimSource == nullptr)
+    {
+        return;
+    }
+
+    AimSource = InAimSource;
+    bHasIssuedBatch = false;
+    bHasValidTarget = false;
+    bAimLatencyRecorded = false;
+    AimStartTime = FPlatformTime::Seconds();
+    SetComponentTickEnabled(true);
+}
+
+bool UVRTeleportComponent::EndAim(FVector& OutTargetLocation)
+{
+    const bool bValid = IsAiming() && bHasValidTarget;
+    OutTargetLocation = TargetLocation;
+    CancelAim();
+    return bValid;
+}
+
+void UVRTeleportComponent::CancelAim()
+{
+    AimSource.Reset();
+    bHasValidTarget = false;
+    bBatchInFlight = false;
+    ArcPoints.Reset();
+    SetComponentTickEnabled(false);
+}
+
+void UVRTeleportComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+    const USceneComponent* Source = AimSource.Get();
+    if (Source == nullptr)
+    {
+        CancelAim();
+        return;
+    }
+
+    // Never wait on a batch; the next one is only issued once the previous one has come back
+    if (!bBatchInFlight)
+    {
+        const FVector Origin = Source->GetComponentLocation();
+        const FVector Direction = Source->GetForwardVector();
+        const bool bAimMoved = !bHasIssuedBatch ||
+                               FVector::DistSquared(Origin, LastAimOrigin) > FMath::Square(AimLocationTolerance) ||
+                               FVector::DotProduct(Direction, LastAimDirection) <
+                               FMath::Cos(FMath::DegreesToRadians(AimAngleTolerance));
+        if (bAimMoved)
+        {
+            IssueArcBatch(Origin, Direction);
+        }
+    }
+
+    if (bDrawArc)
+    {
+        DrawArc();
+    }
+}
+
+void UVRTeleportComponent::IssueArcBatch(const FVector& Origin, const FVector& Direction)
+{
+    UWorld* World = GetWorld();
+    if (World == nullptr)
+    {
+        return;
+    }
+
+    LastAimOrigin = Origin;
+    LastAimDirection = Direction;
+    bHasIssuedBatch = true;
+
+    const int32 NumSegments = FMath::Clamp(ArcSegments, 2, static_cast<int32>(VRTeleport::SegmentMask));
+    const FVector LaunchVelocity = Direction * ArcLaunchSpeed;
+    const FVector Gravity(0.0f, 0.0f, World->GetGravityZ());
+
+    ArcPoints.SetNum(NumSegments + 1, EAllowShrinking::No);
+    for (int32 Index = 0; Index <= NumSegments; ++Index)
+    {
+        const float Time = Index * ArcSegmentTime;
+        ArcPoints[Index] = Origin + LaunchVelocity * Time + 0.5f * Gravity * Time * Time;
+    }
+
+    SegmentResults.Reset();
+    SegmentResults.SetNum(NumSegments);
+
+    BatchId = (BatchId + 1) & (MAX_uint32 >> VRTeleport::SegmentBits);
+    PendingSegments = NumSegments;
+    bBatchInFlight = true;
+
+    FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(VRTeleportArc), false, GetOwner());
+    const FCollisionShape SweepShape = FCollisionShape::MakeSphere(ArcSweepRadius);
+    for (int32 Index = 0; Index < NumSegments; ++Index)
+    {
+        World->AsyncSweepByChannel(EAsyncTraceType::Single,
+                                   ArcPoints[Index],
+                                   ArcPoints[Index + 1],
+                                   FQuat::Identity,
+                                   ArcTraceChannel,
+                                   SweepShape,
+                                   QueryParams,
+                                   FCollisionResponseParams::DefaultResponseParam,
+                                   &ArcTraceDelegate,
+                                   BatchId << VRTeleport::SegmentBits | static_cast<uint32>(Index));
+    }
+
+    TracesIssued += NumSegments;
+    INC_DWORD_STAT_BY(STAT_VRTeleportArcSweeps, NumSegments);
+}
+
+void UVRTeleportComponent::OnArcSegmentTraced(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
+{
+    const uint32 SegmentIndex = TraceDatum.UserData & VRTeleport::SegmentMask;
+    if (!bBatchInFlight || TraceDatum.UserData >> VRTeleport::SegmentBits != BatchId ||
+        !SegmentResults.IsValidIndex(SegmentIndex))
+    {
+        return;
+    }
+
+    FArcSegmentResult& Result = SegmentResults[SegmentIndex];
+    if (Result.bReceived)
+    {
+        return;
+    }
+
+    Result.bReceived = true;
+    if (TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit)
+    {
+        Result.bBlockingHit = true;
+        Result.ImpactPoint = TraceDatum.OutHits[0].ImpactPoint;
+        Result.ImpactNormal = TraceDatum.OutHits[0].ImpactNormal;
+    }
+
+    if (--PendingSegments == 0)
+    {
+        bBatchInFlight = false;
+        ResolveArcBatch();
+    }
+}
+
+void UVRTeleportComponent::ResolveArcBatch()
+{
+    // The arc stops at the first segment that hits anything, whether or not it is a valid landing spot
+    const FArcSegmentResult* FirstHit = SegmentResults.FindByPredicate([](const FArcSegmentResult& Result)
+    {
+        return Result.bBlockingHit;
+    });
+
+    FVector NavLocation;
+    bHasValidTarget = FirstHit != nullptr &&
+                      FirstHit->ImpactNormal.Z >= MinLandingNormalZ &&
+                      ProjectToNavigation(FirstHit->ImpactPoint, NavLocation);
+    if (!bHasValidTarget)
+    {
+        return;
+    }
+
+    TargetLocation = NavLocation;
+    if (!bAimLatencyRecorded)
+    {
+        bAimLatencyRecorded = true;
+        LastAimToTargetLatency = static_cast<float>(FPlatformTime::Seconds() - AimStartTime);
+        SET_FLOAT_STAT(STAT_VRTeleportAimToTarget, LastAimToTargetLatency * 1000.0f);
+        UE_LOG(LogVRTeleport, Verbose, TEXT("Aim to valid target took %.2f ms"), LastAimToTargetLatency * 1000.0f);
+    }
+}
+
+bool UVRTeleportComponent::ProjectToNavigation(const FVector& Point, FVector& OutLocation)
+{
+    if (bHasNavProjection &&
+        FVector::DistSquared(Point, LastNavQueryPoint) <= FMath::Square(NavProjectionCacheTolerance))
+    {
+        OutLocation = LastNavProjection;
+        return bLastNavProjectionValid;
+    }
+
+    const UNavigationSystemV1* NavigationSystem = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+    if (NavigationSystem == nullptr)
+    {
+        return false;
+    }
+
+    FNavLocation NavLocation;
+    bLastNavProjectionValid = NavigationSystem->ProjectPointToNavigation(Point, NavLocation, NavProjectionExtent);
+    LastNavQueryPoint = Point;
+    LastNavProjection = NavLocation.Location;
+    bHasNavProjection = true;
+    INC_DWORD_STAT(STAT_VRTeleportNavProjections);
+
+    OutLocation = LastNavProjection;
+    return bLastNavProjectionValid;
+}
+
+void UVRTeleportComponent::DrawArc() const
+{
+#if ENABLE_DRAW_DEBUG
+    const UWorld* World = GetWorld();
+    const FColor ArcColor = bHasValidTarget ? FColor::Cyan : FColor::Red;
+    for (int32 Index = 1; Index < ArcPoints.Num(); ++Index)
+    {
+        DrawDebugLine(World, ArcPoints[Index - 1], ArcPoints[Index], ArcColor, false, -1.0f, 0, 1.0f);
+    }
+
+    if (bHasValidTarget)
+    {
+        DrawDebugCylinder(World, TargetLocation, TargetLocation + FVector(0.0f, 0.0f, 2.0f), 30.0f, 16, ArcColor);
+    }
+#endif
+}
@@ -3,18 +3,27 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "VRCharacterModes.h"
 #include "GameFramework/Character.h"
 #include "Logging/LogMacros.h"
 #include "DesktopCharacter.generated.h"
 
-class USpringArmComponent;
+class UVRCameraBoomComponent;
 class UCameraComponent;
 class UInputMappingContext;
 class UInputAction;
+class UVRStreamingPredictorComponent;
 struct FInputActionValue;
+struct FVRHitchPlayerState;
 
 DECLARE_LOG_CATEGORY_EXTERN(LogDesktopCharacter, Log, All);
 
+/**
+ * Desktop player character that can switch between third and first person.
+ *
+ * ADesktopThirdPersonCharacter and ADesktopFirstPersonCharacter are the same character fixed to one perspective,
+ * without the cameras and bindings for the other.
+ */
 UCLASS(config = Game)
 class ADesktopCharacter : public ACharacter
 {
@@ -22,7 +31,7 @@ class ADesktopCharacter : public ACharacter
 
     /** Camera boom positioning the camera behind the character */
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
-    USpringArmComponent* CameraBoom;
+    UVRCameraBoomComponent* CameraBoom;
 
     /** The maximum length of the camera boom. */
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (AllowPrivateAccess = "true"))
@@ -44,6 +53,10 @@ class ADesktopCharacter : public ACharacter
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
     UCameraComponent* FirstPersonCamera;
 
+    /** Prefetches World Partition cells ahead of the character */
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Streaming, meta = (AllowPrivateAccess = "true"))
+    UVRStreamingPredictorComponent* StreamingPredictor;
+
     /** Zoom Input Action */
     UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
     UInputAction* ZoomAction;
@@ -52,6 +65,32 @@ class ADesktopCharacter : public ACharacter
     UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
     UInputAction* PerspectiveAction;
 
+    /** The shortest time, in seconds, allowed between two perspective toggles */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (AllowPrivateAccess = "true"))
+    float MinPerspectiveToggleInterval = 0.2f;
+
+    /** How often, in seconds, a perspective change the server hasn't answered yet is sent again */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (AllowPrivateAccess = "true"))
+    float PerspectiveResendInterval = 0.25f;
+
+    /** Bit 0 is set in first person. The upper seven bits number the owning client's requests. */
+    UPROPERTY(ReplicatedUsing = OnRep_PerspectiveState)
+    uint8 PerspectiveState = 0;
+
+    /** The last state this client asked the server for, while it is still unanswered */
+    uint8 PendingPerspectiveState = 0;
+    bool bPerspectivePending = false;
+    double LastPerspectiveToggleTime = -1.0;
+    FTimerHandle PerspectiveResendTimer;
+
+    /** When the pending request was first sent, and how long the last answered one took */
+    double PerspectiveRequestSeconds = 0.0;
+    double LastPerspectiveRoundTripMs = 0.0;
+
+    /** Totals kept on the owning client for VRLab.Perspective.LatencyTest */
+    uint32 PerspectiveRequestsSent = 0;
+    uint32 PerspectiveCorrections = 0;
+
     /** MappingContext */
     UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Input, meta = (AllowPrivateAccess = "true"))
     UInputMappingContext* DefaultMappingContext;
@@ -69,9 +108,39 @@ class ADesktopCharacter : public ACharacter
     UInputAction* LookAction;
 
 public:
-    ADesktopCharacter();
+    ADesktopCharacter(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
+
+    virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+    /** Fill in the camera pose, perspective and input state for a hitch capture */
+    void DescribeForHitch(FVRHitchPlayerState& State) const;
+
+    /** Third or first person */
+    virtual EVRCharacterMode GetCharacterMode() const;
+
+    /** Blueprint subclasses are DesktopPawn primary assets, which the asset manager puts in a chunk of their own */
+    virtual FPrimaryAssetId GetPrimaryAssetId() const override;
+
+    /** Stop the timers and significance updates a hidden character doesn't need, when parked in the pawn pool */
+    virtual void ParkForReuse();
+
+    /** Clear perspective, camera and input state left over from a previous player, when taken from the pawn pool */
+    virtual void ResetForReuse();
+
+    /**
+     * Wait for the local client's character, toggle its perspective Toggles times, and log the round trip to the server
+     * and the corrections it sent back. Backs VRLab.Perspective.LatencyTest.
+     */
+    static void StartPerspectiveLatencyTest(int32 Toggles, bool bQuitWhenDone);
 
 protected:
+    /** Leave out the cameras a mode doesn't use. For the constructors of fixed-mode subclasses. */
+    template <typename TPolicy>
+    static const FObjectInitializer& ForMode(const FObjectInitializer& ObjectInitializer);
+
+    /** Are both cameras here to switch between? */
+    bool CanTogglePerspective() const { return FollowCamera != nullptr && FirstPersonCamera != nullptr; }
+
     /** Called for movement input */
     void Move(const FInputActionValue& Value);
 
@@ -83,9 +152,15 @@ protected:
 
     bool IsInFirstPerson() const;
     void TogglePerspective();
+    void ApplyPerspective(bool bFirstPerson);
+    void ResendPerspectiveRequest();
+    static bool TickPerspectiveLatencyTest(float DeltaTime);
 
-    UFUNCTION(Server, Reliable, WithValidation)
-    void Server_TogglePerspective();
+    UFUNCTION(Server, Unreliable)
+    void Server_SetPerspective(uint8 RequestedState);
+
+    UFUNCTION()
+    void OnRep_PerspectiveState();
 
 protected:
     // APawn interface
@@ -94,9 +169,29 @@ protected:
     // To add mapping context
     virtual void BeginPlay() override;
 
+    // To leave the significance manager
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+    // To time the update for the significance manager
+    virtual void Tick(float DeltaTime) override;
+
 public:
     /** Returns CameraBoom subobject **/
-    FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
+    FORCEINLINE class UVRCameraBoomComponent* GetCameraBoom() const { return CameraBoom; }
     /** Returns FollowCamera subobject **/
     FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 };
+
+template <typename TPolicy>
+const FObjectInitializer& ADesktopCharacter::ForMode(const FObjectInitializer& ObjectInitializer)
+{
+    if constexpr (!TPolicy::bFollowCamera)
+    {
+        ObjectInitializer.DoNotCreateDefaultSubobject(TEXT("CameraBoom")).DoNotCreateDefaultSubobject(TEXT("FollowCamera"));
+    }
+    if constexpr (!TPolicy::bFirstPersonCamera)
+    {
+        ObjectInitializer.DoNotCreateDefaultSubobject(TEXT("FirstPersonCamera"));
+    }
+    return ObjectInitializer;
+}
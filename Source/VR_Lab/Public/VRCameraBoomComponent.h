@@ -0,0 +1,60 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/SpringArmComponent.h"
+#include "WorldCollision.h"
+#include "VRCameraBoomComponent.generated.h"
+
+/**
+ * Spring arm whose collision probe runs through the async trace API.
+ *
+ * Each frame's sweep is issued asynchronously and its result is used on the next frame. The previous hit is applied
+ * as a fraction of the current arm, so the camera follows the arm as it swings. When the obstruction clears, the arm
+ * eases back out instead of snapping. If the arm has moved too far since the probe was issued for its result to be
+ * trusted, a synchronous sweep is done that frame instead. VRLab.CameraBoom.ForceSyncProbe switches every boom back
+ * to the engine's synchronous probe so the two can be compared under stat VR_Lab.
+ */
+UCLASS(ClassGroup = Camera, meta = (BlueprintSpawnableComponent))
+class VR_LAB_API UVRCameraBoomComponent : public USpringArmComponent
+{
+    GENERATED_BODY()
+
+public:
+    UVRCameraBoomComponent();
+
+    /** Stop or restart ticking the boom, e.g. while the camera on the end of it isn't in use */
+    void SetProbingEnabled(bool bEnabled);
+
+    /** Probe with async sweeps rather than a synchronous sweep every frame */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = CameraCollision)
+    bool bAsyncProbe = true;
+
+    /** How far in cm the end of the arm may move between issuing a probe and using it (default: 50) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = CameraCollision, meta = (EditCondition = "bAsyncProbe"))
+    float MaxProbeDrift = 50.0f;
+
+    /** How quickly the arm extends again once an obstruction clears (default: 6) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = CameraCollision, meta = (EditCondition = "bAsyncProbe"))
+    float ReleaseSpeed = 6.0f;
+
+protected:
+    virtual void UpdateDesiredArmLocation(bool bDoTrace, bool bDoLocationLag, bool bDoRotationLag, float DeltaTime) override;
+
+private:
+    void UpdateAsyncProbe(float DeltaTime);
+    void OnProbeTraced(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum);
+
+    FTraceDelegate ProbeDelegate;
+    uint32 ProbeId = 0;
+    bool bProbeInFlight = false;
+
+    /** Latest probe result that hasn't been used yet */
+    bool bHasProbeResult = false;
+    float ProbeHitFraction = 1.0f;
+    FVector ProbeEnd = FVector::ZeroVector;
+
+    /** Fraction of the full arm the camera currently sits at */
+    float ArmFraction = 1.0f;
+};
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "VRCharacterModes.h"
 #include "GameFramework/Character.h"
 #include "VRCharacter.generated.h"
 
@@ -12,6 +13,12 @@ class UCameraComponent;
 class UMotionControllerComponent;
 class UInputAction;
 class UInputMappingContext;
+class UEnhancedInputComponent;
+class UVRTeleportComponent;
+class UVRStreamingPredictorComponent;
+class UVRPhysicsHandComponent;
+class UVRPlayAreaBoundaryComponent;
+struct FVRHitchPlayerState;
 DECLARE_LOG_CATEGORY_EXTERN(LogVRCharacter, Log, All);
 
 UENUM()
@@ -26,6 +33,29 @@ enum class EForwardSource : uint8
     HMD, LeftController, RightController
 };
 
+UENUM()
+enum class ELocomotionMode : uint8
+{
+    Smooth, Teleport
+};
+
+/** Tracking poses sampled once per frame and shared by everything in the character that reads them */
+struct FVRTrackingSample
+{
+    uint64 FrameNumber = MAX_uint64;
+    bool bHeadTracked = false;
+    FRotator HeadRotation = FRotator::ZeroRotator;
+    FVector HeadPosition = FVector::ZeroVector;
+    FTransform LeftController = FTransform::Identity;
+    FTransform RightController = FTransform::Identity;
+};
+
+/**
+ * VR player character that can be seated or room-scale, chosen by SeatedVR when it spawns.
+ *
+ * ASeatedVRCharacter and ARoomScaleVRCharacter are the same character fixed to one mode, which leaves out what the
+ * other mode needs. Use them for levels that only support one.
+ */
 UCLASS()
 class VR_LAB_API AVRCharacter : public ACharacter
 {
@@ -33,29 +63,78 @@ class VR_LAB_API AVRCharacter : public ACharacter
 
 public:
     // Sets default values for this character's properties
-    AVRCharacter();
+    AVRCharacter(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
 
 protected:
     // Called when the game starts or when spawned
     virtual void BeginPlay() override;
 
+    // Called when the character leaves play
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+    // Called from Tick to run the per-frame update for this character's mode
+    virtual void TickForMode(float DeltaTime);
+
+    /** The per-frame update for one mode, with everything the mode doesn't use compiled out */
+    template <typename TPolicy>
+    void TickMode(float DeltaTime);
+
+    // Called from SetupPlayerInputComponent to bind the input only this character's mode uses
+    virtual void BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent);
+
+    /** Bind the input one mode uses */
+    template <typename TPolicy>
+    void BindModeInput(UEnhancedInputComponent* EnhancedInputComponent);
+
+    /** Leave out the subobjects a mode doesn't use. For the constructors of fixed-mode subclasses. */
+    template <typename TPolicy>
+    static const FObjectInitializer& ForMode(const FObjectInitializer& ObjectInitializer);
+
 public:
     // Called every frame
     virtual void Tick(float DeltaTime) override;
 
+    /** Stop the timers and significance updates a hidden character doesn't need, when parked in the pawn pool */
+    virtual void ParkForReuse();
+
+    /** Clear input, pose and tracking state left over from a previous player, when taken from the pawn pool */
+    virtual void ResetForReuse();
+
+    /** Run one frame of the mode's update alone, without the rest of the tick or movement. For benchmarks. */
+    void TickModeForBenchmark(float DeltaTime);
+
+    // Called when the character is possessed or unpossessed
+    virtual void NotifyControllerChanged() override;
+
     // Called to bind functionality to input
     virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
     void Move(const FInputActionValue& Value);
     void SmoothTurn(const FInputActionValue& Value);
     void SnapTurn(const FInputActionValue& Value);
+    void ReleaseSnapTurn(const FInputActionValue& Value);
     void PerformJump(const FInputActionValue& Value);
+    void BeginTeleportAim(const FInputActionValue& Value);
+    void FinishTeleport(const FInputActionValue& Value);
+    void CancelTeleport(const FInputActionValue& Value);
     void ToggleCrouch(const FInputActionValue& Value);
     void GrabAxisLeft(const float AxisValue) const;
     void GrabAxisRight(const float AxisValue) const;
     void UpdateRoomScaleLocation();
+
+    /** Size the capsule from the head height and pick EPose from it. Only the room-scale policy moves the capsule. */
+    template <typename TPolicy>
     void UpdateCapsuleHeight();
 
+    /** Fill in the head pose, EPose and input state for a hitch capture */
+    void DescribeForHitch(FVRHitchPlayerState& State) const;
+
+    /** Seated or room-scale */
+    virtual EVRCharacterMode GetCharacterMode() const;
+
+    /** Blueprint subclasses are VRPawn primary assets, which the asset manager puts in a chunk of their own */
+    virtual FPrimaryAssetId GetPrimaryAssetId() const override;
+
     /** Is this a seated or standing VR experience? */
     UPROPERTY(EditAnywhere, Category = "VR|Camera")
     bool SeatedVR = false;
@@ -63,6 +142,10 @@ public:
     /** Does the player want to allow toggling of crouch? This is always true if Seated. */
     bool AllowCrouchToggle = true;
 
+    /** Should the thumbstick move smoothly or aim a teleport? (default: smooth) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement")
+    ELocomotionMode LocomotionMode = ELocomotionMode::Smooth;
+
     /** Should smooth rotation be used instead of snap turning? (default: false) */
     UPROPERTY(EditAnywhere, Category = "VR|Movement|Turn")
     bool EnableSmoothRotation = false;
@@ -71,7 +154,7 @@ public:
     UPROPERTY(EditAnywhere, Category = "VR|Movement|Turn")
     float SmoothRotationRate = 30.0f;
 
-    /** How long of a delay should there be when snap turning? (default: 0.3) */
+    /** How long should the stick be held before a snap turn repeats? (default: 0.2) */
     UPROPERTY(EditAnywhere, Category = "VR|Movement|Turn")
     float SnapTurnDelay = 0.2f;
 
@@ -79,6 +162,10 @@ public:
     UPROPERTY(EditAnywhere, Category = "VR|Movement|Turn")
     float SnapTurnAngle = 15.0f;
 
+    /** How far must the stick be pushed before a snap turn is triggered? (default: 0.5) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Turn", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+    float SnapTurnDeadZone = 0.5f;
+
     /** Should the left or right hand control movement? (default: true) */
     UPROPERTY(EditAnywhere, Category = "VR|Movement")
     bool bRightHandedControls = true;
@@ -131,10 +218,27 @@ public:
     UPROPERTY(EditAnywhere, Category = "VR|Mesh")
     USkeletalMesh* LeftHandMeshSkeleton;
 
+    /**
+     * Give the hands physical presence with colliders that follow the controllers from the async physics tick. Off by
+     * default; the hands are still created but stay inactive, without collision or ticking.
+     */
+    UPROPERTY(EditAnywhere, Category = "VR|Physics")
+    bool bPhysicsHands = false;
+
     /** Toggles whether to display controllers or hand meshes */
     UPROPERTY(EditAnywhere, Category = "VR|Mesh")
     bool ShowControllers = true;
 
+    /**
+     * How often, in seconds, to check which controllers each hand is holding. OpenXR often reports no device until the
+     * runtime has picked an interaction profile, and reports a new one when the player swaps controllers.
+     */
+    UPROPERTY(EditAnywhere, Category = "VR|Mesh")
+    float ControllerModelPollInterval = 0.5f;
+
+    /** Show the controllers or the hand meshes */
+    void SetShowControllers(bool bShow);
+
 private:
     UPROPERTY(EditAnywhere, Category = "VR|Input|Context")
     TObjectPtr<UInputMappingContext> DefaultMappingContext;
@@ -154,12 +258,35 @@ private:
     UPROPERTY(EditAnywhere, Category = "VR|Input|Actions")
     TObjectPtr<UInputAction> SnapTurnAction;
 
+    /** Left unset, the character maps its own: push the left thumbstick forward to aim and let go to teleport */
+    UPROPERTY(EditAnywhere, Category = "VR|Input|Actions")
+    TObjectPtr<UInputAction> TeleportAction;
+
+    /** Holds the built-in teleport mapping when TeleportAction is left unset */
+    UPROPERTY(Transient)
+    TObjectPtr<UInputMappingContext> TeleportMappingContext;
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Movement", meta = (AllowPrivateAccess = "true"))
+    TObjectPtr<UVRTeleportComponent> TeleportComponent;
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Streaming", meta = (AllowPrivateAccess = "true"))
+    TObjectPtr<UVRStreamingPredictorComponent> StreamingPredictor;
+
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|MotionController", meta = (AllowPrivateAccess = "true"))
     TObjectPtr<UMotionControllerComponent> LeftMotionController;
 
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|MotionController", meta = (AllowPrivateAccess = "true"))
     TObjectPtr<UMotionControllerComponent> RightMotionController;
 
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Physics", meta = (AllowPrivateAccess = "true"))
+    TObjectPtr<UVRPhysicsHandComponent> LeftPhysicsHand;
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Physics", meta = (AllowPrivateAccess = "true"))
+    TObjectPtr<UVRPhysicsHandComponent> RightPhysicsHand;
+
+    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Boundary", meta = (AllowPrivateAccess = "true"))
+    TObjectPtr<UVRPlayAreaBoundaryComponent> PlayAreaBoundary;
+
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "VR|Camera", meta = (AllowPrivateAccess = "true"))
     TObjectPtr<USceneComponent> VROrigin;
 
@@ -175,8 +302,53 @@ private:
     TObjectPtr<UArrowComponent> RightHandForwardArrow;
     TObjectPtr<UArrowComponent> RightHandRightArrow;
 
-    bool bCanSnapTurn = false;
+    /** This frame's tracking sample, taken by whichever consumer asks first */
+    const FVRTrackingSample& GetTrackingSample(const TCHAR* Consumer);
+    void SampleTracking();
+    void VerifyTrackingSample(const TCHAR* Consumer) const;
+    void SetTrackingPrerequisites(AController* Target, bool bEnable) const;
+    void CreateDefaultTeleportInput();
+
+    void SetPose(EPose NewPose);
+    void UpdateDebugArrows() const;
+    void QueueSnapTurn();
+    void ApplyPendingSnapTurns();
+    void RefreshControllerModels();
+
+    /** Direction the stick is currently held in for snap turning: -1 left, 0 neutral, 1 right */
+    int8 SnapTurnDirection = 0;
+
+    /** Snap turns queued since the last Tick. Repeats that land in the same frame become a single rotation. */
+    int32 PendingSnapTurns = 0;
+
+    FTimerHandle SnapTurnRepeatTimer;
+    FTimerHandle ControllerModelTimer;
+
+    /** The device each hand's model was last applied for. None until the XR system reports one. */
+    FName LeftControllerDevice;
+    FName RightControllerDevice;
+
+    FVRTrackingSample TrackingSample;
     float PreviousCapsuleHeight;
 
     EPose CurrentPose = EPose::Standing;
 };
+
+template <typename TPolicy>
+const FObjectInitializer& AVRCharacter::ForMode(const FObjectInitializer& ObjectInitializer)
+{
+    if constexpr (!TPolicy::bDebugArrows)
+    {
+        ObjectInitializer.DoNotCreateDefaultSubobject(TEXT("LeftHandForwardArrow"))
+                         .DoNotCreateDefaultSubobject(TEXT("LeftHandForwardGoArrow"))
+                         .DoNotCreateDefaultSubobject(TEXT("LeftHandRightGoArrow"))
+                         .DoNotCreateDefaultSubobject(TEXT("LeftHandRightArrow"))
+                         .DoNotCreateDefaultSubobject(TEXT("RightHandForwardArrow"))
+                         .DoNotCreateDefaultSubobject(TEXT("RightHandRightArrow"));
+    }
+    if constexpr (!TPolicy::bPlayAreaBoundary)
+    {
+        ObjectInitializer.DoNotCreateDefaultSubobject(TEXT("PlayAreaBoundary"));
+    }
+    return ObjectInitializer;
+}
@@ -0,0 +1,73 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VRCharacterModes.generated.h"
+
+/** The ways a player can be embodied */
+UENUM()
+enum class EVRCharacterMode : uint8
+{
+    Seated, RoomScale, DesktopThirdPerson, DesktopFirstPerson
+};
+
+/*
+ * Compile-time update policies, one per mode.
+ *
+ * The fixed-mode characters in VRModeCharacters.h build themselves from these, so a component the mode doesn't use is
+ * never created and a code path it doesn't take is compiled out with if constexpr. AVRCharacter and ADesktopCharacter
+ * still build everything and choose a policy at runtime, for levels that switch modes on the fly.
+ */
+
+/** Seated VR: the play space is the chair, and crouching is done with the thumbstick */
+struct FVRSeatedPolicy
+{
+    static constexpr EVRCharacterMode Mode = EVRCharacterMode::Seated;
+
+    /** Move the capsule under the HMD as the player walks around the play area */
+    static constexpr bool bRoomScale = false;
+
+    /** Size the capsule from the player's head height, which also decides EPose */
+    static constexpr bool bCapsuleFromHead = false;
+
+    /** Crouch and crawl from the thumbstick */
+    static constexpr bool bStickCrouch = true;
+
+    /** Distances from the head and hands to the edge of the play area */
+    static constexpr bool bPlayAreaBoundary = false;
+
+    /** Controller direction arrows, for debugging locomotion */
+    static constexpr bool bDebugArrows = false;
+};
+
+/** Standing VR: the player walks around the play area and crouches for real */
+struct FVRRoomScalePolicy
+{
+    static constexpr EVRCharacterMode Mode = EVRCharacterMode::RoomScale;
+    static constexpr bool bRoomScale = true;
+    static constexpr bool bCapsuleFromHead = true;
+    static constexpr bool bStickCrouch = false;
+    static constexpr bool bPlayAreaBoundary = true;
+    static constexpr bool bDebugArrows = false;
+};
+
+/** Desktop, viewed from a camera boom behind the character */
+struct FDesktopThirdPersonPolicy
+{
+    static constexpr EVRCharacterMode Mode = EVRCharacterMode::DesktopThirdPerson;
+
+    /** Camera boom and the follow camera on the end of it */
+    static constexpr bool bFollowCamera = true;
+
+    /** Camera in the character's head */
+    static constexpr bool bFirstPersonCamera = false;
+};
+
+/** Desktop, viewed from the character's head */
+struct FDesktopFirstPersonPolicy
+{
+    static constexpr EVRCharacterMode Mode = EVRCharacterMode::DesktopFirstPerson;
+    static constexpr bool bFollowCamera = false;
+    static constexpr bool bFirstPersonCamera = true;
+};
@@ -0,0 +1,102 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "InputCoreTypes.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "VRControllerModelCache.generated.h"
+
+class UStaticMesh;
+class UXRDeviceVisualizationComponent;
+struct FStreamableHandle;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRControllerModels, Log, All);
+
+/** The render models for one kind of controller */
+USTRUCT()
+struct FVRControllerModel
+{
+    GENERATED_BODY()
+
+    /** Device name as reported in FXRMotionControllerData, which is the interaction profile under OpenXR */
+    UPROPERTY(Config)
+    FName DeviceName;
+
+    UPROPERTY(Config)
+    TSoftObjectPtr<UStaticMesh> Left;
+
+    UPROPERTY(Config)
+    TSoftObjectPtr<UStaticMesh> Right;
+};
+
+/**
+ * Loads controller render models by device name and shares them between all characters.
+ *
+ * The first character to learn which controllers are in use starts an async load of their models. Until it finishes,
+ * visualization components show the placeholder mesh. Then they all switch to the real model together. The loaded
+ * models stay resident for the life of the game instance. Later characters, and toggling ShowControllers, therefore
+ * never load anything. Devices with no configured model are left to the XR system's own runtime models.
+ * VRLab.ControllerModels.List reports what has been loaded and how long each load took.
+ */
+UCLASS(config = Game)
+class VR_LAB_API UVRControllerModelCache : public UGameInstanceSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    /** Start loading a device's models. Does nothing if they are already loading or loaded. */
+    void Preload(FName DeviceName);
+
+    /**
+     * Show a device's model on a visualization component: the placeholder straight away, then the real model once it
+     * has loaded. This replaces anything asked for the component earlier, even if that is still loading. Returns false,
+     * putting the component back to its own default visualization, if the device has no configured model.
+     */
+    bool ApplyModel(UXRDeviceVisualizationComponent* Visualization, FName DeviceName, EControllerHand Hand);
+
+    bool IsLoaded(FName DeviceName) const;
+
+    /** Log every configured device and the state of its models */
+    void LogModels() const;
+
+private:
+    struct FLoad
+    {
+        TSharedPtr<FStreamableHandle> Handle;
+        double RequestTime = 0.0;
+        double LoadMs = -1.0;
+
+        /** Components showing the placeholder until this load finishes */
+        TArray<TPair<TWeakObjectPtr<UXRDeviceVisualizationComponent>, EControllerHand>> Waiting;
+    };
+
+    const FVRControllerModel* FindModel(FName DeviceName) const;
+    void OnModelLoaded(FName DeviceName);
+    void ShowModel(UXRDeviceVisualizationComponent* Visualization, const FVRControllerModel& Model, EControllerHand Hand) const;
+    void ShowPlaceholder(UXRDeviceVisualizationComponent* Visualization) const;
+    void ShowDefault(UXRDeviceVisualizationComponent* Visualization) const;
+
+    /** Stop an earlier load from showing its model on the component when it finishes */
+    void RemoveWaiting(const UXRDeviceVisualizationComponent* Visualization);
+
+    /** Render models to load, one entry per device */
+    UPROPERTY(Config)
+    TArray<FVRControllerModel> Models;
+
+    /** Cheap mesh shown while a device's models load */
+    UPROPERTY(Config)
+    TSoftObjectPtr<UStaticMesh> PlaceholderMesh;
+
+    /** Scale applied to the placeholder, so a stock engine shape can stand in at roughly controller size */
+    UPROPERTY(Config)
+    float PlaceholderScale = 1.0f;
+
+    UPROPERTY()
+    TObjectPtr<UStaticMesh> Placeholder;
+
+    TMap<FName, FLoad> Loads;
+};
@@ -6,11 +6,67 @@
 #include "GameFramework/GameModeBase.h"
 #include "VRGameModeBase.generated.h"
 
+DECLARE_LOG_CATEGORY_EXTERN(LogVRGameMode, Log, All);
+
 /**
+ * Game mode that keeps a pool of pre-spawned player pawns.
+ *
+ * Pawns are spawned while the map loads and parked hidden, without collision or ticking. Joining or respawning players
+ * take a parked pawn instead of paying for SpawnActor and component registration, and pawns released on respawn or
+ * logout go back into the pool instead of being destroyed. AVRPlayerController releases its pawn when the player
+ * leaves. A parked pawn is taken out of the significance manager and its timers stop through its character's
+ * ParkForReuse, and a pawn taken from the pool is reset and put back through ResetForReuse.
  *
+ * No map uses this game mode yet, and the global default is BP_StartupGameMode. To try it, open a map with
+ * ?game=/Game/Blueprints/BP_VRGameMode.BP_VRGameMode_C. VRLab.PawnPool.Benchmark then respawns the first player with
+ * the pool off and then on. It reports the spawn time, the objects each respawn leaves for the garbage collector, and
+ * how long collecting them takes.
  */
 UCLASS()
 class VR_LAB_API AVRGameModeBase : public AGameModeBase
 {
     GENERATED_BODY()
+
+public:
+    AVRGameModeBase();
+
+    virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+    virtual void StartPlay() override;
+    virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+
+    /** Return the controller's pawn to the pool and restart the player with a pooled one */
+    UFUNCTION(BlueprintCallable, Category = "VR|Pool")
+    void RespawnPlayer(AController* Controller);
+
+    /** Park a pawn in the pool instead of destroying it. Returns false if its class isn't pooled. */
+    UFUNCTION(BlueprintCallable, Category = "VR|Pool")
+    bool ReleasePawn(APawn* Pawn);
+
+    /** Respawn the first player Respawns times with the pool off, then on, and log the cost of each */
+    void BenchmarkRespawns(int32 Respawns);
+
+protected:
+    /** Should player pawns be pooled? Turn off to compare against plain spawning. (default: true) */
+    UPROPERTY(EditDefaultsOnly, Category = "VR|Pool")
+    bool bUsePawnPool = true;
+
+    /** Pawn classes to pre-warm during load. The default pawn class is used when this is empty. */
+    UPROPERTY(EditDefaultsOnly, Category = "VR|Pool")
+    TArray<TSubclassOf<APawn>> PooledPawnClasses;
+
+    /** How many pawns of each pooled class to spawn during load (default: 2) */
+    UPROPERTY(EditDefaultsOnly, Category = "VR|Pool", meta = (ClampMin = "0"))
+    int32 PawnPoolSize = 2;
+
+private:
+    bool IsPooledClass(const UClass* PawnClass) const;
+    APawn* SpawnPooledPawn(UClass* PawnClass);
+    APawn* AcquirePawn(const UClass* PawnClass, const FTransform& SpawnTransform);
+    static void ParkPawn(APawn* Pawn);
+
+    UPROPERTY(Transient)
+    TArray<TObjectPtr<APawn>> PooledPawns;
+
+    int32 PoolHits = 0;
+    int32 PoolMisses = 0;
 };
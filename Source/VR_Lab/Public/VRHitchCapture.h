@@ -0,0 +1,81 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+class APawn;
+class UInputAction;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRHitch, Log, All);
+
+/** Where the local player was and what they were doing when a hitch was captured */
+struct VR_LAB_API FVRHitchPlayerState
+{
+    FString PawnName;
+    FVector Location = FVector::ZeroVector;
+    FRotator Rotation = FRotator::ZeroRotator;
+    FVector Velocity = FVector::ZeroVector;
+    FVector HeadLocation = FVector::ZeroVector;
+    FRotator HeadRotation = FRotator::ZeroRotator;
+
+    /** EPose for VR characters, the camera perspective for desktop characters */
+    FString Pose;
+
+    /** Current value of each input action, by action name */
+    TArray<TPair<FString, FString>> Inputs;
+
+    /** Record the current value of one of the pawn's input actions */
+    void AddInput(const APawn* Pawn, const UInputAction* Action);
+};
+
+/**
+ * Always-on hitch capture.
+ *
+ * VR_Lab timing scopes are recorded into a fixed ring on the game thread, alongside the start and end of every frame
+ * and every garbage collection. When a frame's work, less any time spent idle for the frame rate limit, takes longer
+ * than VRLab.Hitch.ThresholdFrames target frame times (or VRLab.Hitch.ThresholdMs, if set), the last
+ * VRLab.Hitch.WindowSeconds of scopes are written as JSON to Saved/Profiling/Hitches, together with the local player's
+ * pose, input state and EPose. Formatting and writing happen on a worker thread, so a capture doesn't add a hitch of
+ * its own. Nothing here depends on rendering or an HMD, so captures work the same on headless Linux runs and on Quest.
+ */
+class VR_LAB_API FVRHitchCapture
+{
+public:
+    static void Startup();
+    static void Shutdown();
+
+    /** Record a closed scope. Only the game thread is recorded; calls from other threads are ignored. */
+    static void RecordScope(const TCHAR* Name, uint64 StartCycles, uint64 EndCycles);
+
+    /** Record an instantaneous event, such as a streaming cell arriving */
+    static void RecordMarker(const TCHAR* Name);
+
+    /** Write the current window to disk now, whatever the frame time */
+    static void Capture(const TCHAR* Reason);
+};
+
+/** Times the enclosing block for hitch capture. Use VRLAB_HITCH_SCOPE rather than declaring one directly. */
+class FVRHitchScope
+{
+public:
+    explicit FVRHitchScope(const TCHAR* InName)
+        : Name(InName), StartCycles(FPlatformTime::Cycles64())
+    {
+    }
+
+    ~FVRHitchScope()
+    {
+        FVRHitchCapture::RecordScope(Name, StartCycles, FPlatformTime::Cycles64());
+    }
+
+private:
+    const TCHAR* Name;
+    uint64 StartCycles;
+};
+
+/** Time the rest of the block for hitch capture, and in Unreal Insights when a trace is running */
+#define VRLAB_HITCH_SCOPE(Name) \
+    TRACE_CPUPROFILER_EVENT_SCOPE(VRLab_##Name); \
+    FVRHitchScope PREPROCESSOR_JOIN(VRHitchScope_, __LINE__)(TEXT(#Name))
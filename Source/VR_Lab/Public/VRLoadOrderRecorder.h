@@ -0,0 +1,29 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRLoadOrder, Log, All);
+
+/**
+ * Startup and map load timing, and an optional recording of the order packages load in.
+ *
+ * The time from process start to the first map being ready, and the time each map takes to load, are always logged.
+ * That lets a packaged build be compared before and after its containers are reordered.
+ *
+ * With -VRRecordLoadOrder on the command line, every package is also noted the first time it starts loading. The
+ * list is written to Saved/FileOpenOrder/GameOpenOrder.log in the format the packaging tools read from
+ * Build/<Platform>/FileOpenOrder. The file is written on exit, on VRLab.LoadOrder.Write, or, with
+ * -VRRecordLoadOrderSeconds=N, N seconds after the first map loads, after which the game quits. That makes it a single
+ * scripted run.
+ */
+class VR_LAB_API FVRLoadOrderRecorder
+{
+public:
+    static void Startup();
+    static void Shutdown();
+
+    /** Write what has been recorded so far. Returns false if nothing is being recorded. */
+    static bool Write();
+};
@@ -0,0 +1,86 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "VRMemoryReport.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRMemory, Log, All);
+
+/** Memory held by one kind of component on one character */
+USTRUCT(BlueprintType)
+struct FVRMemoryReportRow
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    FString Character;
+
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    FString Category;
+
+    /** Number of components of this kind */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int32 Count = 0;
+
+    /** The objects themselves and the containers they own */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 ObjectBytes = 0;
+
+    /** Render and physics state owned by the components */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 ResourceBytes = 0;
+
+    /** Meshes, materials and textures first referenced by this kind of component. Each asset is counted once. */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 AssetBytes = 0;
+
+    /** Heap held under the VRLab/CharacterTick LLM tag by every character together. Only set on the CharacterTick row. */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 TickHeapBytes = 0;
+
+    /** Average change of that heap from one frame to the next, in either direction */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 TickBytesPerFrame = 0;
+
+    /** Largest change of that heap in one frame */
+    UPROPERTY(BlueprintReadOnly, Category = "VR|Memory")
+    int64 TickBytesPeakFrame = 0;
+};
+
+/**
+ * Measures what a character costs in memory, broken down by component type.
+ *
+ * Object and resource sizes come from the same sources as obj list. Measuring only reads the characters, it never ticks
+ * them. VRLab.Memory.Characters [file.csv] reports every character in the world and writes the rows to CSV for the
+ * headless benchmark.
+ *
+ * What characters allocate while they tick is tracked by the VRLab/CharacterTick LLM tag instead, and stat LLMFULL
+ * shows it live. With -llm, VRLab.Memory.Characters [file.csv] [frames=60] follows the tag for that many frames and
+ * adds a CharacterTick row with the heap it holds and how much that changes per frame. LLM totals tags once a frame,
+ * so an allocation freed within the frame it was made in cancels out there. To see those, record a memory trace
+ * (-trace=default,memory) and filter by the tag in Unreal Insights.
+ */
+UCLASS()
+class VR_LAB_API UVRMemoryReportLibrary : public UBlueprintFunctionLibrary
+{
+    GENERATED_BODY()
+
+public:
+    /** Measure one character. The last row holds the character's totals. */
+    UFUNCTION(BlueprintCallable, Category = "VR|Memory")
+    static TArray<FVRMemoryReportRow> MeasureCharacter(AActor* Character);
+
+    /** Measure every character in the world */
+    UFUNCTION(BlueprintCallable, Category = "VR|Memory", meta = (WorldContext = "WorldContextObject"))
+    static TArray<FVRMemoryReportRow> MeasureAllCharacters(const UObject* WorldContextObject);
+
+    /** Heap currently held under the VRLab/CharacterTick LLM tag, or -1 when the game wasn't run with -llm */
+    static int64 GetCharacterTickBytes();
+
+    UFUNCTION(BlueprintCallable, Category = "VR|Memory")
+    static bool WriteCsv(const TArray<FVRMemoryReportRow>& Rows, const FString& FileName);
+
+    static FString ToCsv(const TArray<FVRMemoryReportRow>& Rows);
+};
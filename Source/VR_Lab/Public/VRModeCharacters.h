@@ -0,0 +1,74 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DesktopCharacter.h"
+#include "VRCharacter.h"
+#include "VRModeCharacters.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRCharacterModes, Log, All);
+
+/*
+ * Characters fixed to a single mode.
+ *
+ * Each is built from its policy in VRCharacterModes.h. It leaves out the subobjects the mode doesn't use and ticks
+ * through a direct call to its mode's update, without checking the mode every frame. VRLab.Characters.ModeBenchmark
+ * compares them with the all-in-one characters.
+ */
+
+/** VR character for seated levels */
+UCLASS()
+class VR_LAB_API ASeatedVRCharacter : public AVRCharacter
+{
+    GENERATED_BODY()
+
+public:
+    ASeatedVRCharacter(const FObjectInitializer& ObjectInitializer);
+
+    virtual EVRCharacterMode GetCharacterMode() const override { return FVRSeatedPolicy::Mode; }
+
+protected:
+    virtual void TickForMode(float DeltaTime) override;
+    virtual void BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent) override;
+};
+
+/** VR character for standing, room-scale levels */
+UCLASS()
+class VR_LAB_API ARoomScaleVRCharacter : public AVRCharacter
+{
+    GENERATED_BODY()
+
+public:
+    ARoomScaleVRCharacter(const FObjectInitializer& ObjectInitializer);
+
+    virtual EVRCharacterMode GetCharacterMode() const override { return FVRRoomScalePolicy::Mode; }
+
+protected:
+    virtual void TickForMode(float DeltaTime) override;
+    virtual void BindInputForMode(UEnhancedInputComponent* EnhancedInputComponent) override;
+};
+
+/** Desktop character that only has the follow camera */
+UCLASS()
+class ADesktopThirdPersonCharacter : public ADesktopCharacter
+{
+    GENERATED_BODY()
+
+public:
+    ADesktopThirdPersonCharacter(const FObjectInitializer& ObjectInitializer);
+
+    virtual EVRCharacterMode GetCharacterMode() const override { return FDesktopThirdPersonPolicy::Mode; }
+};
+
+/** Desktop character that only has the first person camera */
+UCLASS()
+class ADesktopFirstPersonCharacter : public ADesktopCharacter
+{
+    GENERATED_BODY()
+
+public:
+    ADesktopFirstPersonCharacter(const FObjectInitializer& ObjectInitializer);
+
+    virtual EVRCharacterMode GetCharacterMode() const override { return FDesktopFirstPersonPolicy::Mode; }
+};
@@ -0,0 +1,105 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SphereComponent.h"
+#include "VRPhysicsHandComponent.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRPhysicsHand, Log, All);
+
+/** How closely a physics hand followed its target over a number of physics steps */
+struct FVRPhysicsHandError
+{
+    int32 Steps = 0;
+    float SumCm = 0.0f;
+    float MaxCm = 0.0f;
+
+    void Add(const float ErrorCm)
+    {
+        ++Steps;
+        SumCm += ErrorCm;
+        MaxCm = FMath::Max(MaxCm, ErrorCm);
+    }
+
+    float GetAverageCm() const { return Steps > 0 ? SumCm / Steps : 0.0f; }
+};
+
+/**
+ * Simulated collider that follows a tracked hand from the async physics tick.
+ *
+ * The game thread only publishes where the hand should be, once a frame. Each fixed physics step then sets the body's
+ * velocities to reach that target by the next step, so collisions are resolved by the solver at the physics rate
+ * rather than by sweeping a kinematic body at the render rate. Contacts raise no game-thread events, so game-thread
+ * cost doesn't grow with the number of things the hand touches. Needs Tick Physics Async in the physics settings.
+ *
+ * Starts inactive, without collision or ticking. Activate it once it has a target to follow. Activating fails with a
+ * warning while Tick Physics Async is off, since nothing would ever move the hand.
+ */
+UCLASS(ClassGroup = Physics, meta = (BlueprintSpawnableComponent))
+class VR_LAB_API UVRPhysicsHandComponent : public USphereComponent
+{
+    GENERATED_BODY()
+
+public:
+    UVRPhysicsHandComponent();
+
+    /** Follow this component, usually a motion controller */
+    void SetTrackingTarget(USceneComponent* Target);
+
+    /** Follow a fixed world transform instead of a component */
+    void SetTargetTransform(const FTransform& Target);
+
+    /** Forget the tracking error and move the hand straight to its target, e.g. when its character is reused */
+    void ResetTracking();
+
+    /** Tracking error since the last call, which resets it */
+    FVRPhysicsHandError ConsumeTrackingError();
+
+    /** Game-thread cycles spent on this hand since the last call, which resets it */
+    uint64 ConsumeGameThreadCycles();
+
+    virtual void Activate(bool bReset = false) override;
+    virtual void Deactivate() override;
+    virtual void BeginPlay() override;
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+    virtual void AsyncPhysicsTickComponent(float DeltaTime, float SimTime) override;
+
+    /** Fraction of the distance to the target closed each physics step (default: 1) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VR|Physics", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+    float LinearResponse = 1.0f;
+
+    /** Fraction of the rotation to the target closed each physics step (default: 1) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VR|Physics", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+    float AngularResponse = 1.0f;
+
+    /** Fastest the hand may move in cm/s, so a tracking glitch can't fling props across the room (default: 1500) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VR|Physics")
+    float MaxLinearSpeed = 1500.0f;
+
+    /** Fastest the hand may turn in degrees/s (default: 1440) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VR|Physics")
+    float MaxAngularSpeed = 1440.0f;
+
+    /** A hand further than this from its target in cm, e.g. after a teleport, jumps straight there (default: 50) */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "VR|Physics")
+    float SnapDistance = 50.0f;
+
+private:
+    void PublishTarget(const FTransform& Target);
+
+    /** Turn simulation, collision and both ticks on or off together */
+    void SetFollowing(bool bFollow);
+
+    TWeakObjectPtr<USceneComponent> TrackingTarget;
+
+    /** Shared with the physics thread */
+    FCriticalSection TargetLock;
+    FTransform TargetTransform = FTransform::Identity;
+    bool bHasTarget = false;
+    FVRPhysicsHandError TrackingError;
+    FVRPhysicsHandError StepError;
+    float LastStepErrorCm = 0.0f;
+
+    uint64 GameThreadCycles = 0;
+};
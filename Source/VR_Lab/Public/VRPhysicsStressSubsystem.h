@@ -0,0 +1,68 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VRPhysicsHandComponent.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VRPhysicsStressSubsystem.generated.h"
+
+namespace VRPhysicsStress
+{
+    class FStepTimer;
+}
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRPhysicsStress, Log, All);
+
+/**
+ * Headless stress test for the async physics hands.
+ *
+ * VRLab.Physics.HandStress drops a pile of simulated props onto a floor and sweeps a pair of UVRPhysicsHandComponents
+ * through it on a fixed path. When it finishes it logs how long each physics step took on the physics thread, what the
+ * hands cost the game thread, and how far the hands trailed their targets. For example,
+ * -ExecCmds="VRLab.Physics.HandStress 1000 30 quit" on a -nullrhi run.
+ */
+UCLASS()
+class VR_LAB_API UVRPhysicsStressSubsystem : public UTickableWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Deinitialize() override;
+    virtual void Tick(float DeltaTime) override;
+    virtual TStatId GetStatId() const override;
+
+    /** Spawn PropCount props and sweep the hands through them for Duration seconds */
+    void StartHandStress(int32 PropCount, float Duration, bool bQuitWhenDone);
+
+    bool IsRunning() const { return TimeRemaining > 0.0f; }
+
+protected:
+    virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+    void SpawnScene(int32 PropCount);
+    void UpdateHandTargets() const;
+    void Finish();
+    void Cleanup();
+
+    UPROPERTY()
+    TArray<TObjectPtr<AActor>> SpawnedActors;
+
+    UPROPERTY()
+    TArray<TObjectPtr<UVRPhysicsHandComponent>> Hands;
+
+    VRPhysicsStress::FStepTimer* StepTimer = nullptr;
+
+    FVector Center = FVector::ZeroVector;
+    int32 PropCount = 0;
+    float Elapsed = 0.0f;
+    float TimeRemaining = 0.0f;
+    bool bQuitWhenDone = false;
+
+    int32 Frames = 0;
+    float FrameMsSum = 0.0f;
+    float FrameMsMax = 0.0f;
+    uint64 HandGameThreadCycles = 0;
+    FVRPhysicsHandError HandError;
+};
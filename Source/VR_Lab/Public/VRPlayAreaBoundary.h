@@ -0,0 +1,141 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "InputCoreTypes.h"
+#include "Components/ActorComponent.h"
+#include "VRPlayAreaBoundary.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRBoundary, Log, All);
+
+/**
+ * Signed distance to a play area polygon, sampled onto a 2D grid so that looking it up is constant time.
+ *
+ * Distances are in tracking space centimetres, positive inside the play area and negative outside. Between samples the
+ * grid is interpolated bilinearly, which is exact along straight edges and rounds off corners by under a cell. Kept
+ * free of engine state so it can be built from a stand-in polygon and checked against the brute-force distance
+ * headless, with VRLab.Boundary.Benchmark.
+ */
+class VR_LAB_API FVRPlayAreaDistanceField
+{
+public:
+    /** Sample the polygon onto cells of CellSize, covering its bounds plus Margin on every side */
+    void Build(TArrayView<const FVector2D> Polygon, float InCellSize = 5.0f, float Margin = 50.0f);
+    void Reset();
+
+    bool IsValid() const { return Distances.Num() > 0; }
+    int32 GetNumCells() const { return Distances.Num(); }
+
+    /** Distance to the boundary. Beyond the grid it carries on from the grid's edge, so it only grows more negative. */
+    float GetDistance(const FVector2D& Point) const;
+
+    /** Unit direction in which the distance increases, pointing into the play area */
+    FVector2D GetGradient(const FVector2D& Point) const;
+
+    /** Move a point that is closer than MinDistance to the boundary, or outside it, back in along the gradient */
+    FVector2D ClampInside(const FVector2D& Point, float MinDistance) const;
+
+    /** Exact distance, for building the field and checking it. Linear in the number of edges. */
+    static float GetDistanceBruteForce(TArrayView<const FVector2D> Polygon, const FVector2D& Point);
+
+private:
+    float GetSample(const int32 X, const int32 Y) const { return Distances[Y * SizeX + X]; }
+
+    FVector2D Origin = FVector2D::ZeroVector;
+    float CellSize = 5.0f;
+    int32 SizeX = 0;
+    int32 SizeY = 0;
+    TArray<float> Distances;
+};
+
+/**
+ * Tracks how close the player's head and hands are to the edge of the play area.
+ *
+ * The distance field is rebuilt from the tracking system's stage bounds when the character sets the tracking origin,
+ * and again whenever the headset is recentered. If the tracking system has no bounds there is no boundary: nothing is
+ * warned about or clamped. Tests and benchmarks that run headless can ask for the stand-in polygon instead, with
+ * bUseStandInPolygon or -VRStandInBoundary. The character feeds in the head and hand positions once a frame. Every
+ * query after that is a lookup. Coming within WarningDistance is recorded in telemetry.
+ */
+UCLASS(ClassGroup = VR, meta = (BlueprintSpawnableComponent))
+class VR_LAB_API UVRPlayAreaBoundaryComponent : public UActorComponent
+{
+    GENERATED_BODY()
+
+public:
+    UVRPlayAreaBoundaryComponent();
+
+    virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+    /**
+     * Build from the tracking system's stage bounds. Without any, use the stand-in polygon if it was asked for, or
+     * else clear the boundary.
+     */
+    void BuildFromTrackingSystem();
+
+    /** Build from a polygon in tracking space */
+    void SetPolygon(const TArray<FVector2D>& NewPolygon);
+
+    bool HasBoundary() const { return Field.IsValid(); }
+    const FVRPlayAreaDistanceField& GetField() const { return Field; }
+
+    /** Take this frame's head and hand positions, in tracking space */
+    void UpdateTracking(const FVector& Head, const FVector& LeftHand, const FVector& RightHand);
+
+    float GetHeadDistance() const { return HeadDistance; }
+    float GetHandDistance(EControllerHand Hand) const;
+
+    /** Is the head or either hand within WarningDistance of the boundary? */
+    bool IsNearBoundary() const { return bNearBoundary; }
+
+    /** Where room-scale may place the head, in tracking space, at least ClampDistance inside the play area */
+    FVector ClampHead(const FVector& Head) const;
+
+    /** A 3 x 2.5 m room with a corner cut off, standing in for a guardian polygon */
+    static TArray<FVector2D> MakeStandInPolygon();
+
+    /** Size of a distance field cell in cm (default: 5) */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary", meta = (ClampMin = "1.0"))
+    float CellSize = 5.0f;
+
+    /** How close the head or a hand may come to the boundary before the player is warned, in cm (default: 30) */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary")
+    float WarningDistance = 30.0f;
+
+    /** Stop room-scale from moving the capsule past the boundary (default: true) */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary")
+    bool bClampRoomScale = true;
+
+    /** How far inside the boundary room-scale keeps the capsule, in cm (default: 10) */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary")
+    float ClampDistance = 10.0f;
+
+    /**
+     * Use StandInPolygon when the tracking system doesn't report a play area. For tests and benchmarks only: a real
+     * headset without bounds should get no boundary at all. (default: false)
+     */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary")
+    bool bUseStandInPolygon = false;
+
+    /** Play area used when the tracking system doesn't report one and bUseStandInPolygon is set, in tracking space cm */
+    UPROPERTY(EditAnywhere, Category = "VR|Boundary")
+    TArray<FVector2D> StandInPolygon;
+
+private:
+    void OnRecenter();
+    void ClearBoundary();
+
+    /** Was the boundary last built from the tracking system, so that a recenter should build it again? */
+    bool bFromTrackingSystem = false;
+
+    FVRPlayAreaDistanceField Field;
+    TArray<FVector2D> Polygon;
+    FDelegateHandle RecenterHandle;
+
+    float HeadDistance = MAX_flt;
+    float LeftHandDistance = MAX_flt;
+    float RightHandDistance = MAX_flt;
+    bool bNearBoundary = false;
+};
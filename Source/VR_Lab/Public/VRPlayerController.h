@@ -0,0 +1,22 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/PlayerController.h"
+#include "VRPlayerController.generated.h"
+
+/**
+ * Player controller that hands its pawn back to AVRGameModeBase's pool when the player leaves.
+ *
+ * The base class destroys the pawn in PawnLeavingGame, before the game mode's Logout runs, so this is the last point
+ * at which the pawn can still be reclaimed.
+ */
+UCLASS()
+class VR_LAB_API AVRPlayerController : public APlayerController
+{
+    GENERATED_BODY()
+
+public:
+    virtual void PawnLeavingGame() override;
+};
@@ -0,0 +1,178 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+#include "VRQualityGovernor.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRQualityGovernor, Log, All);
+
+/** One step on the quality ladder. Tier 0 is the highest quality and should match the project's renderer settings. */
+USTRUCT()
+struct FVRQualityTier
+{
+    GENERATED_BODY()
+
+    UPROPERTY(Config)
+    FName Name;
+
+    /** r.ScreenPercentage */
+    UPROPERTY(Config)
+    float ScreenPercentage = 100.0f;
+
+    /** r.Shadow.Virtual.Enable */
+    UPROPERTY(Config)
+    bool bVirtualShadows = true;
+
+    /** sg.ShadowQuality, 0 (low) to 3 (epic) */
+    UPROPERTY(Config)
+    int32 ShadowQuality = 3;
+
+    /** r.DynamicGlobalIlluminationMethod: 0 none, 1 Lumen */
+    UPROPERTY(Config)
+    int32 DynamicGlobalIlluminationMethod = 1;
+
+    /** r.ReflectionMethod: 0 none, 1 Lumen, 2 screen space */
+    UPROPERTY(Config)
+    int32 ReflectionMethod = 1;
+
+    /** Multiplier for the significance manager's character budget */
+    UPROPERTY(Config)
+    float CharacterBudgetScale = 1.0f;
+};
+
+/** Thread times for one frame in milliseconds */
+struct FVRFrameTimeSample
+{
+    float GameThreadMs = 0.0f;
+    float RenderThreadMs = 0.0f;
+    float GPUMs = 0.0f;
+
+    float GetBottleneckMs() const { return FMath::Max3(GameThreadMs, RenderThreadMs, GPUMs); }
+
+    /** "Game", "Render" or "GPU", whichever took longest */
+    const TCHAR* GetBottleneckName() const
+    {
+        return GPUMs >= GameThreadMs && GPUMs >= RenderThreadMs ? TEXT("GPU") : RenderThreadMs >= GameThreadMs ? TEXT("Render") : TEXT("Game");
+    }
+};
+
+/**
+ * Decides which quality tier to run at from a stream of frame times.
+ *
+ * Kept free of engine state so recorded traces can be replayed through it headless. The slowest of the game, render
+ * and GPU times is averaged over a rolling window. When the average exceeds DownshiftRatio of the frame budget, the
+ * governor drops a tier. It only climbs back once the average has stayed under UpshiftRatio for UpshiftHoldFrames.
+ * Each change clears the window so the next decision is based entirely on frames from the new tier. The per-thread
+ * averages of the window that caused the latest change are kept for reporting.
+ */
+class VR_LAB_API FVRQualityGovernor
+{
+public:
+    struct FSettings
+    {
+        int32 NumTiers = 1;
+        float FrameBudgetMs = 1000.0f / 72.0f;
+        int32 WindowFrames = 60;
+        float DownshiftRatio = 0.95f;
+        float UpshiftRatio = 0.75f;
+        int32 UpshiftHoldFrames = 300;
+    };
+
+    explicit FVRQualityGovernor(const FSettings& InSettings);
+
+    /** Feed one frame. Returns the tier to run at from now on. */
+    int32 AddSample(const FVRFrameTimeSample& Sample);
+
+    int32 GetTier() const { return Tier; }
+    float GetAverageMs() const { return NumSamples > 0 ? WindowSumMs / NumSamples : 0.0f; }
+
+    /** Average game, render and GPU times over the window that caused the latest tier change */
+    const FVRFrameTimeSample& GetChangeAverage() const { return ChangeAverage; }
+
+    /** Average bottleneck time, as compared against the thresholds, of the window that caused the latest change */
+    float GetChangeAverageMs() const { return ChangeAverageMs; }
+
+    /** Feed a whole trace through a fresh governor. Returns the tiers it ran at in order, starting with tier 0. */
+    static TArray<int32> Replay(const FSettings& Settings, TConstArrayView<FVRFrameTimeSample> Samples);
+
+private:
+    void ChangeTier(int32 NewTier);
+    void ResetWindow();
+
+    FSettings Settings;
+    TArray<FVRFrameTimeSample> Window;
+    int32 NextSample = 0;
+    int32 NumSamples = 0;
+    float WindowSumMs = 0.0f;
+    FVRFrameTimeSample WindowSum;
+    FVRFrameTimeSample ChangeAverage;
+    float ChangeAverageMs = 0.0f;
+    int32 FramesUnderUpshift = 0;
+    int32 Tier = 0;
+};
+
+/**
+ * Watches frame times while the game runs and moves the renderer between the configured quality tiers.
+ *
+ * Recorded traces can be checked headless with VRLab.QualityGovernor.Replay <csv> [tiers] [quit], where each line
+ * holds the game, render and GPU milliseconds of one frame. Given the expected tier sequence, such as 0,1,2,1, the
+ * replay fails when the governor's decisions differ.
+ */
+UCLASS(config = Game)
+class VR_LAB_API UVRQualityGovernorSubsystem : public UGameInstanceSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+    int32 GetCurrentTier() const { return Governor.IsValid() ? Governor->GetTier() : 0; }
+
+    /** Governor settings built from this class's config */
+    FVRQualityGovernor::FSettings MakeGovernorSettings() const;
+
+    /**
+     * Replay a CSV of frame times through a fresh governor and log every tier decision. Returns false if the file can't
+     * be read, or if ExpectedTiers isn't empty and the tiers the governor went through don't match it.
+     */
+    static bool ReplayTrace(const FString& FileName, const TArray<int32>& ExpectedTiers);
+
+private:
+    void ApplyTier(int32 TierIndex);
+
+    /** Turn the governor off entirely */
+    UPROPERTY(Config)
+    bool bEnabled = true;
+
+    /** Refresh rate the headset is expected to run at */
+    UPROPERTY(Config)
+    float TargetFrameRate = 72.0f;
+
+    UPROPERTY(Config)
+    int32 WindowFrames = 60;
+
+    UPROPERTY(Config)
+    float DownshiftRatio = 0.95f;
+
+    UPROPERTY(Config)
+    float UpshiftRatio = 0.75f;
+
+    UPROPERTY(Config)
+    int32 UpshiftHoldFrames = 300;
+
+    /** Tiers ordered from highest to lowest quality */
+    UPROPERTY(Config)
+    TArray<FVRQualityTier> Tiers;
+
+    TUniquePtr<FVRQualityGovernor> Governor;
+    bool bInitialized = false;
+};
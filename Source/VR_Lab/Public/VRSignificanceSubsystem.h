@@ -0,0 +1,172 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VRSignificanceSubsystem.generated.h"
+
+class ACharacter;
+DECLARE_LOG_CATEGORY_EXTERN(LogVRSignificance, Log, All);
+
+/** How often a character, its components and its skeletal meshes update at a given significance */
+USTRUCT()
+struct FVRSignificanceTier
+{
+    GENERATED_BODY()
+
+    /** Lowest significance (0-1) that still qualifies for this tier */
+    UPROPERTY(Config)
+    float MinSignificance = 0.0f;
+
+    /** Tick interval applied to the actor and all of its ticking components. 0 ticks every frame. */
+    UPROPERTY(Config)
+    float TickInterval = 0.0f;
+
+    /** Keep evaluating animation while the mesh is off-screen */
+    UPROPERTY(Config)
+    bool bTickPoseWhenNotRendered = true;
+
+    /** Frames skeletal meshes skip between animation updates, through update rate optimization. 0 updates every frame. */
+    UPROPERTY(Config)
+    int32 AnimFrameSkip = 0;
+};
+
+/**
+ * Throttles characters that the local viewers can't see well.
+ *
+ * Every character registers itself on BeginPlay. Once per frame the significance manager scores each one by distance
+ * to the nearest player view and whether it was rendered recently. Characters are then walked from most to least
+ * significant and given the best tier that fits into the remaining game-thread budget. Locally controlled pawns are
+ * never throttled.
+ *
+ * What a character costs is measured: each one times its own tick through FVRCharacterTickTimer. Component ticks, such
+ * as movement and animation, run separately, so FullRateCharacterCostMs is the least a character is assumed to cost.
+ * VRLab.Significance.Benchmark measures the whole per-character cost from game-thread time to calibrate it, and checks
+ * that hundreds of characters stay inside the budget.
+ */
+UCLASS(config = Game)
+class VR_LAB_API UVRSignificanceSubsystem : public UTickableWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+    virtual void Tick(float DeltaTime) override;
+    virtual TStatId GetStatId() const override;
+
+    void RegisterCharacter(ACharacter* Character);
+    void UnregisterCharacter(ACharacter* Character);
+
+    /** Record how long one of a character's ticks took */
+    void ReportTickCost(ACharacter* Character, float CostMs);
+
+    /** Scale the character budget, e.g. from the quality governor. 1 is the configured budget. */
+    void SetBudgetScale(float InBudgetScale) { BudgetScale = FMath::Max(InBudgetScale, 0.0f); }
+    float GetBudgetScale() const { return BudgetScale; }
+
+    /**
+     * Spawn CharacterCount characters around the first player and measure game-thread time for FramesPerPhase frames
+     * each with no characters, with throttling and with every character at full rate. Logs the results on completion.
+     */
+    void StartBenchmark(int32 CharacterCount, int32 FramesPerPhase, bool bQuitWhenDone);
+
+    bool IsBenchmarkRunning() const { return BenchmarkPhase != EBenchmarkPhase::None; }
+
+protected:
+    virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+    struct FCharacterState
+    {
+        int32 Tier = 0;
+
+        /** Smoothed measured cost of one tick in ms, or negative before the first one */
+        float TickCostMs = -1.0f;
+    };
+
+    enum class EBenchmarkPhase : uint8
+    {
+        None,
+        Baseline,
+        Throttled,
+        FullRate
+    };
+
+    struct FBenchmarkPhaseResult
+    {
+        int32 Frames = 0;
+        double GameThreadMsSum = 0.0;
+        float GameThreadMsMax = 0.0f;
+        double MeasuredTickMsSum = 0.0;
+        double BudgetUsedMsSum = 0.0;
+        int32 FullRateSum = 0;
+
+        float GetAverage(const double Sum) const { return Frames > 0 ? static_cast<float>(Sum / Frames) : 0.0f; }
+    };
+
+    float CalculateSignificance(const AActor* Actor, const FTransform& Viewpoint) const;
+    float GetTierCostMs(int32 TierIndex, float DeltaTime, const FCharacterState& State) const;
+    void ApplyTier(ACharacter* Character, int32 TierIndex) const;
+    void SetThrottling(bool bEnabled);
+
+    void TickBenchmark(float BudgetUsedMs, int32 FullRateCount);
+    void SpawnBenchmarkCharacters();
+    void FinishBenchmark();
+    void LogBenchmarkPhase(const TCHAR* Name, const FBenchmarkPhaseResult& Result) const;
+
+    /** Distance in cm at which a character's distance significance reaches zero */
+    UPROPERTY(Config)
+    float MaxSignificanceDistance = 5000.0f;
+
+    /** Significance multiplier for characters that weren't rendered recently */
+    UPROPERTY(Config)
+    float NotRenderedSignificanceScale = 0.25f;
+
+    /** Game-thread time, in ms, that all characters together are allowed to take per frame */
+    UPROPERTY(Config)
+    float CharacterBudgetMs = 2.0f;
+
+    /** Least game-thread cost, in ms, assumed for one character updating every frame. Calibrate with the benchmark. */
+    UPROPERTY(Config)
+    float FullRateCharacterCostMs = 0.05f;
+
+    /** Tiers ordered from full rate to most throttled */
+    UPROPERTY(Config)
+    TArray<FVRSignificanceTier> Tiers;
+
+    /** Character spawned by VRLab.Significance.Benchmark */
+    UPROPERTY(Config)
+    TSoftClassPtr<ACharacter> BenchmarkCharacterClass;
+
+    float BudgetScale = 1.0f;
+    bool bThrottling = true;
+
+    /** Sum of the character ticks reported since the last update */
+    float FrameTickCostMs = 0.0f;
+
+    TMap<TWeakObjectPtr<ACharacter>, FCharacterState> Characters;
+
+    UPROPERTY(Transient)
+    TArray<TObjectPtr<ACharacter>> BenchmarkCharacters;
+
+    EBenchmarkPhase BenchmarkPhase = EBenchmarkPhase::None;
+    int32 BenchmarkCharacterCount = 0;
+    int32 BenchmarkFramesPerPhase = 0;
+    int32 BenchmarkWarmupFrames = 0;
+    bool bQuitAfterBenchmark = false;
+    FBenchmarkPhaseResult BenchmarkResults[4];
+};
+
+/** Times a character's tick for the significance subsystem, from construction to destruction */
+class VR_LAB_API FVRCharacterTickTimer
+{
+public:
+    explicit FVRCharacterTickTimer(ACharacter* InCharacter);
+    ~FVRCharacterTickTimer();
+
+private:
+    ACharacter* Character;
+    uint64 StartCycles;
+};
@@ -0,0 +1,93 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "WorldPartition/WorldPartitionStreamingSource.h"
+#include "VRStreamingPredictorComponent.generated.h"
+
+class UVRTeleportComponent;
+
+/**
+ * Prefetches World Partition cells along the path the owning pawn is about to take.
+ *
+ * The player controller's own streaming source only covers where the pawn is now, so cells ahead of a sprinting
+ * player are requested the moment they come into range and all finish at once. This component extrapolates the pawn's
+ * velocity along its current rate of turn and adds low-priority sources at points along that arc, plus one on the
+ * teleport target while aiming. Those sources only ask for cells to be loaded, not activated, so the expensive actor
+ * registration still happens under the streaming time budget, just spread over the frames before the player arrives.
+ */
+UCLASS(ClassGroup = (VR), meta = (BlueprintSpawnableComponent))
+class VR_LAB_API UVRStreamingPredictorComponent : public UActorComponent, public IWorldPartitionStreamingSourceProvider
+{
+    GENERATED_BODY()
+
+public:
+    UVRStreamingPredictorComponent();
+
+    virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+    // IWorldPartitionStreamingSourceProvider
+    virtual bool GetStreamingSources(TArray<FWorldPartitionStreamingSource>& OutStreamingSources) const override;
+    virtual const UObject* GetStreamingSourceOwner() const override { return this; }
+
+    /** Points the pawn is expected to pass through, nearest first */
+    const TArray<FVector>& GetPredictedPath() const { return PredictedPath; }
+
+    /** Has World Partition been told to ask this component for streaming sources? */
+    bool IsRegisteredWithWorldPartition() const { return bRegistered; }
+
+    /** How many seconds ahead to predict (default: 2) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    float LookaheadTime = 2.0f;
+
+    /** Number of prefetch sources spread along the predicted path (default: 3) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming", meta = (ClampMin = "1", ClampMax = "8"))
+    int32 PredictionSamples = 3;
+
+    /** Below this speed in cm/s nothing is predicted (default: 50) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    float MinPredictionSpeed = 50.0f;
+
+    /** Turn rates above this many degrees per second are treated as a snap turn and not extrapolated (default: 90) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    float MaxPredictedYawRate = 90.0f;
+
+    /** How quickly the predicted turn rate follows the measured one (default: 4) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    float YawRateSmoothing = 4.0f;
+
+    /** Fraction of each grid's loading range covered by a prefetch source (default: 0.5) */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+    float PrefetchLoadingRangeScale = 0.5f;
+
+    /** Prefetch around the teleport target while the owner is aiming */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    bool bPrefetchTeleportTarget = true;
+
+    /** Draw the predicted path */
+    UPROPERTY(EditAnywhere, Category = "VR|Streaming")
+    bool bDrawPrediction = false;
+
+private:
+    void PredictPath(const APawn* Pawn, float DeltaTime);
+    void AddSource(TArray<FWorldPartitionStreamingSource>& OutStreamingSources,
+                   FName Name,
+                   const FVector& Location,
+                   const FRotator& Rotation,
+                   EStreamingSourcePriority Priority) const;
+
+    TWeakObjectPtr<UVRTeleportComponent> TeleportComponent;
+
+    TArray<FVector> PredictedPath;
+    TArray<FName> SourceNames;
+    FName TeleportSourceName;
+
+    float PreviousVelocityYaw = 0.0f;
+    float SmoothedYawRate = 0.0f;
+    bool bHasPreviousVelocityYaw = false;
+    bool bRegistered = false;
+};
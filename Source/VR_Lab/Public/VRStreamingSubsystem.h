@@ -0,0 +1,126 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "WorldPartition/WorldPartitionStreamingSource.h"
+#include "VRStreamingSubsystem.generated.h"
+
+class ULevel;
+DECLARE_LOG_CATEGORY_EXTERN(LogVRStreaming, Log, All);
+
+/** One frame in which World Partition cells were added to or removed from the world */
+struct FVRStreamingFrame
+{
+    uint64 FrameNumber = 0;
+    float FrameMs = 0.0f;
+
+    /** How far the frame ran over the recent average of frames without streaming */
+    float CostMs = 0.0f;
+
+    int32 CellsAdded = 0;
+    int32 CellsRemoved = 0;
+    FVector PawnLocation = FVector::ZeroVector;
+    float PawnSpeed = 0.0f;
+};
+
+/**
+ * Keeps World Partition streaming inside a per-frame budget and measures what it still costs.
+ *
+ * On startup the configured budget is pushed into the engine's level streaming settings, which is what actually
+ * spreads actor registration and async loading over several frames. Cells are prefetched ahead of the player by
+ * UVRStreamingPredictorComponent. Every frame in which cells come or go is compared with the recent average of quiet
+ * frames, and the worst ones are kept for VRLab.Streaming.Report.
+ *
+ * VRLab.Streaming.FlyThrough moves the local pawn through the map at a fixed speed and turn rate and logs the report
+ * when it finishes, e.g. -ExecCmds="VRLab.Streaming.FlyThrough 670 60 0 quit" on a -nullrhi run for a headless
+ * benchmark. The report also says on how many frames the pawn's streaming predictor offered prefetch sources.
+ */
+UCLASS(config = Game)
+class VR_LAB_API UVRStreamingSubsystem : public UTickableWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+    virtual void Tick(float DeltaTime) override;
+    virtual TStatId GetStatId() const override;
+
+    /** Fly the first local pawn forward at Speed cm/s, turning at TurnRate degrees/s, for Duration seconds */
+    void StartFlyThrough(float Speed, float Duration, float TurnRate, bool bQuitWhenDone);
+
+    bool IsFlyingThrough() const { return FlyThroughTimeRemaining > 0.0f; }
+
+    /** The worst streaming frames so far, most expensive first */
+    const TArray<FVRStreamingFrame>& GetWorstFrames() const { return WorstFrames; }
+
+    void LogReport() const;
+    void ResetReport();
+
+protected:
+    virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+    void ApplyBudget() const;
+    void OnLevelAdded(ULevel* Level, UWorld* World);
+    void OnLevelRemoved(ULevel* Level, UWorld* World);
+    void RecordStreamingFrame(const FVRStreamingFrame& Frame);
+    void UpdateFlyThrough(float DeltaTime);
+    void FinishFlyThrough();
+
+    /** Push the budget below into the engine's streaming settings */
+    UPROPERTY(Config)
+    bool bApplyBudget = true;
+
+    /** s.LevelStreamingActorsUpdateTimeLimit: ms per frame spent adding and removing streamed actors */
+    UPROPERTY(Config)
+    float ActorsUpdateBudgetMs = 2.0f;
+
+    /** s.PriorityLevelStreamingActorsUpdateExtraTime: extra ms allowed for cells the player is standing in */
+    UPROPERTY(Config)
+    float PriorityActorsUpdateExtraMs = 1.0f;
+
+    /** s.UnregisterComponentsTimeLimit: ms per frame spent unregistering the components of removed cells */
+    UPROPERTY(Config)
+    float UnregisterComponentsBudgetMs = 1.0f;
+
+    /** s.AsyncLoadingTimeLimit: ms per frame the game thread spends finishing async loads */
+    UPROPERTY(Config)
+    float AsyncLoadingBudgetMs = 2.0f;
+
+    /** s.LevelStreamingComponentsRegistrationGranularity: components registered between budget checks */
+    UPROPERTY(Config)
+    int32 ComponentsRegistrationGranularity = 5;
+
+    /** wp.Runtime.BlockOnSlowStreaming: freezing the world in VR is worse than a late cell */
+    UPROPERTY(Config)
+    bool bBlockOnSlowStreaming = false;
+
+    /** Number of frames kept in the report */
+    UPROPERTY(Config)
+    int32 ReportFrameCount = 10;
+
+    /** Streaming frames costing more than this are logged as they happen */
+    UPROPERTY(Config)
+    float HitchThresholdMs = 5.0f;
+
+    TArray<FVRStreamingFrame> WorstFrames;
+    FDelegateHandle LevelAddedHandle;
+    FDelegateHandle LevelRemovedHandle;
+    int32 CellsAddedThisFrame = 0;
+    int32 CellsRemovedThisFrame = 0;
+    int32 StreamingFrameCount = 0;
+    double LastTickSeconds = 0.0;
+    float QuietFrameMs = 0.0f;
+
+    float FlyThroughSpeed = 0.0f;
+    float FlyThroughTurnRate = 0.0f;
+    float FlyThroughTimeRemaining = 0.0f;
+    bool bQuitAfterFlyThrough = false;
+    int32 FlyThroughFrames = 0;
+    int32 FlyThroughPrefetchFrames = 0;
+    int32 FlyThroughMaxPrefetchSources = 0;
+    TArray<FWorldPartitionStreamingSource> FlyThroughPrefetchSources;
+};
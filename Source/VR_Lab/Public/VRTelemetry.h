@@ -0,0 +1,74 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRTelemetry, Log, All);
+
+/** Event types written to the telemetry stream. Values are part of the file format; only append. */
+enum class EVRTelemetryEvent : uint8
+{
+    None = 0,
+    PoseChanged = 1,        // Data[0] = new EPose, Data[1] = previous EPose
+    Jump = 2,               // Data[0] = EPose at the time of the jump
+    PerspectiveToggled = 3, // Data[0] = 1 if now in first person
+    HMDActivated = 4,       // Name = HMD device name
+    MotionSource = 5,       // Name = motion source, Data[0] = EControllerHand
+    ControllerDevice = 6,   // Name = device name, Data[0] = EControllerHand
+    QualityTierChanged = 7, // Data[0] = new tier, Data[1] = previous tier
+    BoundaryWarning = 8,    // Data[0] = 1 on coming within the warning distance, 0 on leaving it, Data[1] = closest cm
+};
+
+VR_LAB_API const TCHAR* LexToString(EVRTelemetryEvent Event);
+
+/**
+ * One fixed-size telemetry record.
+ *
+ * Names are stored as their display index and number and only turned into strings by the writer thread, so recording
+ * an event never formats or allocates.
+ */
+struct FVRTelemetryRecord
+{
+    uint64 Cycles = 0;
+    uint32 ObjectId = 0;
+    EVRTelemetryEvent Event = EVRTelemetryEvent::None;
+    uint8 Padding[3] = {};
+    uint32 NameId = 0;
+    int32 NameNumber = 0;
+    int32 Data[2] = {};
+};
+
+static_assert(sizeof(FVRTelemetryRecord) == 32, "FVRTelemetryRecord is part of the file format");
+
+/**
+ * Low-overhead binary telemetry.
+ *
+ * Each recording thread owns a single-producer ring buffer, so Record only does a couple of relaxed atomic operations.
+ * A background writer drains every ring into Saved/Telemetry. Files are decoded offline with the VRTelemetryDecode
+ * commandlet. When a ring is full, new events are dropped and counted rather than blocking the caller.
+ *
+ * Off unless the game runs with -VRTelemetry or VRLab.Telemetry.Enable is set. Only the newest
+ * VRLab.Telemetry.MaxFiles files are kept.
+ */
+class VR_LAB_API FVRTelemetry
+{
+public:
+    static void Startup();
+    static void Shutdown();
+
+    static bool IsEnabled();
+
+    static void Record(EVRTelemetryEvent Event, uint32 ObjectId, int32 Data0 = 0, int32 Data1 = 0);
+    static void RecordName(EVRTelemetryEvent Event, uint32 ObjectId, FName Name, int32 Data0 = 0);
+
+    /** Decode the contents of a telemetry file into CSV. Returns false if the data isn't a telemetry stream. */
+    static bool DecodeToCsv(const TArray<uint8>& FileData, FString& OutCsv);
+
+    static constexpr uint32 FileMagic = 0x4C545256; // "VRTL"
+    static constexpr uint32 FileVersion = 1;
+
+private:
+    /** Only call while holding a producer scope, which keeps Shutdown from deleting the writer underneath */
+    static void Push(const FVRTelemetryRecord& Record);
+};
@@ -0,0 +1,22 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VRTelemetryDecodeCommandlet.generated.h"
+
+/**
+ * Turns a binary telemetry file into CSV.
+ *
+ * Usage: UnrealEditor-Cmd VR_Lab.uproject -run=VRTelemetryDecode -In=Saved/Telemetry/VRLab-....vrtl [-Out=Events.csv]
+ * Without -Out the CSV is written next to the input file.
+ */
+UCLASS()
+class UVRTelemetryDecodeCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,134 @@
+// Copyright 2024 Corysia Taware / Shoebox Games.  All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "WorldCollision.h"
+#include "VRTeleportComponent.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogVRTeleport, Log, All);
+
+/**
+ * Evaluates a parabolic teleport arc without ever blocking the game thread.
+ *
+ * Each arc is split into segments that are swept as one batch through the async trace API, so the results of a
+ * batch issued this frame arrive at the start of the next one. The first blocking segment is projected onto the
+ * navmesh. While the aim source barely moves the previous batch and its navmesh projection are reused.
+ */
+UCLASS(ClassGroup = (VR), meta = (BlueprintSpawnableComponent))
+class VR_LAB_API UVRTeleportComponent : public UActorComponent
+{
+    GENERATED_BODY()
+
+public:
+    UVRTeleportComponent();
+
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+    /** Start evaluating the arc from the forward vector of the given component */
+    void BeginAim(USceneComponent* InAimSource);
+
+    /** Stop evaluating the arc. Returns true and the navmesh location if a valid target was found. */
+    bool EndAim(FVector& OutTargetLocation);
+
+    /** Stop evaluating the arc and discard any target */
+    void CancelAim();
+
+    bool IsAiming() const { return AimSource.IsValid(); }
+    bool HasValidTarget() const { return bHasValidTarget; }
+    const FVector& GetTargetLocation() const { return TargetLocation; }
+
+    /** Total number of arc segment sweeps issued since play began */
+    UFUNCTION(BlueprintPure, Category = "VR|Movement|Teleport")
+    int32 GetTracesIssued() const { return TracesIssued; }
+
+    /** Seconds between the start of the last aim and the first valid target it produced */
+    UFUNCTION(BlueprintPure, Category = "VR|Movement|Teleport")
+    float GetLastAimToTargetLatency() const { return LastAimToTargetLatency; }
+
+    /** Launch speed of the arc in cm/s (default: 900) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float ArcLaunchSpeed = 900.0f;
+
+    /** Number of segments the arc is split into. Each segment is one async sweep. (default: 16) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport", meta = (ClampMin = "2", ClampMax = "64"))
+    int32 ArcSegments = 16;
+
+    /** Simulated flight time covered by each segment in seconds (default: 0.05) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float ArcSegmentTime = 0.05f;
+
+    /** Radius of the sphere swept along each segment (default: 2) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float ArcSweepRadius = 2.0f;
+
+    /** Collision channel the arc is swept against */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    TEnumAsByte<ECollisionChannel> ArcTraceChannel = ECC_Visibility;
+
+    /** Surfaces whose normal Z is below this are not valid landing spots (default: 0.7, roughly 45 degrees) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float MinLandingNormalZ = 0.7f;
+
+    /** Query extent used when projecting the arc hit onto the navmesh */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    FVector NavProjectionExtent = FVector(50.0f, 50.0f, 100.0f);
+
+    /** The aim is considered unchanged while the source moves less than this many cm (default: 1) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float AimLocationTolerance = 1.0f;
+
+    /** The aim is considered unchanged while the source turns less than this many degrees (default: 0.5) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float AimAngleTolerance = 0.5f;
+
+    /** Hits closer than this many cm to the last projected hit reuse its navmesh projection (default: 5) */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    float NavProjectionCacheTolerance = 5.0f;
+
+    /** Draw the arc and the target while aiming */
+    UPROPERTY(EditAnywhere, Category = "VR|Movement|Teleport")
+    bool bDrawArc = true;
+
+private:
+    void IssueArcBatch(const FVector& Origin, const FVector& Direction);
+    void OnArcSegmentTraced(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum);
+    void ResolveArcBatch();
+    bool ProjectToNavigation(const FVector& Point, FVector& OutLocation);
+    void DrawArc() const;
+
+    struct FArcSegmentResult
+    {
+        bool bReceived = false;
+        bool bBlockingHit = false;
+        FVector ImpactPoint = FVector::ZeroVector;
+        FVector ImpactNormal = FVector::UpVector;
+    };
+
+    TWeakObjectPtr<USceneComponent> AimSource;
+    FTraceDelegate ArcTraceDelegate;
+
+    TArray<FVector> ArcPoints;
+    TArray<FArcSegmentResult> SegmentResults;
+    uint32 BatchId = 0;
+    int32 PendingSegments = 0;
+    bool bBatchInFlight = false;
+    bool bHasIssuedBatch = false;
+
+    FVector LastAimOrigin = FVector::ZeroVector;
+    FVector LastAimDirection = FVector::ForwardVector;
+
+    bool bHasNavProjection = false;
+    bool bLastNavProjectionValid = false;
+    FVector LastNavQueryPoint = FVector::ZeroVector;
+    FVector LastNavProjection = FVector::ZeroVector;
+
+    bool bHasValidTarget = false;
+    FVector TargetLocation = FVector::ZeroVector;
+
+    double AimStartTime = 0.0;
+    bool bAimLatencyRecorded = false;
+    float LastAimToTargetLatency = 0.0f;
+    int32 TracesIssued = 0;
+};
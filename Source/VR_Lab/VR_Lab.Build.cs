@@ -10,7 +10,7 @@ public class VR_Lab : ModuleRules
 	
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "EnhancedInput", "HeadMountedDisplay", "UMG" });
 
-		PrivateDependencyModuleNames.AddRange(new string[] { "XRBase"  });
+		PrivateDependencyModuleNames.AddRange(new string[] { "XRBase", "NavigationSystem", "SignificanceManager", "RenderCore", "RHI", "Chaos", "PhysicsCore" });
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
@@ -1,6 +1,29 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "VR_Lab.h"
+#include "VRHitchCapture.h"
+#include "VRLoadOrderRecorder.h"
+#include "VRTelemetry.h"
 #include "Modules/ModuleManager.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, VR_Lab, "VR_Lab" );
+LLM_DEFINE_TAG(VRLab_CharacterTick);
+
+class FVRLabModule : public FDefaultGameModuleImpl
+{
+public:
+    virtual void StartupModule() override
+    {
+        FVRTelemetry::Startup();
+        FVRHitchCapture::Startup();
+        FVRLoadOrderRecorder::Startup();
+    }
+
+    virtual void ShutdownModule() override
+    {
+        FVRLoadOrderRecorder::Shutdown();
+        FVRHitchCapture::Shutdown();
+        FVRTelemetry::Shutdown();
+    }
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FVRLabModule, VR_Lab, "VR_Lab" );
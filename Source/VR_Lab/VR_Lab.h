@@ -3,4 +3,10 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Stats/Stats.h"
 
+DECLARE_STATS_GROUP(TEXT("VR_Lab"), STATGROUP_VRLab, STATCAT_Advanced);
+
+/** Heap allocated while characters tick. Shown by stat LLM when run with -llm, and tags the allocations in a memory trace. */
+LLM_DECLARE_TAG_API(VRLab_CharacterTick, VR_LAB_API);